@@ -0,0 +1,92 @@
+#include "astcompare.h"
+#include <string.h>
+
+static int same_list(ASTNode **a, ASTNode **b, int count);
+
+int same_tree(const ASTNode *a, const ASTNode *b)
+{
+    if (!a || !b)
+        return a == b;
+    if (a->type != b->type)
+        return 0;
+    switch (a->type)
+    {
+    case AST_NUMBER:
+        return a->data.number.kind == b->data.number.kind &&
+               (a->data.number.kind == TOKEN_INT ? a->data.number.intValue == b->data.number.intValue
+                                                 : a->data.number.floatValue == b->data.number.floatValue);
+    case AST_STRING:
+    case AST_IMPORT:
+        return strcmp(a->data.string, b->data.string) == 0;
+    case AST_IDENTIFIER:
+        return a->data.identifier == b->data.identifier;
+    case AST_BINARY_EXPR:
+        return a->data.binary.op == b->data.binary.op && same_tree(a->data.binary.left, b->data.binary.left) &&
+               same_tree(a->data.binary.right, b->data.binary.right);
+    case AST_UNARY_EXPR:
+        return a->data.unary.op == b->data.unary.op && same_tree(a->data.unary.operand, b->data.unary.operand);
+    case AST_VAR_DECL:
+        return a->data.varDecl.varName == b->data.varDecl.varName &&
+               same_tree(a->data.varDecl.varType, b->data.varDecl.varType) &&
+               same_tree(a->data.varDecl.initializer, b->data.varDecl.initializer);
+    case AST_RETURN:
+        return same_tree(a->data.returnStmt.expr, b->data.returnStmt.expr);
+    case AST_FUNCTION:
+        return a->data.function.name == b->data.function.name &&
+               a->data.function.paramCount == b->data.function.paramCount &&
+               same_list(a->data.function.params, b->data.function.params, a->data.function.paramCount) &&
+               same_tree(a->data.function.returnType, b->data.function.returnType) &&
+               same_tree(a->data.function.body, b->data.function.body);
+    case AST_IF:
+        return same_tree(a->data.ifStmt.condition, b->data.ifStmt.condition) &&
+               same_tree(a->data.ifStmt.thenBranch, b->data.ifStmt.thenBranch) &&
+               same_tree(a->data.ifStmt.elseBranch, b->data.ifStmt.elseBranch);
+    case AST_PROGRAM:
+        return a->data.program.count == b->data.program.count &&
+               same_list(a->data.program.statements, b->data.program.statements, a->data.program.count);
+    case AST_TYPE:
+        if (a->data.type.typeKind != b->data.type.typeKind)
+            return 0;
+        if (a->data.type.typeKind == AST_TYPE_ARRAY)
+            return same_tree(a->data.type.elementType, b->data.type.elementType);
+        if (a->data.type.typeKind == AST_TYPE_TUPLE)
+            return a->data.type.tuple.elementCount == b->data.type.tuple.elementCount &&
+                   same_list(a->data.type.tuple.elementTypes, b->data.type.tuple.elementTypes,
+                             a->data.type.tuple.elementCount);
+        if (a->data.type.typeKind == AST_TYPE_STRUCT)
+            return a->data.type.structType.name == b->data.type.structType.name &&
+                   a->data.type.structType.fieldCount == b->data.type.structType.fieldCount &&
+                   same_list(a->data.type.structType.fields, b->data.type.structType.fields,
+                             a->data.type.structType.fieldCount);
+        return 1;
+    case AST_FUNCTION_CALL:
+        return a->data.call.argCount == b->data.call.argCount && same_tree(a->data.call.callee, b->data.call.callee) &&
+               same_list(a->data.call.arguments, b->data.call.arguments, a->data.call.argCount);
+    case AST_PRINT_STATEMENT:
+        return same_tree(a->data.printStmt.expr, b->data.printStmt.expr);
+    case AST_ARRAY_LITERAL:
+        return a->data.arrayLiteral.elementCount == b->data.arrayLiteral.elementCount &&
+               same_list(a->data.arrayLiteral.elements, b->data.arrayLiteral.elements,
+                         a->data.arrayLiteral.elementCount);
+    case AST_WHILE:
+        return same_tree(a->data.whileStmt.condition, b->data.whileStmt.condition) &&
+               same_tree(a->data.whileStmt.body, b->data.whileStmt.body);
+    case AST_FOR:
+        return same_tree(a->data.forStmt.init, b->data.forStmt.init) &&
+               same_tree(a->data.forStmt.condition, b->data.forStmt.condition) &&
+               same_tree(a->data.forStmt.increment, b->data.forStmt.increment) &&
+               same_tree(a->data.forStmt.body, b->data.forStmt.body);
+    case AST_EXPR_STMT:
+        return same_tree(a->data.ExprStmt.expr, b->data.ExprStmt.expr);
+    default:
+        return 1;
+    }
+}
+
+static int same_list(ASTNode **a, ASTNode **b, int count)
+{
+    for (int i = 0; i < count; i++)
+        if (!same_tree(a[i], b[i]))
+            return 0;
+    return 1;
+}
@@ -0,0 +1,14 @@
+#ifndef JAM_AST_COMPARE_H
+#define JAM_AST_COMPARE_H
+
+#include "parser.h"
+
+/*
+ * Structural AST comparison for the benchmarks that check a tree against a
+ * fresh parse. Names compare as atoms, strings by content.
+ */
+
+// 1 when a and b have the same shape and contents; NULL only equals NULL
+int same_tree(const ASTNode *a, const ASTNode *b);
+
+#endif // JAM_AST_COMPARE_H
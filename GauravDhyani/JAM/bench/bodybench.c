@@ -0,0 +1,119 @@
+#include "astcompare.h"
+#include "jamcorpus.h"
+#include "lexer.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Parallel function body benchmark.
+ * Generates a functions-shape script of the given size in MB (default 16),
+ * tokenizes it once, then parses it, best of 5, with parseScript() and with
+ * parseScriptParallel() on 1, 2, 4, ... threads. Every parse starts from a
+ * fresh parser, as a script run does. The speedup of each thread count is
+ * against parseScriptParallel() on one thread, whose cost over parseScript()
+ * (the pre-scan and the hand-off of bodies) is printed on its own. Every
+ * parallel parse must leave no body lazy and build the same tree as
+ * parseScript().
+ */
+
+#define ROUNDS 5
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bodies_built(const ASTNode *program, int statements)
+{
+    if (program->data.program.count != statements)
+        return 0;
+    for (int i = 0; i < statements; i++)
+    {
+        const ASTNode *node = program->data.program.statements[i];
+        if (node->type == AST_FUNCTION && (node->data.function.lazyBody || !node->data.function.body))
+            return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 16;
+    size_t length;
+    char *source = generate_corpus(CORPUS_FUNCTIONS, mb * 1024 * 1024, 32, 1, &length);
+    TokenStream tokens;
+    if (!source || tokenize_n(source, length, &tokens) < 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    Parser parser, reference;
+    double base = 0;
+    int statements = 0, functions = 0;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        double t0 = now();
+        initParser(&parser, &tokens);
+        ParseResult result = parseScript(&parser);
+        double t = now() - t0;
+        if (!result.ast || result.diagnosticCount)
+        {
+            fprintf(stderr, "parse failed\n");
+            return 1;
+        }
+        if (base == 0 || t < base)
+            base = t;
+        statements = result.ast->data.program.count;
+        functions = 0;
+        for (int i = 0; i < statements; i++)
+            functions += result.ast->data.program.statements[i]->type == AST_FUNCTION;
+        freeParser(&parser);
+    }
+    // the tree every parallel parse is checked against
+    initParser(&reference, &tokens);
+    const ASTNode *expected = parseScript(&reference).ast;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%.1f MB, %d tokens, %d functions, %ld online CPUs\n", length / 1e6, tokens.count, functions, cpus);
+    printf("parseScript:          %8.2f ms\n", base * 1e3);
+
+    int maxThreads = cpus > 16 ? 16 : (int)cpus;
+    if (maxThreads < 4)
+        maxThreads = 4;
+    double one = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        double best = 0;
+        for (int round = 0; round < ROUNDS; round++)
+        {
+            double t0 = now();
+            initParser(&parser, &tokens);
+            ParseResult result = parseScriptParallel(&parser, threads);
+            double t = now() - t0;
+            if (!result.ast || result.diagnosticCount || !bodies_built(result.ast, statements) ||
+                !same_tree(result.ast, expected))
+            {
+                fprintf(stderr, "parallel parse differs with %d threads\n", threads);
+                return 1;
+            }
+            if (best == 0 || t < best)
+                best = t;
+            freeParser(&parser);
+        }
+        if (threads == 1)
+            one = best;
+        printf("parallel, %2d threads: %8.2f ms  speedup %.2fx\n", threads, best * 1e3, one / best);
+    }
+    printf("parallel on 1 thread takes %.2fx the time of parseScript\n", one / base);
+
+    freeParser(&reference);
+    free_token_stream(&tokens);
+    free(source);
+    return 0;
+}
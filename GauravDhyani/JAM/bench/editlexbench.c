@@ -0,0 +1,156 @@
+#include "lexer.h"
+#include "sourceloader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Incremental relexing benchmark.
+ * Generates scripts of 1, 8 and 64 MB (or the size given in MB), then
+ * simulates typing: a character is inserted and removed again, first at
+ * scattered places all over the file, then walking forward from a few random
+ * places, and each edit is brought into the token stream with
+ * retokenize_edit_tokens(). Prints the time of a full tokenize_n() pass and,
+ * for each pattern, the mean latency per edit, split into edits that keep the
+ * token count (a character typed into a word) and edits that add or drop
+ * tokens, which still move the arrays of every later token. Checks the final
+ * stream against a fresh one.
+ */
+
+#define EDITS 2000
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *generate(size_t bytes, size_t *length)
+{
+    static const char *lines[] = {
+        "var total: Int = count + 42;\n",
+        "** running sum of the generated rows\n",
+        "print(\"row value\");\n",
+        "*- a block comment\n   spanning two lines -*\n",
+        "while (i < 1000) { i = i + 1; }\n",
+    };
+    // room for the one byte an edit adds
+    char *source = malloc(bytes + 1 + SOURCE_PADDING);
+    size_t pos = 0;
+    unsigned state = 1;
+    while (1)
+    {
+        state = state * 1103515245u + 12345u;
+        const char *line = lines[(state >> 16) % 5];
+        size_t len = strlen(line);
+        if (pos + len >= bytes)
+            break;
+        memcpy(source + pos, line, len);
+        pos += len;
+    }
+    memset(source + pos, 0, 1 + SOURCE_PADDING);
+    *length = pos;
+    return source;
+}
+
+static int same_tokens(const TokenStream *a, const TokenStream *b)
+{
+    return a->count == b->count &&
+           memcmp(a->types, b->types, a->count) == 0 &&
+           memcmp(a->offsets, b->offsets, a->count * sizeof(int)) == 0 &&
+           memcmp(a->lengths, b->lengths, a->count * sizeof(int)) == 0;
+}
+
+// mean latency of the edits of one typing pattern, split by whether an edit
+// changed the token count
+typedef struct {
+    double spent[2];
+    int edits[2];
+} EditTimes;
+
+// type a character at at and delete it again, timing both edits
+static int type_at(TokenStream *tokens, char *source, size_t *length, int at, EditTimes *times)
+{
+    TokenEdit changed;
+    memmove(source + at + 1, source + at, *length - at);
+    source[at] = 'x';
+    ++*length;
+    double t0 = now();
+    if (retokenize_edit_tokens(tokens, source, *length, at, 0, 1, &changed) < 0)
+        return -1;
+    int grew = changed.inserted != changed.removed;
+    times->spent[grew] += now() - t0;
+    times->edits[grew]++;
+
+    memmove(source + at, source + at + 1, *length - at);
+    --*length;
+    t0 = now();
+    if (retokenize_edit_tokens(tokens, source, *length, at, 1, 0, &changed) < 0)
+        return -1;
+    grew = changed.inserted != changed.removed;
+    times->spent[grew] += now() - t0;
+    times->edits[grew]++;
+    return 0;
+}
+
+static void report(const char *pattern, const EditTimes *t)
+{
+    printf("    %-9s per edit %8.2f us (same count %8.2f us, count changed %8.2f us)\n", pattern,
+           (t->spent[0] + t->spent[1]) / (t->edits[0] + t->edits[1]) * 1e6,
+           t->edits[0] ? t->spent[0] / t->edits[0] * 1e6 : 0, t->edits[1] ? t->spent[1] / t->edits[1] * 1e6 : 0);
+}
+
+static int run(size_t mb)
+{
+    size_t length;
+    char *source = generate(mb * 1024 * 1024, &length);
+
+    TokenStream tokens;
+    double t0 = now();
+    if (tokenize_n(source, length, &tokens) < 0)
+        return 1;
+    double full = now() - t0;
+    int line, col;
+    token_position(&tokens, 0, &line, &col); // edits keep the line table current
+
+    // scattered: every edit lands somewhere else in the file; local: edits
+    // walk forward a few bytes at a time from a random place, as when typing
+    unsigned state = 7;
+    EditTimes scattered = {{0, 0}, {0, 0}}, local = {{0, 0}, {0, 0}};
+    for (int e = 0; e < EDITS; e++)
+    {
+        state = state * 1103515245u + 12345u;
+        if (type_at(&tokens, source, &length, (int)((state >> 4) % length), &scattered) != 0)
+            return 1;
+    }
+    int at = 0;
+    for (int e = 0; e < EDITS; e++)
+    {
+        state = state * 1103515245u + 12345u;
+        at = e % 100 == 0 ? (int)((state >> 4) % length) : (at + 1 + (int)((state >> 4) % 8)) % (int)length;
+        if (type_at(&tokens, source, &length, at, &local) != 0)
+            return 1;
+    }
+
+    TokenStream fresh;
+    tokenize_n(source, length, &fresh);
+    settle_token_offsets(&tokens);
+    int ok = same_tokens(&tokens, &fresh);
+    printf("%5.1f MB %9d tokens: full tokenize %8.2f ms%s\n", length / 1e6, tokens.count, full * 1e3,
+           ok ? "" : "  MISMATCH");
+    report("scattered", &scattered);
+    report("local", &local);
+    free_token_stream(&fresh);
+    free_token_stream(&tokens);
+    free(source);
+    return !ok;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        return run((size_t)atoi(argv[1]));
+    return run(1) | run(8) | run(64);
+}
@@ -0,0 +1,192 @@
+#include "flatast.h"
+#include "jamcorpus.h"
+#include "lexer.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Compact AST benchmark.
+ * Parses a generated mixed-shape script of the given size in MB (default 32),
+ * flattens it with flatten_ast(), and compares the two forms: bytes held by
+ * the pointer tree against the flat arrays, and the best time of a full
+ * pre-order walk over each. The walks must agree on the node count.
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long walk_tree(ASTNode *node, size_t *bytes);
+
+static long walk_list(ASTNode **nodes, int count, size_t *bytes)
+{
+    long n = 0;
+    *bytes += count * sizeof(ASTNode *);
+    for (int i = 0; i < count; i++)
+        n += walk_tree(nodes[i], bytes);
+    return n;
+}
+
+// nodes below node; *bytes collects the nodes and child arrays of the tree
+static long walk_tree(ASTNode *node, size_t *bytes)
+{
+    if (!node)
+        return 0;
+    *bytes += sizeof(ASTNode);
+    switch (node->type)
+    {
+    case AST_BINARY_EXPR:
+        return 1 + walk_tree(node->data.binary.left, bytes) + walk_tree(node->data.binary.right, bytes);
+    case AST_UNARY_EXPR:
+        return 1 + walk_tree(node->data.unary.operand, bytes);
+    case AST_VAR_DECL:
+        return 1 + walk_tree(node->data.varDecl.varType, bytes) + walk_tree(node->data.varDecl.initializer, bytes);
+    case AST_RETURN:
+        return 1 + walk_tree(node->data.returnStmt.expr, bytes);
+    case AST_FUNCTION:
+        return 1 + walk_list(node->data.function.params, node->data.function.paramCount, bytes) +
+               walk_tree(node->data.function.returnType, bytes) + walk_tree(node->data.function.body, bytes);
+    case AST_IF:
+        return 1 + walk_tree(node->data.ifStmt.condition, bytes) + walk_tree(node->data.ifStmt.thenBranch, bytes) +
+               walk_tree(node->data.ifStmt.elseBranch, bytes);
+    case AST_PROGRAM:
+        return 1 + walk_list(node->data.program.statements, node->data.program.count, bytes);
+    case AST_TYPE:
+        return 1 + (node->data.type.typeKind == AST_TYPE_ARRAY ? walk_tree(node->data.type.elementType, bytes) : 0);
+    case AST_FUNCTION_CALL:
+        return 1 + walk_tree(node->data.call.callee, bytes) +
+               walk_list(node->data.call.arguments, node->data.call.argCount, bytes);
+    case AST_PRINT_STATEMENT:
+        return 1 + walk_tree(node->data.printStmt.expr, bytes);
+    case AST_ARRAY_LITERAL:
+        return 1 + walk_list(node->data.arrayLiteral.elements, node->data.arrayLiteral.elementCount, bytes);
+    case AST_WHILE:
+        return 1 + walk_tree(node->data.whileStmt.condition, bytes) + walk_tree(node->data.whileStmt.body, bytes);
+    case AST_FOR:
+        return 1 + walk_tree(node->data.forStmt.init, bytes) + walk_tree(node->data.forStmt.condition, bytes) +
+               walk_tree(node->data.forStmt.increment, bytes) + walk_tree(node->data.forStmt.body, bytes);
+    case AST_EXPR_STMT:
+        return 1 + walk_tree(node->data.ExprStmt.expr, bytes);
+    default:
+        return 1;
+    }
+}
+
+static long walk_flat(const FlatAst *ast, FlatNode n);
+
+static long walk_flat_list(const FlatAst *ast, FlatNode n, int field)
+{
+    int count;
+    const FlatNode *list = flat_list(ast, n, field, &count);
+    long total = 0;
+    for (int i = 0; i < count; i++)
+        total += walk_flat(ast, list[i]);
+    return total;
+}
+
+static long walk_flat(const FlatAst *ast, FlatNode n)
+{
+    if (n == FLAT_NONE)
+        return 0;
+    switch (flat_kind(ast, n))
+    {
+    case AST_BINARY_EXPR:
+        return 1 + walk_flat(ast, flat_child(ast, n, FLAT_LEFT)) + walk_flat(ast, flat_child(ast, n, FLAT_RIGHT));
+    case AST_UNARY_EXPR:
+    case AST_RETURN:
+    case AST_PRINT_STATEMENT:
+    case AST_EXPR_STMT:
+        return 1 + walk_flat(ast, flat_child(ast, n, FLAT_EXPR));
+    case AST_VAR_DECL:
+        return 1 + walk_flat(ast, flat_child(ast, n, FLAT_VAR_TYPE)) + walk_flat(ast, flat_child(ast, n, FLAT_VAR_INIT));
+    case AST_FUNCTION:
+        return 1 + walk_flat_list(ast, n, FLAT_FN_PARAMS) + walk_flat(ast, flat_child(ast, n, FLAT_FN_RETURN)) +
+               walk_flat(ast, flat_child(ast, n, FLAT_FN_BODY));
+    case AST_IF:
+        return 1 + walk_flat(ast, flat_child(ast, n, FLAT_CONDITION)) + walk_flat(ast, flat_child(ast, n, FLAT_THEN)) +
+               walk_flat(ast, flat_child(ast, n, FLAT_ELSE));
+    case AST_PROGRAM:
+        return 1 + walk_flat_list(ast, n, FLAT_STATEMENTS);
+    case AST_TYPE:
+        return 1 + (flat_tag(ast, n) == AST_TYPE_ARRAY ? walk_flat(ast, flat_child(ast, n, FLAT_ELEMENT)) : 0);
+    case AST_FUNCTION_CALL:
+        return 1 + walk_flat(ast, flat_child(ast, n, FLAT_CALLEE)) + walk_flat_list(ast, n, FLAT_ARGUMENTS);
+    case AST_ARRAY_LITERAL:
+        return 1 + walk_flat_list(ast, n, FLAT_ELEMENTS);
+    case AST_WHILE:
+        return 1 + walk_flat(ast, flat_child(ast, n, FLAT_LOOP_CONDITION)) +
+               walk_flat(ast, flat_child(ast, n, FLAT_LOOP_BODY));
+    case AST_FOR:
+        return 1 + walk_flat(ast, flat_child(ast, n, FLAT_FOR_INIT)) +
+               walk_flat(ast, flat_child(ast, n, FLAT_FOR_CONDITION)) +
+               walk_flat(ast, flat_child(ast, n, FLAT_FOR_INCREMENT)) + walk_flat(ast, flat_child(ast, n, FLAT_FOR_BODY));
+    default:
+        return 1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 32;
+    size_t length;
+    char *source = generate_corpus(CORPUS_MIXED, mb * 1024 * 1024, 32, 1, &length);
+    TokenStream tokens;
+    if (!source || tokenize_n(source, length, &tokens) < 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    Parser parser;
+    initParser(&parser, &tokens);
+    ASTNode *ast = parseProgram(&parser);
+
+    double t0 = now();
+    FlatAst flat;
+    if (flatten_ast(ast, &flat) < 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    double flatten = now() - t0;
+
+    size_t treeBytes = 0;
+    long nodes = walk_tree(ast, &treeBytes);
+    treeBytes += flat.stringBytes; // both forms hold the same decoded literals
+    size_t flatBytes = flat.wordCount * 4 + flat.listCount * 4 + flat.atomCount * sizeof(Atom) + flat.stringBytes;
+
+    double treeBest = 1e9, flatBest = 1e9;
+    long flatNodes = 0;
+    for (int r = 0; r < 5; r++)
+    {
+        size_t ignored = 0;
+        t0 = now();
+        walk_tree(ast, &ignored);
+        double t = now() - t0;
+        if (t < treeBest)
+            treeBest = t;
+        t0 = now();
+        flatNodes = walk_flat(&flat, flat.root);
+        t = now() - t0;
+        if (t < flatBest)
+            flatBest = t;
+    }
+
+    printf("%.1f MB source, %ld nodes, flatten %.2f ms\n", length / 1e6, nodes, flatten * 1e3);
+    printf("pointer tree: %8.1f MB  %5.1f bytes/node  walk %7.2f ms\n", treeBytes / 1e6,
+           (double)treeBytes / nodes, treeBest * 1e3);
+    printf("flat:         %8.1f MB  %5.1f bytes/node  walk %7.2f ms\n", flatBytes / 1e6,
+           (double)flatBytes / nodes, flatBest * 1e3);
+    if (flatNodes != nodes)
+        printf("node counts differ: %ld flat\n", flatNodes);
+
+    free_flat_ast(&flat);
+    freeParser(&parser);
+    free_token_stream(&tokens);
+    free(source);
+    return flatNodes != nodes;
+}
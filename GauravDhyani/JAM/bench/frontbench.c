@@ -0,0 +1,205 @@
+#include "jamcorpus.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semanticanalyser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Front-end benchmark suite.
+ * For every corpus shape (or the one named) generates a script of the given
+ * size in MB (default 8) and measures, best of the given rounds (default 3):
+ *   lexer    MB/s through the initlexer()/get_next_token() loop
+ *   tokenize MB/s through tokenize_n()
+ *   parser   AST nodes/s through parseProgram()
+ *   semantic AST nodes/s through traverse()
+ * Results go to stdout as one JSON document; progress goes to stderr.
+ *
+ *   frontbench [size_mb] [rounds] [shape] [depth] [seed]
+ *   frontbench --emit shape [size_mb] [depth] [seed]   writes the corpus
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long count_nodes(ASTNode *node);
+
+static long count_list(ASTNode **nodes, int count)
+{
+    long n = 0;
+    for (int i = 0; i < count; i++)
+        n += count_nodes(nodes[i]);
+    return n;
+}
+
+static long count_nodes(ASTNode *node)
+{
+    if (!node)
+        return 0;
+    switch (node->type)
+    {
+    case AST_PROGRAM:
+        return 1 + count_list(node->data.program.statements, node->data.program.count);
+    case AST_VAR_DECL:
+        return 1 + count_nodes(node->data.varDecl.varType) + count_nodes(node->data.varDecl.initializer);
+    case AST_TYPE:
+        return 1 + (node->data.type.typeKind == AST_TYPE_ARRAY ? count_nodes(node->data.type.elementType) : 0);
+    case AST_BINARY_EXPR:
+        return 1 + count_nodes(node->data.binary.left) + count_nodes(node->data.binary.right);
+    case AST_UNARY_EXPR:
+        return 1 + count_nodes(node->data.unary.operand);
+    case AST_FUNCTION:
+        return 1 + count_list(node->data.function.params, node->data.function.paramCount) +
+               count_nodes(node->data.function.returnType) + count_nodes(node->data.function.body);
+    case AST_FUNCTION_CALL:
+        return 1 + count_nodes(node->data.call.callee) +
+               count_list(node->data.call.arguments, node->data.call.argCount);
+    case AST_RETURN:
+        return 1 + count_nodes(node->data.returnStmt.expr);
+    case AST_IF:
+        return 1 + count_nodes(node->data.ifStmt.condition) + count_nodes(node->data.ifStmt.thenBranch) +
+               count_nodes(node->data.ifStmt.elseBranch);
+    case AST_PRINT_STATEMENT:
+        return 1 + count_nodes(node->data.printStmt.expr);
+    case AST_WHILE:
+        return 1 + count_nodes(node->data.whileStmt.condition) + count_nodes(node->data.whileStmt.body);
+    case AST_FOR:
+        return 1 + count_nodes(node->data.forStmt.init) + count_nodes(node->data.forStmt.condition) +
+               count_nodes(node->data.forStmt.increment) + count_nodes(node->data.forStmt.body);
+    case AST_EXPR_STMT:
+        return 1 + count_nodes(node->data.ExprStmt.expr);
+    case AST_ARRAY_LITERAL:
+        return 1 + count_list(node->data.arrayLiteral.elements, node->data.arrayLiteral.elementCount);
+    default:
+        return 1;
+    }
+}
+
+typedef struct {
+    size_t bytes;
+    long tokens;
+    long nodes;
+    double lex, tokenize, parse, semantic; // best seconds
+} Result;
+
+static void keep_best(double *best, double t)
+{
+    if (*best == 0 || t < *best)
+        *best = t;
+}
+
+static int measure(CorpusShape shape, size_t bytes, int rounds, int depth, unsigned seed, Result *r)
+{
+    size_t length;
+    char *source = generate_corpus(shape, bytes, depth, seed, &length);
+    if (!source)
+        return -1;
+    memset(r, 0, sizeof *r);
+    r->bytes = length;
+    Parser parser;
+    int parsed = 0;
+
+    for (int round = 0; round < rounds; round++)
+    {
+        double t0 = now();
+        initlexer(source);
+        long tokens = 0;
+        while (get_next_token().type != TOKEN_EOF)
+            tokens++;
+        keep_best(&r->lex, now() - t0);
+        r->tokens = tokens + 1;
+
+        TokenStream stream;
+        t0 = now();
+        if (tokenize_n(source, length, &stream) < 0)
+            return -1;
+        keep_best(&r->tokenize, now() - t0);
+
+        if (parsed++)
+            resetParser(&parser, &stream);
+        else
+            initParser(&parser, &stream);
+        t0 = now();
+        ASTNode *ast = parseProgram(&parser);
+        keep_best(&r->parse, now() - t0);
+
+        t0 = now();
+        traverse(ast);
+        keep_best(&r->semantic, now() - t0);
+
+        r->nodes = count_nodes(ast);
+        free_token_stream(&stream);
+    }
+    freeParser(&parser);
+    free(source);
+    return 0;
+}
+
+static void print_result(CorpusShape shape, const Result *r, int last)
+{
+    printf("    {\"shape\": \"%s\", \"bytes\": %zu, \"tokens\": %ld, \"nodes\": %ld,\n",
+           corpus_shape_name(shape), r->bytes, r->tokens, r->nodes);
+    printf("     \"lexer_mb_per_s\": %.1f, \"tokenize_mb_per_s\": %.1f,\n",
+           r->bytes / r->lex / 1e6, r->bytes / r->tokenize / 1e6);
+    printf("     \"parser_nodes_per_s\": %.0f, \"semantic_nodes_per_s\": %.0f}%s\n",
+           r->nodes / r->parse, r->nodes / r->semantic, last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 2 && strcmp(argv[1], "--emit") == 0)
+    {
+        int shape = corpus_shape_from_name(argv[2]);
+        size_t mb = argc > 3 ? (size_t)atoi(argv[3]) : 8;
+        int depth = argc > 4 ? atoi(argv[4]) : 32;
+        unsigned seed = argc > 5 ? (unsigned)atoi(argv[5]) : 1;
+        size_t length;
+        char *source = shape < 0 ? NULL : generate_corpus((CorpusShape)shape, mb * 1024 * 1024, depth, seed, &length);
+        if (!source)
+        {
+            fprintf(stderr, "unknown shape '%s'\n", argv[2]);
+            return 1;
+        }
+        fwrite(source, 1, length, stdout);
+        free(source);
+        return 0;
+    }
+
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 8;
+    int rounds = argc > 2 ? atoi(argv[2]) : 3;
+    int only = argc > 3 && strcmp(argv[3], "all") != 0 ? corpus_shape_from_name(argv[3]) : -1;
+    int depth = argc > 4 ? atoi(argv[4]) : 32;
+    unsigned seed = argc > 5 ? (unsigned)atoi(argv[5]) : 1;
+    if (argc > 3 && strcmp(argv[3], "all") != 0 && only < 0)
+    {
+        fprintf(stderr, "unknown shape '%s'\n", argv[3]);
+        return 1;
+    }
+    if (rounds < 1)
+        rounds = 1;
+
+    printf("{\n  \"benchmark\": \"frontbench\",\n");
+    printf("  \"size_mb\": %zu, \"rounds\": %d, \"depth\": %d, \"seed\": %u,\n", mb, rounds, depth, seed);
+    printf("  \"results\": [\n");
+    int first = only >= 0 ? only : 0;
+    int last = only >= 0 ? only : CORPUS_SHAPE_COUNT - 1;
+    for (int shape = first; shape <= last; shape++)
+    {
+        fprintf(stderr, "%s...\n", corpus_shape_name((CorpusShape)shape));
+        Result r;
+        if (measure((CorpusShape)shape, mb * 1024 * 1024, rounds, depth, seed, &r) != 0)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        print_result((CorpusShape)shape, &r, shape == last);
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "astimage.h"
+#include "jamcorpus.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semanticanalyser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * AST image startup benchmark.
+ * Generates a script of the given size in MB (default 8) and shape (default
+ * functions), writes its image to the given path (default jam.jami), and
+ * compares, best of 5, what has to happen before the first statement runs:
+ *   script  load_source(), tokenize_n(), parseProgram() and traverse()
+ *   image   load_ast_image() and expand_flat_ast_lazily()
+ * along with a full expand_flat_ast() for reference.
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void keep_best(double *best, double t)
+{
+    if (*best == 0 || t < *best)
+        *best = t;
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 8;
+    int shape = argc > 2 ? corpus_shape_from_name(argv[2]) : CORPUS_FUNCTIONS;
+    const char *imagePath = argc > 3 ? argv[3] : "jam.jami";
+    if (shape < 0)
+    {
+        fprintf(stderr, "unknown shape '%s'\n", argv[2]);
+        return 1;
+    }
+
+    // the script goes through a file too, so both sides start from disk
+    size_t length;
+    char *corpus = generate_corpus((CorpusShape)shape, mb * 1024 * 1024, 32, 1, &length);
+    char scriptPath[1024];
+    snprintf(scriptPath, sizeof scriptPath, "%s.jam", imagePath);
+    FILE *f = corpus ? fopen(scriptPath, "wb") : NULL;
+    if (!f || fwrite(corpus, 1, length, f) != length || fclose(f) != 0)
+    {
+        perror("imagebench");
+        return 1;
+    }
+    free(corpus);
+
+    double script = 0, image = 0, lazy = 0, full = 0;
+    size_t imageBytes = 0;
+    for (int round = 0; round < 5; round++)
+    {
+        double t0 = now();
+        SourceBuffer source;
+        TokenStream tokens;
+        Parser parser;
+        if (load_source(scriptPath, &source) != 0 || tokenize_n(source.data, source.length, &tokens) < 0)
+        {
+            perror("imagebench");
+            return 1;
+        }
+        initParser(&parser, &tokens);
+        ASTNode *ast = parseProgram(&parser);
+        enterScope();
+        traverse(ast);
+        exitScope();
+        keep_best(&script, now() - t0);
+
+        if (round == 0)
+        {
+            FlatAst flat;
+            if (flatten_ast(ast, &flat) != 0 || write_ast_image(&flat, imagePath) != 0)
+            {
+                perror("imagebench");
+                return 1;
+            }
+            free_flat_ast(&flat);
+        }
+        freeParser(&parser);
+        free_token_stream(&tokens);
+        release_source(&source);
+
+        t0 = now();
+        AstImage loaded;
+        if (load_ast_image(imagePath, &loaded) != 0)
+        {
+            perror("imagebench");
+            return 1;
+        }
+        double loadTime = now() - t0;
+        imageBytes = loaded.file.length;
+
+        // alternate the order, so neither expansion always gets the memory
+        // the other one just released
+        Arena arena;
+        arena_init(&arena);
+        double lazyTime = 0;
+        for (int pass = 0; pass < 2; pass++)
+        {
+            int lazyPass = (pass + round) % 2 == 0;
+            t0 = now();
+            ASTNode *program = lazyPass ? expand_flat_ast_lazily(&loaded.ast, &arena) : expand_flat_ast(&loaded.ast, &arena);
+            double t = now() - t0;
+            if (!program)
+            {
+                fprintf(stderr, "out of memory\n");
+                return 1;
+            }
+            if (lazyPass)
+                lazyTime = t;
+            else
+                keep_best(&full, t);
+            arena_free(&arena);
+        }
+        keep_best(&image, loadTime + lazyTime);
+        keep_best(&lazy, lazyTime);
+        release_ast_image(&loaded);
+    }
+
+    printf("%s, %.1f MB script, %.1f MB image\n", corpus_shape_name((CorpusShape)shape), length / 1e6,
+           imageBytes / 1e6);
+    printf("script: load + lex + parse + check  %8.2f ms\n", script * 1e3);
+    printf("image:  load + lazy expand          %8.2f ms  (expand %.2f ms)\n", image * 1e3, lazy * 1e3);
+    printf("full expand_flat_ast()              %8.2f ms\n", full * 1e3);
+    remove(scriptPath);
+    return 0;
+}
@@ -0,0 +1,249 @@
+#include "jamcorpus.h"
+#include "sourceloader.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const shapeNames[CORPUS_SHAPE_COUNT] = {
+    "mixed", "ident", "comment", "string", "nested", "functions",
+};
+
+const char *corpus_shape_name(CorpusShape shape)
+{
+    return (unsigned)shape < CORPUS_SHAPE_COUNT ? shapeNames[shape] : "unknown";
+}
+
+int corpus_shape_from_name(const char *name)
+{
+    for (int i = 0; i < CORPUS_SHAPE_COUNT; i++)
+        if (strcmp(name, shapeNames[i]) == 0)
+            return i;
+    return -1;
+}
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    unsigned state; // LCG, so a seed always gives the same corpus
+    int functions;  // functions emitted so far, all callable as f<n>(a, b)
+} Corpus;
+
+static unsigned next_random(Corpus *c, unsigned n)
+{
+    c->state = c->state * 1103515245u + 12345u;
+    return (c->state >> 8) % n;
+}
+
+static void emit(Corpus *c, const char *format, ...)
+{
+    va_list args;
+    while (1)
+    {
+        va_start(args, format);
+        int n = vsnprintf(c->data + c->length, c->capacity - c->length, format, args);
+        va_end(args);
+        if (n < 0)
+            exit(1);
+        if (c->length + n < c->capacity)
+        {
+            c->length += n;
+            return;
+        }
+        c->capacity *= 2;
+        c->data = realloc(c->data, c->capacity);
+        if (!c->data)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+}
+
+static const char *const words[] = {
+    "total", "count", "index", "value", "limit", "offset", "result", "cursor",
+    "buffer", "sample", "weight", "factor", "length", "window", "height", "score",
+};
+#define WORD(c) words[next_random(c, sizeof(words) / sizeof(words[0]))]
+
+// every variable used is declared by the prologue
+static void emit_prologue(Corpus *c)
+{
+    for (int i = 0; i < 8; i++)
+        emit(c, "var v%d: Int = %d;\n", i, i + 1);
+}
+
+static void emit_expression(Corpus *c, int depth)
+{
+    if (depth <= 0 || next_random(c, 3) == 0)
+    {
+        if (next_random(c, 2))
+            emit(c, "v%u", next_random(c, 8));
+        else
+            emit(c, "%u", next_random(c, 1000));
+        return;
+    }
+    // one operand nests further, the other is a leaf, so size stays linear in depth
+    static const char *const ops[] = {"+", "-", "*", "<", "==", "!=", ">="};
+    int left = (int)next_random(c, 2);
+    emit(c, "(");
+    emit_expression(c, left ? depth - 1 : 0);
+    emit(c, " %s ", ops[next_random(c, 7)]);
+    emit_expression(c, left ? 0 : depth - 1);
+    emit(c, ")");
+}
+
+static void emit_ident_unit(Corpus *c)
+{
+    char name[64];
+    snprintf(name, sizeof name, "%s_%s_%zu", WORD(c), WORD(c), c->length);
+    emit(c, "var %s: Int = v%u + v%u * v%u;\n", name, next_random(c, 8), next_random(c, 8), next_random(c, 8));
+    emit(c, "%s = %s - v%u * (v%u + %s);\n", name, name, next_random(c, 8), next_random(c, 8), name);
+}
+
+static void emit_comment_unit(Corpus *c)
+{
+    switch (next_random(c, 4))
+    {
+    case 0:
+        emit(c, "** %s of the %s, adjusted by the %s for every %s\n", WORD(c), WORD(c), WORD(c), WORD(c));
+        break;
+    case 1:
+        emit(c, "*- %s %s %s\n   the %s is kept in the %s until the %s is known\n   %s %s -*\n",
+             WORD(c), WORD(c), WORD(c), WORD(c), WORD(c), WORD(c), WORD(c), WORD(c));
+        break;
+    case 2:
+        emit(c, "    ** %s\n    ** %s %s\n", WORD(c), WORD(c), WORD(c));
+        break;
+    default:
+        emit(c, "v%u = v%u + 1; ** %s\n", next_random(c, 8), next_random(c, 8), WORD(c));
+        break;
+    }
+}
+
+static void emit_string_unit(Corpus *c)
+{
+    switch (next_random(c, 3))
+    {
+    case 0:
+        emit(c, "print(\"the %s of the %s is \\\"%s\\\" and the %s is %s\");\n",
+             WORD(c), WORD(c), WORD(c), WORD(c), WORD(c));
+        break;
+    case 1:
+        emit(c, "print(\"%s\\t%s\\t%s\\t%s\\n%s\\\\%s\");\n", WORD(c), WORD(c), WORD(c), WORD(c), WORD(c), WORD(c));
+        break;
+    default:
+        emit(c, "print(\"a longer message about the %s, the %s, the %s and the %s, repeated for the %s\");\n",
+             WORD(c), WORD(c), WORD(c), WORD(c), WORD(c));
+        break;
+    }
+}
+
+static void emit_block(Corpus *c, int depth, int indent)
+{
+    emit(c, "%*s", indent * 4, "");
+    if (depth <= 0)
+    {
+        emit(c, "v%u = ", next_random(c, 8));
+        emit_expression(c, 3);
+        emit(c, ";\n");
+        return;
+    }
+    if (next_random(c, 2))
+    {
+        emit(c, "if (");
+        emit_expression(c, 2);
+        emit(c, ") {\n");
+        emit_block(c, depth - 1, indent + 1);
+        emit(c, "%*s} else {\n", indent * 4, "");
+        emit_block(c, 0, indent + 1);
+        emit(c, "%*s}\n", indent * 4, "");
+    }
+    else
+    {
+        emit(c, "while (v%u < %u) {\n", next_random(c, 8), next_random(c, 100));
+        emit_block(c, depth - 1, indent + 1);
+        emit(c, "%*s}\n", indent * 4, "");
+    }
+}
+
+static void emit_nested_unit(Corpus *c, int depth)
+{
+    if (next_random(c, 2))
+        emit_block(c, depth, 0);
+    else
+    {
+        emit(c, "v%u = ", next_random(c, 8));
+        emit_expression(c, depth);
+        emit(c, ";\n");
+    }
+}
+
+static void emit_function_unit(Corpus *c)
+{
+    if (c->functions > 0 && next_random(c, 3) == 0)
+    {
+        emit(c, "v%u = f%u(v%u, %u);\n", next_random(c, 8), next_random(c, (unsigned)c->functions),
+             next_random(c, 8), next_random(c, 100));
+        return;
+    }
+    int n = c->functions++;
+    emit(c, "fn f%d(a: Int, b: Int) -> Int {\n", n);
+    emit(c, "    var t: Int = a * b + %u;\n", next_random(c, 100));
+    if (next_random(c, 2))
+        emit(c, "    if (t > b) {\n        return t - a;\n    }\n");
+    emit(c, "    return t;\n}\n");
+}
+
+char *generate_corpus(CorpusShape shape, size_t bytes, int depth, unsigned seed, size_t *length)
+{
+    Corpus c;
+    c.capacity = bytes + 4096;
+    c.data = malloc(c.capacity);
+    c.length = 0;
+    c.state = seed * 2654435761u + 1;
+    c.functions = 0;
+    if (!c.data)
+        return NULL;
+    if (depth < 1)
+        depth = 1;
+
+    emit_prologue(&c);
+    while (c.length < bytes)
+    {
+        CorpusShape unit = shape;
+        if (shape == CORPUS_MIXED)
+            unit = (CorpusShape)(1 + next_random(&c, CORPUS_SHAPE_COUNT - 1));
+        switch (unit)
+        {
+        case CORPUS_IDENT:
+            emit_ident_unit(&c);
+            break;
+        case CORPUS_COMMENT:
+            emit_comment_unit(&c);
+            break;
+        case CORPUS_STRING:
+            emit_string_unit(&c);
+            break;
+        case CORPUS_NESTED:
+            emit_nested_unit(&c, shape == CORPUS_MIXED ? depth / 4 + 1 : depth);
+            break;
+        default:
+            emit_function_unit(&c);
+            break;
+        }
+    }
+
+    // NUL padding, so the result can be lexed like a loaded source
+    if (c.length + SOURCE_PADDING > c.capacity)
+    {
+        c.capacity = c.length + SOURCE_PADDING;
+        c.data = realloc(c.data, c.capacity);
+        if (!c.data)
+            return NULL;
+    }
+    memset(c.data + c.length, 0, SOURCE_PADDING);
+    *length = c.length;
+    return c.data;
+}
@@ -0,0 +1,30 @@
+#ifndef JAM_CORPUS_H
+#define JAM_CORPUS_H
+
+#include <stddef.h>
+
+/*
+ * Synthetic JAM corpus generator for the benchmarks.
+ * Every generated program lexes and parses cleanly: the buffer is built
+ * from complete top-level units until the requested size is reached.
+ */
+
+typedef enum {
+    CORPUS_MIXED,     // a blend of all the shapes below
+    CORPUS_IDENT,     // long identifiers in declarations and expressions
+    CORPUS_COMMENT,   // mostly line and block comments around sparse code
+    CORPUS_STRING,    // print statements with long, escaped string literals
+    CORPUS_NESTED,    // deeply nested blocks and parenthesized expressions
+    CORPUS_FUNCTIONS, // many small functions and calls to them
+    CORPUS_SHAPE_COUNT
+} CorpusShape;
+
+const char *corpus_shape_name(CorpusShape shape);
+// shape for a name, or -1 if there is none
+int corpus_shape_from_name(const char *name);
+
+// generate about bytes of source; depth bounds block and expression nesting.
+// The result is NUL-padded like a loaded SourceBuffer; free() it.
+char *generate_corpus(CorpusShape shape, size_t bytes, int depth, unsigned seed, size_t *length);
+
+#endif // JAM_CORPUS_H
@@ -0,0 +1,123 @@
+#include "lexer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Identifier classification microbenchmark.
+ * Compares the original strcmp keyword chain against keyword_type() on the
+ * same corpus of identifiers, then measures whole-lexer identifier throughput.
+ */
+
+#define WORD_COUNT 2000000
+#define ROUNDS 5
+
+static const char *words[] = {
+    "fn", "if", "else", "var", "return", "while", "Int", "Float", "String",
+    "count", "index", "result", "factorial", "n", "i", "total", "buffer_size",
+    "print", "value", "left", "right", "node", "isReady", "x1", "tmp",
+    "acc", "fibonacci", "struct", "true", "false", "userName", "length"
+};
+
+// the classifier identifier() used before keyword_type()
+static TokenType strcmp_chain(const char *lexeme)
+{
+    if (strcmp(lexeme, "fn") == 0) return TOKEN_KEYWORD_FN;
+    else if (strcmp(lexeme, "if") == 0) return TOKEN_KEYWORD_IF;
+    else if (strcmp(lexeme, "else") == 0) return TOKEN_KEYWORD_ELSE;
+    else if (strcmp(lexeme, "var") == 0) return TOKEN_KEYWORD_VAR;
+    else if (strcmp(lexeme, "return") == 0) return TOKEN_KEYWORD_RETURN;
+    else if (strcmp(lexeme, "import") == 0) return TOKEN_KEYWORD_IMPORT;
+    else if (strcmp(lexeme, "while") == 0) return TOKEN_KEYWORD_LOOP;
+    else if (strcmp(lexeme, "for") == 0) return TOKEN_KEYWORD_FORLOOP;
+    else if (strcmp(lexeme, "Int") == 0) return TOKEN_KEYWORD_INT;
+    else if (strcmp(lexeme, "Float") == 0) return TOKEN_KEYWORD_FLOAT;
+    else if (strcmp(lexeme, "Bool") == 0) return TOKEN_KEYWORD_BOOL;
+    else if (strcmp(lexeme, "Void") == 0) return TOKEN_KEYWORD_VOID;
+    else if (strcmp(lexeme, "String") == 0) return TOKEN_KEYWORD_STRING;
+    else if (strcmp(lexeme, "struct") == 0) return TOKEN_KEYWORD_STRUCT;
+    else if (strcmp(lexeme, "true") == 0) return TOKEN_KEYWORD_TRUE;
+    else if (strcmp(lexeme, "false") == 0) return TOKEN_KEYWORD_FALSE;
+    else if (strcmp(lexeme, "null") == 0) return TOKEN_KEYWORD_NULL;
+    return TOKEN_IDENTIFIER;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    int wordKinds = sizeof(words) / sizeof(words[0]);
+
+    // corpus: identifiers separated by spaces, plus a start offset per word
+    size_t cap = (size_t)WORD_COUNT * 12;
+    char *corpus = malloc(cap);
+    int *starts = malloc(sizeof(int) * WORD_COUNT);
+    int *lengths = malloc(sizeof(int) * WORD_COUNT);
+    size_t pos = 0;
+    srand(42);
+    for (int i = 0; i < WORD_COUNT; i++)
+    {
+        const char *w = words[rand() % wordKinds];
+        int len = (int)strlen(w);
+        starts[i] = (int)pos;
+        lengths[i] = len;
+        memcpy(corpus + pos, w, len);
+        pos += len;
+        corpus[pos++] = '\0'; // NUL-separated so strcmp_chain can read it in place
+    }
+    size_t bytes = pos;
+
+    long check = 0;
+    double best_chain = 1e9, best_switch = 1e9;
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        double t0 = now();
+        for (int i = 0; i < WORD_COUNT; i++)
+            check += strcmp_chain(corpus + starts[i]);
+        double t1 = now();
+        for (int i = 0; i < WORD_COUNT; i++)
+            check -= keyword_type(corpus + starts[i], lengths[i]);
+        double t2 = now();
+        if (t1 - t0 < best_chain) best_chain = t1 - t0;
+        if (t2 - t1 < best_switch) best_switch = t2 - t1;
+    }
+    if (check != 0)
+    {
+        fprintf(stderr, "classifiers disagree (%ld)\n", check);
+        return 1;
+    }
+
+    printf("identifiers:        %d (%zu bytes)\n", WORD_COUNT, bytes);
+    printf("strcmp chain:       %.1f M ident/s\n", WORD_COUNT / best_chain / 1e6);
+    printf("keyword_type:       %.1f M ident/s\n", WORD_COUNT / best_switch / 1e6);
+    printf("speedup:            %.2fx\n", best_chain / best_switch);
+
+    // whole lexer on the same identifiers, space separated
+    for (size_t i = 0; i < bytes; i++)
+        if (corpus[i] == '\0')
+            corpus[i] = ' ';
+    corpus[bytes - 1] = '\0';
+    double best_lex = 1e9;
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        TokenStream tokens;
+        double t0 = now();
+        tokenize(corpus, &tokens);
+        double t1 = now();
+        free_token_stream(&tokens);
+        if (t1 - t0 < best_lex) best_lex = t1 - t0;
+    }
+    printf("tokenize:           %.1f M ident/s, %.1f MB/s\n",
+           WORD_COUNT / best_lex / 1e6, bytes / best_lex / 1e6);
+
+    free(corpus);
+    free(starts);
+    free(lengths);
+    return 0;
+}
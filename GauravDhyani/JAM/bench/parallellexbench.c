@@ -0,0 +1,166 @@
+#include "lexer.h"
+#include "sourceloader.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Concurrent lexing benchmark.
+ * Lexes N independent sources with 1, 2, 4, ... threads (one JamLexer per
+ * source) and checks every run produces the same token counts as a
+ * sequential pass. Pass script paths to lex real files; with no arguments
+ * a synthetic set of 64 sources is generated.
+ */
+
+#define SYNTHETIC_FILES 64
+#define SYNTHETIC_BYTES (2 * 1024 * 1024)
+
+typedef struct {
+    const char **sources;
+    size_t *lengths;
+    int *counts;
+    int fileCount;
+    int nextFile; // shared work counter
+} Work;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *lex_worker(void *arg)
+{
+    Work *work = arg;
+    while (1)
+    {
+        int i = __atomic_fetch_add(&work->nextFile, 1, __ATOMIC_RELAXED);
+        if (i >= work->fileCount)
+            break;
+        TokenStream tokens;
+        work->counts[i] = tokenize_n(work->sources[i], work->lengths[i], &tokens);
+        free_token_stream(&tokens);
+    }
+    return NULL;
+}
+
+static double run(Work *work, int threads)
+{
+    pthread_t ids[64];
+    work->nextFile = 0;
+    double t0 = now();
+    for (int t = 0; t < threads; t++)
+        pthread_create(&ids[t], NULL, lex_worker, work);
+    for (int t = 0; t < threads; t++)
+        pthread_join(ids[t], NULL);
+    return now() - t0;
+}
+
+static char *synthetic(int seed, size_t *length)
+{
+    static const char *lines[] = {
+        "var total: Int = count + 42;\n",
+        "** running sum of the generated rows\n",
+        "print(\"row value\");\n",
+        "fn helper(a: Int, b: Int) -> Int { return a * b - 1; }\n",
+        "while (i < 1000) { i = i + 1; }\n",
+    };
+    char *source = malloc(SYNTHETIC_BYTES + SOURCE_PADDING);
+    size_t pos = 0;
+    unsigned state = (unsigned)seed * 2654435761u + 1;
+    while (1)
+    {
+        state = state * 1103515245u + 12345u;
+        const char *line = lines[(state >> 16) % 5];
+        size_t len = strlen(line);
+        if (pos + len >= SYNTHETIC_BYTES)
+            break;
+        memcpy(source + pos, line, len);
+        pos += len;
+    }
+    memset(source + pos, 0, SOURCE_PADDING);
+    *length = pos;
+    return source;
+}
+
+int main(int argc, char **argv)
+{
+    int fileCount = argc > 1 ? argc - 1 : SYNTHETIC_FILES;
+    Work work;
+    work.fileCount = fileCount;
+    work.sources = malloc(sizeof(char *) * fileCount);
+    work.lengths = malloc(sizeof(size_t) * fileCount);
+    work.counts = malloc(sizeof(int) * fileCount);
+    SourceBuffer *loaded = calloc(fileCount, sizeof(SourceBuffer));
+
+    size_t totalBytes = 0;
+    for (int i = 0; i < fileCount; i++)
+    {
+        if (argc > 1)
+        {
+            if (load_source(argv[i + 1], &loaded[i]) != 0)
+            {
+                perror(argv[i + 1]);
+                return 1;
+            }
+            work.sources[i] = loaded[i].data;
+            work.lengths[i] = loaded[i].length;
+        }
+        else
+            work.sources[i] = synthetic(i, &work.lengths[i]);
+        totalBytes += work.lengths[i];
+    }
+
+    // sequential reference
+    int *expected = malloc(sizeof(int) * fileCount);
+    for (int i = 0; i < fileCount; i++)
+    {
+        TokenStream tokens;
+        expected[i] = tokenize_n(work.sources[i], work.lengths[i], &tokens);
+        free_token_stream(&tokens);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int maxThreads = cpus > 64 ? 64 : (int)cpus;
+    if (maxThreads < 4)
+        maxThreads = 4;
+    printf("%d sources, %.1f MB, %ld online CPUs\n", fileCount, totalBytes / 1e6, cpus);
+
+    double base = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        double best = 1e9;
+        for (int r = 0; r < 3; r++)
+        {
+            double t = run(&work, threads);
+            if (t < best)
+                best = t;
+            if (memcmp(work.counts, expected, sizeof(int) * fileCount) != 0)
+            {
+                fprintf(stderr, "token counts differ from the sequential run with %d threads\n", threads);
+                return 1;
+            }
+        }
+        if (threads == 1)
+            base = best;
+        printf("threads %2d: %8.1f MB/s  speedup %.2fx\n", threads, totalBytes / best / 1e6, base / best);
+    }
+
+    for (int i = 0; i < fileCount; i++)
+    {
+        if (argc > 1)
+            release_source(&loaded[i]);
+        else
+            free((char *)work.sources[i]);
+    }
+    free(loaded);
+    free(expected);
+    free(work.sources);
+    free(work.lengths);
+    free(work.counts);
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "lexer.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Parse-phase benchmark.
+ * Tokenizes a generated script once (default 32 MB), then times
+ * parseProgram() over it several times and reports token throughput and,
+ * where the kernel exposes hardware counters, cache misses per token.
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// hardware cache-miss counter for this thread, or -1 if unavailable
+static int open_cache_misses(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static char *generate(size_t bytes, size_t *length)
+{
+    static const char *lines[] = {
+        "var total: Int = count + 42 * (n - 1);\n",
+        "print(\"row value\");\n",
+        "while (i < 1000) { i = i + 1; if (i == 7) { print(i); } else { j = -i; } }\n",
+        "fn helper(a: Int, b: Int) -> Int { return a * b - 1; }\n",
+        "result = helper(x, y) >= 10 && !done;\n",
+        "var arr: [Int] = [1, 2, 3, 4];\n",
+    };
+    char *source = malloc(bytes + 256);
+    size_t pos = 0;
+    unsigned state = 1;
+    while (pos < bytes)
+    {
+        state = state * 1103515245u + 12345u;
+        const char *line = lines[(state >> 16) % 6];
+        size_t len = strlen(line);
+        memcpy(source + pos, line, len);
+        pos += len;
+    }
+    source[pos] = '\0';
+    *length = pos;
+    return source;
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 32;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    size_t length;
+    char *source = generate(mb * 1024 * 1024, &length);
+
+    TokenStream tokens;
+    if (tokenize_n(source, length, &tokens) < 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    int counter = open_cache_misses();
+    double best = 1e9;
+    long long misses = -1;
+    Parser parser;
+    initParser(&parser, &tokens);
+    for (int r = 0; r < rounds; r++)
+    {
+        // later rounds parse into the memory the previous AST used
+        resetParser(&parser, &tokens);
+#ifdef __linux__
+        if (counter >= 0)
+        {
+            ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+        double t0 = now();
+        parseProgram(&parser);
+        double t = now() - t0;
+#ifdef __linux__
+        if (counter >= 0)
+        {
+            long long count;
+            ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counter, &count, sizeof(count)) == sizeof(count) && (misses < 0 || count < misses))
+                misses = count;
+        }
+#endif
+        if (t < best)
+            best = t;
+    }
+
+    printf("%d tokens, %.1f MB\n", tokens.count, length / 1e6);
+    printf("parse: %8.2f ms  %8.1f Mtokens/s  %7.1f MB/s\n", best * 1e3, tokens.count / best / 1e6, length / best / 1e6);
+    if (misses >= 0)
+        printf("cache misses: %lld (%.3f per token)\n", misses, (double)misses / tokens.count);
+    else
+        printf("cache misses: n/a (no hardware perf counters)\n");
+
+    freeParser(&parser);
+    free_token_stream(&tokens);
+    free(source);
+    return 0;
+}
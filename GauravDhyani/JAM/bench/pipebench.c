@@ -0,0 +1,116 @@
+#include "jamcorpus.h"
+#include "lexer.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Pipelined front-end benchmark.
+ * Generates a mixed-shape script of the given size in MB (default 32) and
+ * times, best of 5, lexing alone, parsing a finished stream alone, the two
+ * back to back, and the pipelined parse with a lexer thread feeding rings
+ * of 4K and 64K tokens. Every pipelined parse must produce as many top-level
+ * statements as the sequential one. Token memory is the stream's arrays
+ * against the ring's.
+ */
+
+#define ROUNDS 5
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void keep_best(double *best, double t)
+{
+    if (*best == 0 || t < *best)
+        *best = t;
+}
+
+// bytes of token arrays per token, as grow_token_stream() lays them out
+static size_t token_bytes(int count)
+{
+    return (size_t)count * (sizeof(TokenValue) + 2 * sizeof(int) + 1);
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 32;
+    size_t length;
+    char *source = generate_corpus(CORPUS_MIXED, mb * 1024 * 1024, 32, 1, &length);
+    if (!source)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    double lex = 0, parse = 0, both = 0;
+    int tokens = 0, statements = 0;
+    Parser parser;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        TokenStream stream;
+        double t0 = now();
+        if (tokenize_n(source, length, &stream) < 0)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        double t1 = now();
+        initParser(&parser, &stream);
+        ASTNode *ast = parseProgram(&parser);
+        double t2 = now();
+        if (!ast)
+        {
+            fprintf(stderr, "parse failed\n");
+            return 1;
+        }
+        keep_best(&lex, t1 - t0);
+        keep_best(&parse, t2 - t1);
+        keep_best(&both, t2 - t0);
+        tokens = stream.count;
+        statements = ast->data.program.count;
+        freeParser(&parser);
+        free_token_stream(&stream);
+    }
+
+    printf("%.1f MB script, %d tokens, %ld online CPUs\n", length / 1e6, tokens, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("lex                  %8.2f ms\n", lex * 1e3);
+    printf("parse                %8.2f ms\n", parse * 1e3);
+    printf("lex, then parse      %8.2f ms  token memory %7.2f MB\n", both * 1e3, token_bytes(tokens) / 1e6);
+
+    static const int rings[] = {4 * 1024, 64 * 1024};
+    for (int k = 0; k < 2; k++)
+    {
+        double best = 0;
+        for (int round = 0; round < ROUNDS; round++)
+        {
+            TokenPipe pipe;
+            double t0 = now();
+            if (token_pipe_start(&pipe, source, length, rings[k]) != 0)
+            {
+                fprintf(stderr, "could not start the lexer thread\n");
+                return 1;
+            }
+            initPipelinedParser(&parser, &pipe);
+            ASTNode *ast = parseProgram(&parser);
+            int status = token_pipe_finish(&pipe);
+            keep_best(&best, now() - t0);
+            if (!ast || status != 0 || ast->data.program.count != statements)
+            {
+                fprintf(stderr, "pipelined parse differs with a %d token ring\n", rings[k]);
+                return 1;
+            }
+            freeParser(&parser);
+        }
+        printf("pipelined, %2dK ring  %8.2f ms  token memory %7.2f MB\n", rings[k] / 1024, best * 1e3,
+               token_bytes(rings[k]) / 1e6);
+    }
+    printf("max(lex, parse)      %8.2f ms\n", (lex > parse ? lex : parse) * 1e3);
+    free(source);
+    return 0;
+}
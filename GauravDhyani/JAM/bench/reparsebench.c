@@ -0,0 +1,160 @@
+#include "astcompare.h"
+#include "jamcorpus.h"
+#include "lexer.h"
+#include "parser.h"
+#include "reparse.h"
+#include "sourceloader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Incremental reparsing benchmark.
+ * Generates a functions-shape script of about the given number of lines
+ * (default 10000) and edits it like a user would: a digit of a number is
+ * changed, or a whole statement line is inserted at the start of a line and
+ * deleted again. Each edit is brought into the tree with reparse_edit().
+ * Prints the mean and worst latency per edit next to a full tokenize_n() and
+ * parseScript(), and how many edits fell back to a full parse; every 50
+ * edits and at the end the tree must equal a fresh parse of the same text.
+ */
+
+#define EDITS 2000
+#define CHECK_EVERY 50
+
+static const char inserted[] = "var edited: Int = 7;\n";
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// full parse of the current text; also the reference the tree is checked against
+static double parse_fresh(const char *source, size_t length, const Reparser *r, int *same)
+{
+    TokenStream tokens;
+    Parser parser;
+    double t0 = now();
+    if (tokenize_n(source, length, &tokens) < 0)
+        return -1;
+    initParser(&parser, &tokens);
+    ParseResult result = parseScript(&parser);
+    double t = now() - t0;
+    if (same)
+        *same = result.diagnosticCount == r->parser.diagnosticCount && same_tree(result.ast, r->program);
+    freeParser(&parser);
+    free_token_stream(&tokens);
+    return t;
+}
+
+int main(int argc, char **argv)
+{
+    int lines = argc > 1 ? atoi(argv[1]) : 10000;
+    size_t length;
+    char *generated = generate_corpus(CORPUS_FUNCTIONS, (size_t)lines * 18, 32, 1, &length);
+    // room for the line an edit inserts
+    char *source = generated ? malloc(length + sizeof inserted + SOURCE_PADDING) : NULL;
+    if (!source)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    memcpy(source, generated, length);
+    memset(source + length, 0, sizeof inserted + SOURCE_PADDING);
+    free(generated);
+    int lineCount = 0;
+    for (size_t i = 0; i < length; i++)
+        lineCount += source[i] == '\n';
+
+    double full = 0;
+    Reparser r;
+    for (int round = 0; round < 5; round++)
+    {
+        if (round > 0)
+            reparse_free(&r);
+        if (reparse_init(&r, source, length) < 0 || !r.program)
+        {
+            fprintf(stderr, "parse failed\n");
+            return 1;
+        }
+        double t = parse_fresh(source, length, &r, NULL);
+        if (full == 0 || t < full)
+            full = t;
+    }
+
+    unsigned state = 7;
+    double spent = 0, worst = 0;
+    int edits = 0, fallbacks = 0, checks = 0, mismatches = 0;
+    while (edits < EDITS)
+    {
+        state = state * 1103515245u + 12345u;
+        size_t at = (state >> 4) % length;
+        int steps;
+        if (state & 0x10000)
+        {
+            // change one digit of a number
+            while (at < length && (source[at] < '0' || source[at] > '9'))
+                at++;
+            if (at == length)
+                continue;
+            source[at] = source[at] == '9' ? '1' : source[at] + 1;
+            steps = 1;
+        }
+        else
+        {
+            // insert a statement line at the start of a line, then delete it
+            while (at > 0 && source[at - 1] != '\n')
+                at--;
+            steps = 2;
+        }
+
+        for (int step = 0; step < steps; step++)
+        {
+            int removed = 0, added = 0;
+            if (steps == 1)
+                removed = added = 1;
+            else if (step == 0)
+            {
+                memmove(source + at + sizeof inserted - 1, source + at, length - at);
+                memcpy(source + at, inserted, sizeof inserted - 1);
+                length += added = sizeof inserted - 1;
+            }
+            else
+            {
+                memmove(source + at, source + at + sizeof inserted - 1, length - at - (sizeof inserted - 1));
+                length -= removed = sizeof inserted - 1;
+                memset(source + length, 0, sizeof inserted);
+            }
+            double t0 = now();
+            if (reparse_edit(&r, source, length, (int)at, removed, added) < 0)
+            {
+                fprintf(stderr, "out of memory\n");
+                return 1;
+            }
+            double t = now() - t0;
+            spent += t;
+            if (t > worst)
+                worst = t;
+            fallbacks += r.full;
+            edits++;
+            if (edits % CHECK_EVERY == 0 || edits == EDITS)
+            {
+                int same;
+                parse_fresh(source, length, &r, &same);
+                checks++;
+                mismatches += !same;
+            }
+        }
+    }
+
+    printf("%d lines, %d tokens: full tokenize + parse %8.3f ms\n", lineCount, r.tokens.count, full * 1e3);
+    printf("reparse_edit: mean %8.3f ms, worst %8.3f ms, %d of %d edits parsed in full\n",
+           spent / edits * 1e3, worst * 1e3, fallbacks, edits);
+    printf("%d checks against a fresh parse, %d mismatches\n", checks, mismatches);
+    reparse_free(&r);
+    free(source);
+    return mismatches != 0;
+}
@@ -0,0 +1,81 @@
+#include "lexer.h"
+#include "lexscan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Lexer skipping benchmark.
+ * Tokenizes comment-heavy, whitespace-heavy and string-heavy sources with each
+ * scanning level the CPU supports and reports throughput in MB/s.
+ */
+
+#define SOURCE_BYTES (64 * 1024 * 1024)
+#define ROUNDS 3
+
+static const char *levelNames[] = {"scalar", "sse2", "avx2"};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// repeat one snippet until the buffer is full
+static char *fill(const char *snippet)
+{
+    size_t len = strlen(snippet);
+    char *source = malloc(SOURCE_BYTES + 1);
+    size_t pos = 0;
+    while (pos + len < SOURCE_BYTES)
+    {
+        memcpy(source + pos, snippet, len);
+        pos += len;
+    }
+    source[pos] = '\0';
+    return source;
+}
+
+static void run(const char *name, const char *snippet)
+{
+    char *source = fill(snippet);
+    size_t bytes = strlen(source);
+    for (int level = SCAN_SCALAR; level <= (int)scan_best_level(); level++)
+    {
+        scan_set_level((ScanLevel)level);
+        double best = 1e9;
+        int count = 0;
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            TokenStream tokens;
+            double t0 = now();
+            count = tokenize(source, &tokens);
+            double t1 = now();
+            free_token_stream(&tokens);
+            if (t1 - t0 < best)
+                best = t1 - t0;
+        }
+        printf("%-12s %-7s %9d tokens %9.1f MB/s\n", name, levelNames[level], count, bytes / best / 1e6);
+    }
+    free(source);
+}
+
+int main(void)
+{
+    run("comments",
+        "*- ==================================================================\n"
+        "   generated banner: this table was produced by the data exporter.  \n"
+        "   do not edit by hand; rerun the exporter to regenerate the rows.  \n"
+        "   ================================================================= -*\n"
+        "** row marker ------------------------------------------------------\n"
+        "x;\n");
+    run("whitespace",
+        "                                                                    \n"
+        "\t\t\t\t\t\t\t\t                                    \n"
+        "                                                     x;\n");
+    run("strings",
+        "print(\"a generated data table row with a long payload of text 0123456789\");\n");
+    return 0;
+}
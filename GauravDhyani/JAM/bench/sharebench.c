@@ -0,0 +1,174 @@
+#include "jamcorpus.h"
+#include "lexer.h"
+#include "parser.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Hash-consing benchmark.
+ * Parses a generated script of each corpus shape, of the given size in MB
+ * (default 8), with and without Parser.shareExpressions, and prints how many
+ * nodes the tree has against how many distinct nodes were built with
+ * sharing, the AST node bytes that saves, and the best parse time of each.
+ * Both trees must have the same number of nodes.
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the distinct nodes a walk meets; open addressing on the pointer
+typedef struct
+{
+    const ASTNode **slots;
+    size_t capacity;
+    size_t count;
+} NodeSet;
+
+static void set_add(NodeSet *set, const ASTNode *node)
+{
+    if ((set->count + 1) * 2 > set->capacity)
+    {
+        NodeSet grown = {calloc(set->capacity ? set->capacity * 2 : 1024, sizeof(ASTNode *)),
+                         set->capacity ? set->capacity * 2 : 1024, 0};
+        if (!grown.slots)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < set->capacity; i++)
+            if (set->slots[i])
+                set_add(&grown, set->slots[i]);
+        free(set->slots);
+        *set = grown;
+    }
+    size_t i = ((uintptr_t)node >> 4) * 0x9E3779B97F4A7C15ull & (set->capacity - 1);
+    while (set->slots[i] && set->slots[i] != node)
+        i = (i + 1) & (set->capacity - 1);
+    if (!set->slots[i])
+    {
+        set->slots[i] = node;
+        set->count++;
+    }
+}
+
+static long walk(const ASTNode *node, NodeSet *set);
+
+static long walk_list(ASTNode **nodes, int count, NodeSet *set)
+{
+    long n = 0;
+    for (int i = 0; i < count; i++)
+        n += walk(nodes[i], set);
+    return n;
+}
+
+// nodes below node, counting every occurrence of a shared one
+static long walk(const ASTNode *node, NodeSet *set)
+{
+    if (!node)
+        return 0;
+    set_add(set, node);
+    switch (node->type)
+    {
+    case AST_BINARY_EXPR:
+        return 1 + walk(node->data.binary.left, set) + walk(node->data.binary.right, set);
+    case AST_UNARY_EXPR:
+        return 1 + walk(node->data.unary.operand, set);
+    case AST_VAR_DECL:
+        return 1 + walk(node->data.varDecl.varType, set) + walk(node->data.varDecl.initializer, set);
+    case AST_RETURN:
+        return 1 + walk(node->data.returnStmt.expr, set);
+    case AST_FUNCTION:
+        return 1 + walk_list(node->data.function.params, node->data.function.paramCount, set) +
+               walk(node->data.function.returnType, set) + walk(node->data.function.body, set);
+    case AST_IF:
+        return 1 + walk(node->data.ifStmt.condition, set) + walk(node->data.ifStmt.thenBranch, set) +
+               walk(node->data.ifStmt.elseBranch, set);
+    case AST_PROGRAM:
+        return 1 + walk_list(node->data.program.statements, node->data.program.count, set);
+    case AST_TYPE:
+        return 1 + (node->data.type.typeKind == AST_TYPE_ARRAY ? walk(node->data.type.elementType, set) : 0);
+    case AST_FUNCTION_CALL:
+        return 1 + walk(node->data.call.callee, set) + walk_list(node->data.call.arguments, node->data.call.argCount, set);
+    case AST_PRINT_STATEMENT:
+        return 1 + walk(node->data.printStmt.expr, set);
+    case AST_ARRAY_LITERAL:
+        return 1 + walk_list(node->data.arrayLiteral.elements, node->data.arrayLiteral.elementCount, set);
+    case AST_WHILE:
+        return 1 + walk(node->data.whileStmt.condition, set) + walk(node->data.whileStmt.body, set);
+    case AST_FOR:
+        return 1 + walk(node->data.forStmt.init, set) + walk(node->data.forStmt.condition, set) +
+               walk(node->data.forStmt.increment, set) + walk(node->data.forStmt.body, set);
+    case AST_EXPR_STMT:
+        return 1 + walk(node->data.ExprStmt.expr, set);
+    default:
+        return 1;
+    }
+}
+
+// best of three parses; *nodes and *distinct describe the last tree
+static double parse(TokenStream *tokens, bool share, long *nodes, size_t *distinct)
+{
+    double best = 1e9;
+    for (int r = 0; r < 3; r++)
+    {
+        Parser parser;
+        initParser(&parser, tokens);
+        parser.shareExpressions = share;
+        double t0 = now();
+        ASTNode *ast = parseProgram(&parser);
+        double t = now() - t0;
+        if (t < best)
+            best = t;
+        if (!ast)
+        {
+            fprintf(stderr, "parse failed\n");
+            exit(1);
+        }
+        NodeSet set = {NULL, 0, 0};
+        *nodes = walk(ast, &set);
+        *distinct = set.count;
+        free(set.slots);
+        freeParser(&parser);
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 8;
+    int failed = 0;
+    printf("%-10s %10s %10s %7s %10s %10s %10s\n", "shape", "nodes", "built", "shared", "saved MB", "plain ms",
+           "shared ms");
+    for (int shape = 0; shape < CORPUS_SHAPE_COUNT; shape++)
+    {
+        size_t length;
+        char *source = generate_corpus(shape, mb * 1024 * 1024, 32, 1, &length);
+        TokenStream tokens;
+        if (!source || tokenize_n(source, length, &tokens) < 0)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        long nodes, sharedNodes;
+        size_t distinct, built;
+        double plain = parse(&tokens, false, &nodes, &distinct);
+        double shared = parse(&tokens, true, &sharedNodes, &built);
+        printf("%-10s %10ld %10zu %6.1f%% %10.1f %10.2f %10.2f\n", corpus_shape_name(shape), nodes, built,
+               100.0 * (distinct - built) / distinct, (distinct - built) * sizeof(ASTNode) / 1e6, plain * 1e3,
+               shared * 1e3);
+        if (sharedNodes != nodes)
+        {
+            printf("node counts differ: %ld shared\n", sharedNodes);
+            failed = 1;
+        }
+        free_token_stream(&tokens);
+        free(source);
+    }
+    return failed;
+}
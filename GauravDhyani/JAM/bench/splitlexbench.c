@@ -0,0 +1,123 @@
+#include "lexer.h"
+#include "sourceloader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Single-file parallel lexing benchmark.
+ * Generates one script of the requested size (default 64 MB) with block
+ * comments and string literals that span lines, so some chunk boundaries
+ * fall inside them, then tokenizes it with tokenize_n() and with
+ * tokenize_parallel() on 1, 2, 4, ... threads. Every parallel stream must
+ * match the sequential one token for token.
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *generate(size_t bytes, size_t *length)
+{
+    static const char *lines[] = {
+        "var total: Int = count + 42;\n",
+        "** running sum of the generated rows\n",
+        "print(\"row value\");\n",
+        "*- a block comment\n   spanning two lines -*\n",
+        "while (i < 1000) { i = i + 1; }\n",
+        "print(\"a string\nover two lines\");\n",
+        "var ratio: Float = 0.25 * total;\n",
+    };
+    char *source = malloc(bytes + SOURCE_PADDING);
+    size_t pos = 0;
+    unsigned state = 1;
+    while (1)
+    {
+        state = state * 1103515245u + 12345u;
+        const char *line = lines[(state >> 16) % 7];
+        size_t len = strlen(line);
+        if (pos + len >= bytes)
+            break;
+        memcpy(source + pos, line, len);
+        pos += len;
+    }
+    memset(source + pos, 0, SOURCE_PADDING);
+    *length = pos;
+    return source;
+}
+
+static int same_tokens(const TokenStream *a, const TokenStream *b)
+{
+    return a->count == b->count &&
+           memcmp(a->types, b->types, a->count) == 0 &&
+           memcmp(a->offsets, b->offsets, a->count * sizeof(int)) == 0 &&
+           memcmp(a->lengths, b->lengths, a->count * sizeof(int)) == 0 &&
+           memcmp(a->values, b->values, a->count * sizeof(TokenValue)) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 64;
+    size_t length;
+    char *source = generate(mb * 1024 * 1024, &length);
+
+    TokenStream expected;
+    double best = 1e9;
+    for (int r = 0; r < 3; r++)
+    {
+        if (r)
+            free_token_stream(&expected);
+        double t0 = now();
+        if (tokenize_n(source, length, &expected) < 0)
+        {
+            fprintf(stderr, "tokenize_n failed\n");
+            return 1;
+        }
+        double t = now() - t0;
+        if (t < best)
+            best = t;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%.1f MB, %d tokens, %ld online CPUs\n", length / 1e6, expected.count, cpus);
+    printf("tokenize_n:      %8.1f MB/s\n", length / best / 1e6);
+
+    int maxThreads = cpus > 64 ? 64 : (int)cpus;
+    if (maxThreads < 4)
+        maxThreads = 4;
+    double base = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        best = 1e9;
+        for (int r = 0; r < 3; r++)
+        {
+            TokenStream tokens;
+            double t0 = now();
+            if (tokenize_parallel(source, length, &tokens, threads) < 0)
+            {
+                fprintf(stderr, "tokenize_parallel failed with %d threads\n", threads);
+                return 1;
+            }
+            double t = now() - t0;
+            if (t < best)
+                best = t;
+            if (!same_tokens(&tokens, &expected))
+            {
+                fprintf(stderr, "tokens differ from tokenize_n with %d threads\n", threads);
+                return 1;
+            }
+            free_token_stream(&tokens);
+        }
+        if (threads == 1)
+            base = best;
+        printf("threads %2d:      %8.1f MB/s  speedup %.2fx\n", threads, length / best / 1e6, base / best);
+    }
+
+    free_token_stream(&expected);
+    free(source);
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "lexer.h"
+#include "sourceloader.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Streaming lexer benchmark.
+ * Writes a generated script of the requested size (default 256 MB) to a
+ * temporary file, lexes it with jam_stream_next() through a 64 KB window and
+ * then with load_source() + tokenize_n(), and reports throughput and peak
+ * resident memory after each. The streaming pass runs first because peak RSS
+ * only ever grows. Token counts of both passes must agree.
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double peak_mb(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0; // kilobytes on Linux
+}
+
+static void generate(FILE *out, size_t bytes)
+{
+    static const char *lines[] = {
+        "var total: Int = count + 42;\n",
+        "** running sum of the generated rows\n",
+        "print(\"row value\");\n",
+        "*- a block comment\n   spanning two lines -*\n",
+        "while (i < 1000) { i = i + 1; }\n",
+    };
+    size_t written = 0;
+    unsigned state = 1;
+    while (written < bytes)
+    {
+        state = state * 1103515245u + 12345u;
+        const char *line = lines[(state >> 16) % 5];
+        written += fwrite(line, 1, strlen(line), out);
+    }
+    // one comment far longer than the window
+    fputs("*-", out);
+    for (int i = 0; i < 100000; i++)
+        fputs(" comment", out);
+    fputs(" -*\nvar end: Int = 1;\n", out);
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 256;
+    char path[] = "/tmp/jamstreamXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+    FILE *out = fdopen(fd, "w");
+    generate(out, mb * 1024 * 1024);
+    fclose(out);
+    printf("input: %zu MB, baseline peak RSS %.1f MB\n", mb, peak_mb());
+
+    fd = open(path, O_RDONLY);
+    JamStreamLexer stream;
+    if (fd < 0 || jam_stream_init(&stream, fd, JAM_STREAM_WINDOW) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+    double t0 = now();
+    long streamed = 0;
+    while (1)
+    {
+        streamed++;
+        if (jam_stream_next(&stream).type == TOKEN_EOF)
+            break;
+    }
+    double t1 = now();
+    size_t bytes = stream.base + stream.lexer.length;
+    int streamError = stream.error;
+    jam_stream_free(&stream);
+    close(fd);
+    printf("stream:    %9ld tokens %8.1f MB/s  peak RSS %7.1f MB\n", streamed, bytes / (t1 - t0) / 1e6, peak_mb());
+
+    SourceBuffer source;
+    TokenStream tokens;
+    t0 = now();
+    if (load_source(path, &source) != 0 || tokenize_n(source.data, source.length, &tokens) < 0)
+    {
+        perror(path);
+        return 1;
+    }
+    t1 = now();
+    long whole = tokens.count;
+    printf("tokenize:  %9ld tokens %8.1f MB/s  peak RSS %7.1f MB\n", whole, bytes / (t1 - t0) / 1e6, peak_mb());
+    free_token_stream(&tokens);
+    release_source(&source);
+    unlink(path);
+
+    if (streamError || streamed != whole)
+    {
+        fprintf(stderr, "streaming and whole-buffer lexing disagree\n");
+        return 1;
+    }
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include "executionengine.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int main(void) {
     const char* source = 
@@ -26,26 +27,30 @@ int main(void) {
     "}\n";
     // Lex
 
-    initlexer((char*)source);
-    Token** tokens = NULL;
+    TokenStream tokens;
+    tokenize(source, &tokens);
     printf("===== Tokens =====\n");
-    int count = 0, cap = 0;
-    while (1) {
-        Token* t = get_next_token();
-        printf("Token(type=%d, lexeme='%s', line=%d, col=%d)\n",(int)t->type, t->lexeme, t->line, t->col);
-        if (count == cap) {
-            cap = cap ? cap * 2 : 8;
-            tokens = realloc(tokens, cap * sizeof(Token*));
-        }
-        tokens[count++] = t;
-        if (t->type == TOKEN_EOF) break;
+    for (int i = 0; i < tokens.count; i++) {
+        const char *spelling = token_spelling((TokenType)tokens.types[i]);
+        int line, col;
+        token_position(&tokens, i, &line, &col);
+        printf("Token(type=%d, lexeme='%.*s', line=%d, col=%d)\n", (int)tokens.types[i],
+               spelling ? (int)strlen(spelling) : tokens.lengths[i],
+               spelling ? spelling : source + token_offset(&tokens, i), line, col);
     }
     
 
     // Parse
     Parser parser;
-    initParser(&parser, tokens, count);
-    ASTNode *ast = parseProgram(&parser);
+    initParser(&parser, &tokens);
+    ParseResult parsed = parseScript(&parser);
+    ASTNode *ast = parsed.ast;
+    if (!ast || parsed.diagnosticCount > 0) {
+        printParseDiagnostics(&parsed);
+        freeParser(&parser);
+        free_token_stream(&tokens);
+        return 1;
+    }
     // Print AST
     puts("\n===== AST =====");
     printAST(ast, 0);
@@ -63,12 +68,8 @@ int main(void) {
     execute(ast);
 
     // Cleanup
-    freeAST(ast);
-    for (int i = 0; i < count; i++) {
-        free(tokens[i]->lexeme);
-        free(tokens[i]);
-    }
-    free(tokens);
+    freeParser(&parser);
+    free_token_stream(&tokens);
 
     return 0;
 }
@@ -0,0 +1,104 @@
+#include "arena.h"
+#include <stdlib.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_FIRST_CHUNK (64 * 1024)
+#define ARENA_MAX_CHUNK (8 * 1024 * 1024)
+
+struct ArenaChunk {
+    ArenaChunk *prev;
+    size_t size; // usable bytes after the header
+};
+
+// header rounded up so the first allocation is aligned too
+#define CHUNK_HEADER ((sizeof(ArenaChunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+void arena_init(Arena *arena)
+{
+    arena->chunks = NULL;
+    arena->next = NULL;
+    arena->end = NULL;
+}
+
+// chunks double up to ARENA_MAX_CHUNK; larger requests get a chunk of their own size
+static int arena_grow(Arena *arena, size_t size)
+{
+    size_t chunkSize = ARENA_FIRST_CHUNK;
+    if (arena->chunks)
+    {
+        chunkSize = arena->chunks->size * 2;
+        if (chunkSize > ARENA_MAX_CHUNK)
+            chunkSize = ARENA_MAX_CHUNK;
+    }
+    if (chunkSize < size)
+        chunkSize = size;
+
+    ArenaChunk *chunk = malloc(CHUNK_HEADER + chunkSize);
+    if (!chunk)
+        return 0;
+    chunk->prev = arena->chunks;
+    chunk->size = chunkSize;
+    arena->chunks = chunk;
+    arena->next = (char *)chunk + CHUNK_HEADER;
+    arena->end = arena->next + chunkSize;
+    return 1;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if ((size_t)(arena->end - arena->next) < size && !arena_grow(arena, size))
+        return NULL;
+    void *block = arena->next;
+    arena->next += size;
+    return block;
+}
+
+void arena_reset(Arena *arena)
+{
+    ArenaChunk *keep = arena->chunks;
+    if (!keep)
+        return;
+    ArenaChunk *chunk = keep->prev;
+    while (chunk)
+    {
+        ArenaChunk *prev = chunk->prev;
+        free(chunk);
+        chunk = prev;
+    }
+    keep->prev = NULL;
+    arena->next = (char *)keep + CHUNK_HEADER;
+    arena->end = arena->next + keep->size;
+}
+
+void arena_free(Arena *arena)
+{
+    ArenaChunk *chunk = arena->chunks;
+    while (chunk)
+    {
+        ArenaChunk *prev = chunk->prev;
+        free(chunk);
+        chunk = prev;
+    }
+    arena_init(arena);
+}
+
+void arena_adopt(Arena *arena, Arena *from)
+{
+    if (!from->chunks)
+        return;
+    if (!arena->chunks)
+    {
+        *arena = *from;
+    }
+    else
+    {
+        // splice from's chunks in just behind arena's newest
+        ArenaChunk *oldest = from->chunks;
+        while (oldest->prev)
+            oldest = oldest->prev;
+        oldest->prev = arena->chunks->prev;
+        arena->chunks->prev = from->chunks;
+    }
+    arena_init(from);
+}
@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator. Memory comes from a list of chunks that grow as needed;
+ * there is no per-allocation free, everything is released at once by
+ * arena_reset() (which keeps the newest chunk for reuse) or arena_free().
+ */
+
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+    ArenaChunk *chunks; // newest first
+    char *next;         // free space of the newest chunk
+    char *end;
+} Arena;
+
+void arena_init(Arena *arena);
+// size bytes aligned for any type; NULL only when out of memory
+void *arena_alloc(Arena *arena, size_t size);
+// drop every allocation, keeping the newest chunk
+void arena_reset(Arena *arena);
+// drop every allocation and return all chunks
+void arena_free(Arena *arena);
+// take over every allocation of from, which is left empty; arena goes on
+// allocating from its own newest chunk
+void arena_adopt(Arena *arena, Arena *from);
+
+#endif // ARENA_H
@@ -0,0 +1,176 @@
+#include "astimage.h"
+#include "intern.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t align8(uint64_t offset)
+{
+    return (uint32_t)((offset + 7) & ~(uint64_t)7);
+}
+
+// -------------------------
+// Writing
+// -------------------------
+
+static int write_section(FILE *f, uint32_t offset, const void *data, size_t size)
+{
+    static const char zeros[8];
+    long at = ftell(f);
+    if (at < 0 || fwrite(zeros, 1, offset - (uint32_t)at, f) != offset - (uint32_t)at)
+        return -1;
+    return size == 0 || fwrite(data, 1, size, f) == size ? 0 : -1;
+}
+
+int write_ast_image(const FlatAst *ast, const char *filename)
+{
+    AstImageHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, JAM_IMAGE_MAGIC, 4);
+    h.version = JAM_IMAGE_VERSION;
+    h.byteOrder = JAM_IMAGE_BYTE_ORDER;
+    h.root = ast->root;
+    h.wordCount = ast->wordCount;
+    h.listCount = ast->listCount;
+    h.atomCount = ast->atomCount;
+    h.stringBytes = ast->stringBytes;
+
+    uint32_t *atomOffsets = malloc((ast->atomCount + 1) * sizeof *atomOffsets);
+    if (!atomOffsets)
+        return -1;
+    uint64_t atomBytes = 0;
+    for (uint32_t i = 0; i < ast->atomCount; i++)
+    {
+        atomOffsets[i] = (uint32_t)atomBytes;
+        atomBytes += strlen(ast->atoms[i]) + 1;
+    }
+
+    uint64_t end = align8(sizeof h);
+    h.wordsOffset = (uint32_t)end;
+    end = align8(end + (uint64_t)h.wordCount * sizeof(uint32_t));
+    h.listsOffset = (uint32_t)end;
+    end = align8(end + (uint64_t)h.listCount * sizeof(uint32_t));
+    h.atomsOffset = (uint32_t)end;
+    end = align8(end + (uint64_t)h.atomCount * sizeof(uint32_t));
+    h.atomTextOffset = (uint32_t)end;
+    end = align8(end + atomBytes);
+    h.stringsOffset = (uint32_t)end;
+    end += h.stringBytes;
+    h.atomBytes = (uint32_t)atomBytes;
+    if (end > UINT32_MAX)
+    {
+        free(atomOffsets);
+        errno = EFBIG;
+        return -1;
+    }
+
+    FILE *f = fopen(filename, "wb");
+    if (!f)
+    {
+        free(atomOffsets);
+        return -1;
+    }
+    int status = write_section(f, 0, &h, sizeof h);
+    if (status == 0)
+        status = write_section(f, h.wordsOffset, ast->words, (size_t)h.wordCount * sizeof(uint32_t));
+    if (status == 0)
+        status = write_section(f, h.listsOffset, ast->lists, (size_t)h.listCount * sizeof(uint32_t));
+    if (status == 0)
+        status = write_section(f, h.atomsOffset, atomOffsets, (size_t)h.atomCount * sizeof(uint32_t));
+    if (status == 0 && write_section(f, h.atomTextOffset, NULL, 0) == 0)
+    {
+        for (uint32_t i = 0; i < ast->atomCount && status == 0; i++)
+        {
+            size_t length = strlen(ast->atoms[i]) + 1;
+            if (fwrite(ast->atoms[i], 1, length, f) != length)
+                status = -1;
+        }
+    }
+    if (status == 0)
+        status = write_section(f, h.stringsOffset, ast->strings, h.stringBytes);
+    free(atomOffsets);
+
+    int saved = errno;
+    if (fclose(f) != 0 && status == 0)
+        return -1;
+    errno = saved;
+    return status;
+}
+
+// -------------------------
+// Loading
+// -------------------------
+
+// does [offset, offset + size) lie inside the file, 4-byte aligned?
+static int section_fits(const AstImage *image, uint32_t offset, uint64_t size)
+{
+    return offset % 4 == 0 && offset + size <= image->file.length;
+}
+
+int load_ast_image(const char *filename, AstImage *image)
+{
+    memset(image, 0, sizeof *image);
+    if (load_source(filename, &image->file) != 0)
+        return -1;
+
+    // mapped page-aligned, or malloc'd: either way aligned for the header
+    const AstImageHeader *h = (const AstImageHeader *)image->file.data;
+    char *base = image->file.data;
+    if (image->file.length < sizeof *h || memcmp(h->magic, JAM_IMAGE_MAGIC, 4) != 0 ||
+        h->version != JAM_IMAGE_VERSION || h->byteOrder != JAM_IMAGE_BYTE_ORDER ||
+        h->wordCount == 0 || h->root >= h->wordCount ||
+        !section_fits(image, h->wordsOffset, (uint64_t)h->wordCount * sizeof(uint32_t)) ||
+        !section_fits(image, h->listsOffset, (uint64_t)h->listCount * sizeof(uint32_t)) ||
+        !section_fits(image, h->atomsOffset, (uint64_t)h->atomCount * sizeof(uint32_t)) ||
+        h->atomTextOffset + (uint64_t)h->atomBytes > image->file.length ||
+        h->stringsOffset + (uint64_t)h->stringBytes > image->file.length ||
+        (h->stringBytes > 0 && base[h->stringsOffset + h->stringBytes - 1] != '\0'))
+    {
+        release_ast_image(image);
+        errno = ENOEXEC;
+        return -1;
+    }
+
+    // names are the only thing to rebuild: the runtime compares atoms by
+    // address, so each is interned once, however many nodes use it
+    FlatAst *ast = &image->ast;
+    ast->atoms = malloc((h->atomCount + 1) * sizeof *ast->atoms);
+    if (!ast->atoms)
+    {
+        release_ast_image(image);
+        errno = ENOMEM;
+        return -1;
+    }
+    const uint32_t *atomOffsets = (const uint32_t *)(base + h->atomsOffset);
+    const char *atomText = base + h->atomTextOffset;
+    for (uint32_t i = 0; i < h->atomCount; i++)
+    {
+        uint32_t at = atomOffsets[i];
+        const char *end = at < h->atomBytes ? memchr(atomText + at, '\0', h->atomBytes - at) : NULL;
+        if (!end || !(ast->atoms[i] = intern(atomText + at, (size_t)(end - (atomText + at)))))
+        {
+            int error = end ? ENOMEM : ENOEXEC;
+            release_ast_image(image);
+            errno = error;
+            return -1;
+        }
+    }
+    ast->atomCount = h->atomCount;
+
+    ast->words = (uint32_t *)(base + h->wordsOffset);
+    ast->wordCount = h->wordCount;
+    ast->lists = (uint32_t *)(base + h->listsOffset);
+    ast->listCount = h->listCount;
+    ast->strings = base + h->stringsOffset;
+    ast->stringBytes = h->stringBytes;
+    ast->root = h->root;
+    return 0;
+}
+
+void release_ast_image(AstImage *image)
+{
+    free(image->ast.atoms);
+    release_source(&image->file);
+    memset(image, 0, sizeof *image);
+}
@@ -0,0 +1,69 @@
+#ifndef AST_IMAGE_H
+#define AST_IMAGE_H
+
+#include "flatast.h"
+#include "sourceloader.h"
+#include <stdint.h>
+
+/*
+ * Precompiled AST image: a FlatAst written out as it is in memory, so that
+ * loading one is a mapping plus interning its names.
+ *
+ *   section     count        contents
+ *   header      1            AstImageHeader
+ *   words       wordCount    node records, uint32
+ *   lists       listCount    child lists, uint32
+ *   atoms       atomCount    offset of every name in the name text, uint32
+ *   name text   atomBytes    NUL-terminated names back to back
+ *   strings     stringBytes  NUL-terminated literals back to back
+ *
+ * Every section starts 8-byte aligned, at the file offset the header gives.
+ * Images are native-endian and tied to this build's numbering of node kinds,
+ * operators and token types; JAM_IMAGE_VERSION changes whenever any of them
+ * or the record layout does, and images of another version are refused.
+ */
+
+#define JAM_IMAGE_MAGIC "JAMI"
+#define JAM_IMAGE_VERSION 1
+#define JAM_IMAGE_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder; // JAM_IMAGE_BYTE_ORDER as the writer stored it
+    uint32_t root;
+    uint32_t wordCount;
+    uint32_t listCount;
+    uint32_t atomCount;
+    uint32_t atomBytes;
+    uint32_t stringBytes;
+    uint32_t wordsOffset;
+    uint32_t listsOffset;
+    uint32_t atomsOffset;
+    uint32_t atomTextOffset;
+    uint32_t stringsOffset;
+} AstImageHeader;
+
+typedef struct {
+    FlatAst ast;       // words, lists and strings point into the mapping
+    SourceBuffer file; // the mapped image
+} AstImage;
+
+// C++ linkage-aware section
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 0 on success, -1 on failure (errno describes the error)
+int write_ast_image(const FlatAst *ast, const char *filename);
+// 0 on success, -1 on failure (errno describes the error; ENOEXEC when the
+// file is not an image of this version). The tree is used in place; the
+// expanders check its records as they read them.
+int load_ast_image(const char *filename, AstImage *image);
+void release_ast_image(AstImage *image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AST_IMAGE_H
@@ -1,9 +1,13 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "parser.h"
 #include "semanticanalyser.h"
 #include "executionengine.h"
+#include "astimage.h"
+#include "moduleloader.h"
+#include "sourceloader.h"
 
 
 // -------------------------
@@ -24,25 +28,25 @@ void freeValue(Value *v) {
 }
 
 typedef struct FunctionEntry {
-    const char *name;
+    Atom name;
     ASTNode *functionNode;
     struct FunctionEntry *next;
 } FunctionEntry;
 
 FunctionEntry *functionRegistry = NULL;
 
-void setFunctionEntry(const char *name, ASTNode *functionNode) {
+void setFunctionEntry(Atom name, ASTNode *functionNode) {
     FunctionEntry *entry = malloc(sizeof(FunctionEntry));
-    entry->name = strdup(name);
+    entry->name = name;
     entry->functionNode = functionNode;
     entry->next = functionRegistry;
     functionRegistry = entry;
 }
 
-ASTNode* getFunctionEntry(const char *name) {
+ASTNode* getFunctionEntry(Atom name) {
     FunctionEntry *current = functionRegistry;
     while (current) {
-        if (strcmp(current->name, name) == 0) {
+        if (current->name == name) {
             return current->functionNode;
         }
         current = current->next;
@@ -102,12 +106,13 @@ Type* makeFunctionType(ASTNode* functionNode) {
 // Environment Management
 // -------------------------
 
-EnvEntry *getEnvEntry(EnvEntry *env, char *name)
+// names are atoms, so a pointer comparison is a name comparison
+EnvEntry *getEnvEntry(EnvEntry *env, Atom name)
 {
     //dumpEnvEntries(env);  // pass pointer, not dereferenced struct
     while (env)
     {
-        if (strcmp(env->name, name) == 0)
+        if (env->name == name)
             return env;
         env = env->next;
     }
@@ -124,9 +129,9 @@ void dumpEnvEntries(EnvEntry *env) {
     }
 }
 
-void addEnvEntry(EnvEntry **env, char *name, ASTNode *typeAnnotation) {
+void addEnvEntry(EnvEntry **env, Atom name, ASTNode *typeAnnotation) {
     EnvEntry *newEntry = malloc(sizeof(EnvEntry));
-    newEntry->name = strdup(name);
+    newEntry->name = name;
     newEntry->typeAnnotation = typeAnnotation;
     newEntry->storedValue = NULL;   
     newEntry->next = *env;
@@ -138,7 +143,6 @@ void freeEnv(EnvEntry *env)
     while (env)
     {
         EnvEntry *next = env->next;
-        free(env->name);
         if (env->typeAnnotation &&
             env->typeAnnotation->type == AST_TYPE &&
             env->typeAnnotation->data.type.typeKind == AST_TYPE_STRING &&
@@ -170,7 +174,7 @@ void freeEnv(EnvEntry *env)
 // -------------------------
 
 CallStackEntry *callStack = NULL;
-void pushCallStack(char *funcName, EnvEntry *env)
+void pushCallStack(Atom funcName, EnvEntry *env)
 {
     CallStackEntry *entry = malloc(sizeof(CallStackEntry));
     if (!entry) {
@@ -178,13 +182,7 @@ void pushCallStack(char *funcName, EnvEntry *env)
         exit(1);
     }
 
-    entry->funcName = strdup(funcName);
-    if (!entry->funcName) {
-        perror("strdup failed");
-        free(entry);
-        exit(1);
-    }
-
+    entry->funcName = funcName;
     entry->env = env;
     entry->next = callStack;
     callStack = entry;
@@ -197,7 +195,6 @@ void popCallStack()
         CallStackEntry *entry = callStack;
         callStack = callStack->next;
 
-        free(entry->funcName);
         // freeEnv(entry->env); // Uncomment if safe
         free(entry);
     }
@@ -207,18 +204,64 @@ void popCallStack()
 // -------------------------
 // Expression Evaluation
 // -------------------------
-Value* evaluateExpression(ASTNode *node, EnvEntry *env) {
-    if (!node) {
-        printf("Runtime Error: Null expression node.\n");
-        exit(EXIT_FAILURE);
-    }
+// Operators are evaluated with an explicit stack of pending nodes and one of
+// finished values instead of recursion, so a long operator chain costs heap,
+// not C stack. Leaves, calls and array literals are evaluated by
+// evaluateOperand(). Both stacks start in a small buffer in the frame, so an
+// ordinary expression allocates nothing extra.
+#define EVAL_INLINE_DEPTH 8
+
+typedef struct {
+    ASTNode *node;
+    bool operandsDone; // its operands' values are on the value stack
+} EvalStep;
+
+typedef struct {
+    EvalStep *steps;
+    int stepCount, stepCapacity;
+    Value **values;
+    int valueCount, valueCapacity;
+    EvalStep stepBuffer[EVAL_INLINE_DEPTH];
+    Value *valueBuffer[EVAL_INLINE_DEPTH];
+} EvalStack;
+
+static void *growEvalArray(void *array, const void *buffer, int *capacity, size_t size) {
+    int next = *capacity * 2;
+    void *grown = array == buffer ? malloc(next * size) : realloc(array, next * size);
+    if (!grown) { perror("malloc failed"); exit(EXIT_FAILURE); }
+    if (array == buffer)
+        memcpy(grown, buffer, *capacity * size);
+    *capacity = next;
+    return grown;
+}
+
+static void pushEvalStep(EvalStack *s, ASTNode *node, bool operandsDone) {
+    if (s->stepCount == s->stepCapacity)
+        s->steps = growEvalArray(s->steps, s->stepBuffer, &s->stepCapacity, sizeof(EvalStep));
+    s->steps[s->stepCount].node = node;
+    s->steps[s->stepCount].operandsDone = operandsDone;
+    s->stepCount++;
+}
+
+static void pushEvalValue(EvalStack *s, Value *value) {
+    if (s->valueCount == s->valueCapacity)
+        s->values = growEvalArray(s->values, s->valueBuffer, &s->valueCapacity, sizeof(Value *));
+    s->values[s->valueCount++] = value;
+}
 
+static Value *evaluateOperand(ASTNode *node, EnvEntry *env) {
     switch (node->type) {
         case AST_NUMBER: {
             Value *v = malloc(sizeof(Value));
             if (!v) { perror("malloc failed"); exit(EXIT_FAILURE); }
-            v->type = VALUE_FLOAT;
-            v->floatValue = (float)node->data.number;
+            // the lexer already decoded the literal; just box the typed constant
+            if (node->data.number.kind == TOKEN_FLOAT) {
+                v->type = VALUE_FLOAT;
+                v->floatValue = node->data.number.floatValue;
+            } else {
+                v->type = VALUE_INT;
+                v->intValue = node->data.number.intValue;
+            }
             return v;
         }
 
@@ -250,113 +293,6 @@ Value* evaluateExpression(ASTNode *node, EnvEntry *env) {
             return copy;
         }
 
-        case AST_BINARY_EXPR: {
-            const char *op = node->data.binary.op->lexeme;
-
-            if (strcmp(op, "=") == 0) {
-                // Assignment operator
-
-                ASTNode *leftNode = node->data.binary.left;
-                ASTNode *rightNode = node->data.binary.right;
-
-                if (leftNode->type != AST_IDENTIFIER) {
-                    printf("Runtime Error: Left side of assignment must be a variable.\n");
-                    exit(EXIT_FAILURE);
-                }
-
-                // Evaluate right side expression first
-                Value *rightVal = evaluateExpression(rightNode, env);
-                if (!rightVal) {
-                    printf("Runtime Error: Failed to evaluate right side of assignment.\n");
-                    exit(EXIT_FAILURE);
-                }
-
-                // Lookup the variable entry in environment
-                EnvEntry *entry = getEnvEntry(env, leftNode->data.identifier);
-                if (!entry) {
-                    printf("Runtime Error: Variable '%s' not declared.\n", leftNode->data.identifier);
-                    exit(EXIT_FAILURE);
-                }
-
-                // Free old stored value if any
-                if (entry->storedValue) {
-                    freeValue(entry->storedValue);
-                }
-
-                // Assign new value
-                entry->storedValue = rightVal;
-
-                // Return the assigned value
-                return rightVal;
-            }
-
-            // For other binary operators, evaluate left and right as usual
-            Value *left = evaluateExpression(node->data.binary.left, env);
-            Value *right = evaluateExpression(node->data.binary.right, env);
-
-            if ((left->type != VALUE_INT && left->type != VALUE_FLOAT) ||
-                (right->type != VALUE_INT && right->type != VALUE_FLOAT)) {
-                printf("Runtime Error: Binary operations require numeric operands.\n");
-                exit(EXIT_FAILURE);
-            }
-
-            float l = (left->type == VALUE_FLOAT) ? left->floatValue : (float)left->intValue;
-            float r = (right->type == VALUE_FLOAT) ? right->floatValue : (float)right->intValue;
-
-            Value *v = malloc(sizeof(Value));
-            if (!v) { perror("malloc failed"); exit(EXIT_FAILURE); }
-            v->type = VALUE_FLOAT;
-
-            if (strcmp(op, "<=") == 0) v->floatValue = l <= r ? 1.0f : 0.0f;
-            else if (strcmp(op, ">=") == 0) v->floatValue = l >= r ? 1.0f : 0.0f;
-            else if (strcmp(op, "<")  == 0) v->floatValue = l < r  ? 1.0f : 0.0f;
-            else if (strcmp(op, ">")  == 0) v->floatValue = l > r  ? 1.0f : 0.0f;
-            else if (strcmp(op, "==") == 0) v->floatValue = l == r ? 1.0f : 0.0f;
-            else if (strcmp(op, "!=") == 0) v->floatValue = l != r ? 1.0f : 0.0f;
-            else if (strcmp(op, "+")  == 0) v->floatValue = l + r;
-            else if (strcmp(op, "-")  == 0) v->floatValue = l - r;
-            else if (strcmp(op, "*")  == 0) v->floatValue = l * r;
-            else if (strcmp(op, "/")  == 0) {
-                if (r == 0.0f) {
-                    printf("Runtime Error: Division by zero.\n");
-                    exit(EXIT_FAILURE);
-                }
-                v->floatValue = l / r;
-            } else {
-                printf("Runtime Error: Unknown binary operator '%s'\n", op);
-                exit(EXIT_FAILURE);
-            }
-
-            free(left);
-            free(right);
-            return v;
-        }
-
-
-        case AST_UNARY_EXPR: {
-            Value *operand = evaluateExpression(node->data.unary.operand, env);
-            const char *op = node->data.unary.op->lexeme;
-
-            if (operand->type != VALUE_FLOAT) {
-                printf("Runtime Error: Unary operations require float operand.\n");
-                exit(EXIT_FAILURE);
-            }
-
-            Value *v = malloc(sizeof(Value));
-            if (!v) { perror("malloc failed"); exit(EXIT_FAILURE); }
-            v->type = VALUE_FLOAT;
-
-            if (strcmp(op, "-") == 0) v->floatValue = -operand->floatValue;
-            else if (strcmp(op, "!") == 0) v->floatValue = (!operand->floatValue) ? 1.0f : 0.0f;
-            else {
-                printf("Runtime Error: Unknown unary operator '%s'\n", op);
-                exit(EXIT_FAILURE);
-            }
-
-            free(operand);
-            return v;
-        }
-
         case AST_FUNCTION_CALL: {
             if (!node->data.call.callee || node->data.call.callee->type != AST_IDENTIFIER) {
                 printf("Runtime Error: Invalid function call callee.\n");
@@ -401,10 +337,167 @@ Value* evaluateExpression(ASTNode *node, EnvEntry *env) {
     }
 }
 
+// store the value of the right side of an assignment; it is also the result
+static Value *assignValue(ASTNode *node, Value *rightVal, EnvEntry *env) {
+    ASTNode *leftNode = node->data.binary.left;
+    if (!rightVal) {
+        printf("Runtime Error: Failed to evaluate right side of assignment.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Lookup the variable entry in environment
+    EnvEntry *entry = getEnvEntry(env, leftNode->data.identifier);
+    if (!entry) {
+        printf("Runtime Error: Variable '%s' not declared.\n", leftNode->data.identifier);
+        exit(EXIT_FAILURE);
+    }
+
+    // Free old stored value if any
+    if (entry->storedValue) {
+        freeValue(entry->storedValue);
+    }
+
+    // Assign new value
+    entry->storedValue = rightVal;
+
+    // Return the assigned value
+    return rightVal;
+}
+
+static Value *binaryValue(OpCode op, Value *left, Value *right) {
+    if ((left->type != VALUE_INT && left->type != VALUE_FLOAT) ||
+        (right->type != VALUE_INT && right->type != VALUE_FLOAT)) {
+        printf("Runtime Error: Binary operations require numeric operands.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    float l = (left->type == VALUE_FLOAT) ? left->floatValue : (float)left->intValue;
+    float r = (right->type == VALUE_FLOAT) ? right->floatValue : (float)right->intValue;
+
+    Value *v = malloc(sizeof(Value));
+    if (!v) { perror("malloc failed"); exit(EXIT_FAILURE); }
+    v->type = VALUE_FLOAT;
+
+    switch (op) {
+        case OP_LTE: v->floatValue = l <= r ? 1.0f : 0.0f; break;
+        case OP_GTE: v->floatValue = l >= r ? 1.0f : 0.0f; break;
+        case OP_LT:  v->floatValue = l < r  ? 1.0f : 0.0f; break;
+        case OP_GT:  v->floatValue = l > r  ? 1.0f : 0.0f; break;
+        case OP_EQ:  v->floatValue = l == r ? 1.0f : 0.0f; break;
+        case OP_NEQ: v->floatValue = l != r ? 1.0f : 0.0f; break;
+        case OP_ADD: v->floatValue = l + r; break;
+        case OP_SUB: v->floatValue = l - r; break;
+        case OP_MUL: v->floatValue = l * r; break;
+        case OP_DIV:
+            if (r == 0.0f) {
+                printf("Runtime Error: Division by zero.\n");
+                exit(EXIT_FAILURE);
+            }
+            v->floatValue = l / r;
+            break;
+        default:
+            printf("Runtime Error: Unknown binary operator '%s'\n", opSpelling(op));
+            exit(EXIT_FAILURE);
+    }
+
+    free(left);
+    free(right);
+    return v;
+}
+
+static Value *unaryValue(OpCode op, Value *operand) {
+    if (operand->type != VALUE_FLOAT && operand->type != VALUE_INT) {
+        printf("Runtime Error: Unary operations require numeric operand.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Value *v = malloc(sizeof(Value));
+    if (!v) { perror("malloc failed"); exit(EXIT_FAILURE); }
+    v->type = operand->type;
+
+    // int operands stay ints, e.g. a negative Int literal
+    bool isInt = operand->type == VALUE_INT;
+    if (op == OP_NEG) {
+        if (isInt) v->intValue = -operand->intValue;
+        else v->floatValue = -operand->floatValue;
+    }
+    else if (op == OP_NOT) {
+        if (isInt) v->intValue = !operand->intValue;
+        else v->floatValue = (!operand->floatValue) ? 1.0f : 0.0f;
+    }
+    else {
+        printf("Runtime Error: Unknown unary operator '%s'\n", opSpelling(op));
+        exit(EXIT_FAILURE);
+    }
+
+    free(operand);
+    return v;
+}
+
+Value* evaluateExpression(ASTNode *node, EnvEntry *env) {
+    EvalStack s;
+    s.steps = s.stepBuffer;
+    s.stepCount = 0;
+    s.stepCapacity = EVAL_INLINE_DEPTH;
+    s.values = s.valueBuffer;
+    s.valueCount = 0;
+    s.valueCapacity = EVAL_INLINE_DEPTH;
+    pushEvalStep(&s, node, false);
+
+    while (s.stepCount > 0) {
+        EvalStep step = s.steps[--s.stepCount];
+        node = step.node;
+        if (!node) {
+            printf("Runtime Error: Null expression node.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (node->type == AST_BINARY_EXPR) {
+            OpCode op = node->data.binary.op;
+            if (!step.operandsDone) {
+                if (op == OP_ASSIGN && node->data.binary.left->type != AST_IDENTIFIER) {
+                    printf("Runtime Error: Left side of assignment must be a variable.\n");
+                    exit(EXIT_FAILURE);
+                }
+                // the left operand is popped, and so evaluated, first; an
+                // assignment evaluates only its right side
+                pushEvalStep(&s, node, true);
+                pushEvalStep(&s, node->data.binary.right, false);
+                if (op != OP_ASSIGN)
+                    pushEvalStep(&s, node->data.binary.left, false);
+            } else if (op == OP_ASSIGN) {
+                s.values[s.valueCount - 1] = assignValue(node, s.values[s.valueCount - 1], env);
+            } else {
+                Value *right = s.values[--s.valueCount];
+                s.values[s.valueCount - 1] = binaryValue(op, s.values[s.valueCount - 1], right);
+            }
+        } else if (node->type == AST_UNARY_EXPR) {
+            if (!step.operandsDone) {
+                pushEvalStep(&s, node, true);
+                pushEvalStep(&s, node->data.unary.operand, false);
+            } else {
+                s.values[s.valueCount - 1] = unaryValue(node->data.unary.op, s.values[s.valueCount - 1]);
+            }
+        } else {
+            pushEvalValue(&s, evaluateOperand(node, env));
+        }
+    }
+
+    Value *result = s.values[0];
+    if (s.steps != s.stepBuffer)
+        free(s.steps);
+    if (s.values != s.valueBuffer)
+        free(s.values);
+    return result;
+}
+
 // -------------------------
 // Statement Execution
 // -------------------------
 void executeStatement(ASTNode *node, EnvEntry **env, float *outReturnValue, bool *outHasReturned) {
+    // the branch taken by an if and the last statement of a block run here,
+    // not in a nested call, so an else-if ladder of any length takes no stack
+tail:
     if (!node || (outHasReturned && *outHasReturned)) return;
 
     // Skip non-statement nodes
@@ -452,7 +545,7 @@ void executeStatement(ASTNode *node, EnvEntry **env, float *outReturnValue, bool
                         case AST_TYPE_INT:
                             if (value->type == VALUE_FLOAT || value->type == VALUE_INT) {
                                 entry->storedValue->type = VALUE_INT;
-                                entry->storedValue->intValue = (int)(value->type == VALUE_FLOAT ? value->floatValue : value->intValue);
+                                entry->storedValue->intValue = value->type == VALUE_FLOAT ? (int)value->floatValue : value->intValue;
                             } else {
                                 printf("Runtime Error: Type mismatch assigning to int variable '%s'\n", node->data.varDecl.varName);
                                 free(entry->storedValue);
@@ -524,11 +617,8 @@ void executeStatement(ASTNode *node, EnvEntry **env, float *outReturnValue, bool
             bool cond = (condVal->type == VALUE_FLOAT ? condVal->floatValue : condVal->intValue);
             free(condVal);
 
-            if (cond)
-                executeStatement(node->data.ifStmt.thenBranch, env, outReturnValue, outHasReturned);
-            else if (node->data.ifStmt.elseBranch)
-                executeStatement(node->data.ifStmt.elseBranch, env, outReturnValue, outHasReturned);
-            break;
+            node = cond ? node->data.ifStmt.thenBranch : node->data.ifStmt.elseBranch;
+            goto tail;
         }
 
         case AST_WHILE: {
@@ -568,13 +658,13 @@ void executeStatement(ASTNode *node, EnvEntry **env, float *outReturnValue, bool
         case AST_EXPR_STMT: {
         if (node->data.ExprStmt.expr->type == AST_BINARY_EXPR) {
             ASTNode *expr = node->data.ExprStmt.expr;
-            if (strcmp(expr->data.binary.op->lexeme, "=") == 0) {
+            if (expr->data.binary.op == OP_ASSIGN) {
                 // Left side must be an identifier
                 if (expr->data.binary.left->type != AST_IDENTIFIER) {
                     printf("Runtime Error: Left side of assignment must be variable.\n");
                     exit(EXIT_FAILURE);
                 }
-                char *varName = expr->data.binary.left->data.identifier;
+                Atom varName = expr->data.binary.left->data.identifier;
                 Value *val = evaluateExpression(expr->data.binary.right, *env);
                 EnvEntry *entry = getEnvEntry(*env, varName);
                 if (!entry) {
@@ -638,6 +728,10 @@ void executeStatement(ASTNode *node, EnvEntry **env, float *outReturnValue, bool
             break;
         }
 
+        case AST_IMPORT:
+            // imported modules are linked and run by the module loader
+            break;
+
         case AST_FUNCTION: {
             addEnvEntry(env, node->data.function.name, node);  // Store full function node
             EnvEntry *entry = getEnvEntry(*env, node->data.function.name);
@@ -647,10 +741,14 @@ void executeStatement(ASTNode *node, EnvEntry **env, float *outReturnValue, bool
         }
 
         case AST_PROGRAM: {
-            for (int i = 0; i < node->data.program.count && !(*outHasReturned); i++) {
+            int last = node->data.program.count - 1;
+            if (last < 0)
+                break;
+            for (int i = 0; i < last && !(*outHasReturned); i++) {
                 executeStatement(node->data.program.statements[i], env, outReturnValue, outHasReturned);
             }
-            break;
+            node = node->data.program.statements[last];
+            goto tail;
         }
 
         default:
@@ -747,7 +845,17 @@ float executeFunction(ASTNode *funcNode, ASTNode **args, int argCount) {
     float returnValue = 0.0f;
     bool hasReturned = false;
 
-    executeStatement(funcNode->data.function.body, &localEnv, &returnValue, &hasReturned);
+    // a lazy body is parsed and checked on the first call
+    bool firstCall = funcNode->data.function.lazyBody != NULL;
+    ASTNode *body = functionBody(funcNode);
+    if (!body && funcNode->data.function.lazyBody) {
+        fprintf(stderr, "Runtime Error: the body of function '%s' could not be loaded.\n",
+                funcNode->data.function.name);
+        exit(EXIT_FAILURE);
+    }
+    if (firstCall)
+        traverse(body);
+    executeStatement(body, &localEnv, &returnValue, &hasReturned);
 
     popCallStack();
     freeEnv(localEnv);
@@ -807,6 +915,9 @@ void execute(ASTNode *node)
             printf("Warning: Function '%s' found outside program block.\n", node->data.function.name);
             break;
 
+        case AST_IMPORT:
+            break;
+
         case AST_VAR_DECL:
         case AST_IF:
         case AST_RETURN:
@@ -833,76 +944,151 @@ void execute(ASTNode *node)
  // Script Runner
  // -------------------------
 
+ // Imported modules stay compiled here for the life of the process, so
+ // scripts run one after another share them
+static ModuleCache *sharedModuleCache(void) {
+    static ModuleCache moduleCache;
+    static int moduleCacheReady = 0;
+    if (!moduleCacheReady) {
+        init_module_cache(&moduleCache);
+        moduleCacheReady = 1;
+    }
+    return &moduleCache;
+}
+
  /**
-  * Loads and runs a JAM script from file.
+  * Loads and runs a JAM script from file, after every module it imports.
+  * The file is memory-mapped and lexed in place; "-" reads standard input.
   *
-  * @param filename Path to the script file.
+  * @param filename Path to the script file, or "-".
   * @return 0 on success, 1 on failure.
   */
 int run_jam_script(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("Script open error");
-        return 1;
-    }
-
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    rewind(file);
-
-    char *source_code = malloc(size + 1);
-    fread(source_code, 1, size, file);
-    source_code[size] = '\0';
-    fclose(file);
-
-    // Lexing
-    initlexer(source_code);
-    Token** tokens = NULL;
-    int count = 0, cap = 0;
-    while (1) {
-        Token* t = get_next_token();
-        if (count == cap) {
-            cap = cap ? cap * 2 : 8;
-            tokens = realloc(tokens, cap * sizeof(Token*));
-        }
-        tokens[count++] = t;
-        if (t->type == TOKEN_EOF) break;
-    }
-
-    // Parse
-    Parser parser;
-    initParser(&parser, tokens, count);
-    ASTNode *ast = parseProgram(&parser);
-    if (!ast) {
-        fprintf(stderr, "Parsing failed.\n");
-        free(source_code);
-        for (int i = 0; i < count; i++) {
-            free(tokens[i]->lexeme);
-            free(tokens[i]);
-        }
-        free(tokens);
+    // Lexing and parsing: large scripts are lexed on every online CPU,
+    // independent imports are compiled in parallel
+    ModuleGraph graph;
+    if (load_module_graph(sharedModuleCache(), filename, &graph) != 0) {
+        print_module_errors(&graph);
+        free_module_graph(&graph);
         return 1;
     }
 
     // Semantic Analysis
     enterScope();
-    traverse(ast);
+    for (int i = 0; i < graph.orderCount; i++)
+        traverse(graph.nodes[graph.order[i]].module->ast);
     exitScope();
 
-    // Execution
+    // Execution: imported modules first, all in the one global scope
     printf("\n===== Execution =====\n");
-    execute(ast);
+    for (int i = 0; i < graph.orderCount; i++)
+        execute(graph.nodes[graph.order[i]].module->ast);
 
     // Cleanup
-    freeAST(ast);
-    for (int i = 0; i < count; i++) {
-        free(tokens[i]->lexeme);
-        free(tokens[i]);
-    }
-    free(tokens);
-    free(source_code);
+    free_module_graph(&graph);
     return 0;
 }
 
+ /**
+  * Compiles a JAM script and everything it imports into an AST image.
+  * The image holds one program per module, in the order they run, and is
+  * written only when every module parses and passes semantic analysis.
+  *
+  * @param filename Path to the script file, or "-".
+  * @param imagePath Path of the image to write.
+  * @return 0 on success, 1 on failure.
+  */
+int compile_jam_image(const char *filename, const char *imagePath) {
+    ModuleGraph graph;
+    if (load_module_graph(sharedModuleCache(), filename, &graph) != 0) {
+        print_module_errors(&graph);
+        free_module_graph(&graph);
+        return 1;
+    }
+
+    ASTNode **modules = malloc(graph.orderCount * sizeof(ASTNode *));
+    if (!modules) {
+        fprintf(stderr, "Image error: out of memory.\n");
+        free_module_graph(&graph);
+        return 1;
+    }
+    // the image holds every body, so parse the ones imports left lazy
+    for (int i = 0; i < graph.orderCount; i++) {
+        if (load_function_bodies(graph.nodes[graph.order[i]].module) != 0) {
+            free(modules);
+            free_module_graph(&graph);
+            return 1;
+        }
+    }
+    enterScope();
+    for (int i = 0; i < graph.orderCount; i++) {
+        modules[i] = graph.nodes[graph.order[i]].module->ast;
+        traverse(modules[i]);
+    }
+    exitScope();
+
+    ASTNode program;
+    program.type = AST_PROGRAM;
+    program.data.program.statements = modules;
+    program.data.program.count = graph.orderCount;
+
+    FlatAst flat;
+    int status = 0;
+    if (flatten_ast(&program, &flat) != 0) {
+        fprintf(stderr, "Image error: out of memory.\n");
+        status = 1;
+    } else {
+        if (write_ast_image(&flat, imagePath) != 0) {
+            fprintf(stderr, "Image write error: %s: %s\n", imagePath, strerror(errno));
+            status = 1;
+        }
+        free_flat_ast(&flat);
+    }
+    free(modules);
+    free_module_graph(&graph);
+    return status;
+}
+
+ /**
+  * Runs an AST image written by compile_jam_image().
+  * The image is mapped and used in place: only its names are interned and
+  * the top-level statements expanded; function bodies are expanded on
+  * their first call, so code that never runs is never touched.
+  *
+  * @param imagePath Path to the image.
+  * @return 0 on success, 1 on failure.
+  */
+int run_jam_image(const char *imagePath) {
+    AstImage image;
+    if (load_ast_image(imagePath, &image) != 0) {
+        if (errno == ENOEXEC)
+            fprintf(stderr, "Image error: %s is not a version %d JAM image.\n", imagePath, JAM_IMAGE_VERSION);
+        else
+            fprintf(stderr, "Image open error: %s\n", strerror(errno));
+        return 1;
+    }
+
+    Arena arena;
+    arena_init(&arena);
+    ASTNode *program = expand_flat_ast_lazily(&image.ast, &arena);
+    if (!program || program->type != AST_PROGRAM) {
+        if (!program && errno == ENOMEM)
+            fprintf(stderr, "Image error: out of memory.\n");
+        else
+            fprintf(stderr, program ? "Image error: %s has no program.\n" : "Image error: %s is damaged.\n",
+                    imagePath);
+        arena_free(&arena);
+        release_ast_image(&image);
+        return 1;
+    }
 
-  
\ No newline at end of file
+    // Execution: one program per module, imported modules first
+    printf("\n===== Execution =====\n");
+    for (int i = 0; i < program->data.program.count; i++)
+        execute(program->data.program.statements[i]);
+
+    // Cleanup
+    arena_free(&arena);
+    release_ast_image(&image);
+    return 0;
+}
@@ -28,7 +28,7 @@ typedef struct Value {
 } Value;
 // Structure for environment entries (variables and their values)
 typedef struct EnvEntry {
-    char *name;
+    Atom name;
     ASTNode *typeAnnotation;  
     Value *storedValue;
     union {
@@ -43,7 +43,7 @@ typedef struct EnvEntry {
 
 // Structure for call stack entries (function calls)
 typedef struct CallStackEntry {
-    char *funcName;
+    Atom funcName;
     EnvEntry *env;
     struct CallStackEntry *next;
 } CallStackEntry;
@@ -55,16 +55,18 @@ extern "C" {
 
 void freeType(Type *type);
 void freeSymbolTable(SymbolTableEntry *table);
-EnvEntry* getEnvEntry(EnvEntry *env, char *name);
-void addEnvEntry(EnvEntry **env, char *name, ASTNode *typeAnnotation);
+EnvEntry* getEnvEntry(EnvEntry *env, Atom name);
+void addEnvEntry(EnvEntry **env, Atom name, ASTNode *typeAnnotation);
 void freeEnv(EnvEntry *env);
-void pushCallStack(char *funcName, EnvEntry *env);
+void pushCallStack(Atom funcName, EnvEntry *env);
 void popCallStack(void);
 Value* evaluateExpression(ASTNode *node, EnvEntry *env);
 void executeStatement(ASTNode *node, EnvEntry **env, float *outReturnValue, bool *outHasReturned);
 float executeFunction(ASTNode *funcNode, ASTNode **args, int argCount);
 void execute(ASTNode *node);
 int run_jam_script(const char *filename);
+int compile_jam_image(const char *filename, const char *imagePath);
+int run_jam_image(const char *imagePath);
 void dumpEnvEntries(EnvEntry *env);
 
 #ifdef __cplusplus
@@ -72,8 +74,8 @@ void dumpEnvEntries(EnvEntry *env);
 #endif
 
 // Leave these outside if defined in C++
-void addSymbol(char *name, Type *type);
-int isDeclared(char *name);
+void addSymbol(Atom name, Type *type);
+int isDeclared(Atom name);
 
 #endif // EXECUTION_ENGINE_H
 
@@ -0,0 +1,974 @@
+#include "flatast.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// -------------------------
+// Building
+// -------------------------
+
+typedef struct {
+    FlatAst *ast;
+    uint32_t wordCapacity;
+    uint32_t listCapacity;
+    uint32_t atomCapacity;
+    uint32_t stringCapacity;
+    uint32_t *atomSlots; // open addressing by atom pointer, index + 1 (0 is empty)
+    uint32_t atomSlotCount;
+    int failed;
+} FlatBuilder;
+
+// make room for needed elements, doubling; 0 when out of memory
+static int reserve(FlatBuilder *b, void **array, uint32_t *capacity, uint64_t needed, size_t size)
+{
+    if (needed <= *capacity)
+        return 1;
+    uint64_t grown = *capacity ? (uint64_t)*capacity * 2 : 256;
+    while (grown < needed)
+        grown *= 2;
+    void *bigger = grown > UINT32_MAX ? NULL : realloc(*array, grown * size);
+    if (!bigger)
+    {
+        b->failed = 1;
+        return 0;
+    }
+    *array = bigger;
+    *capacity = (uint32_t)grown;
+    return 1;
+}
+
+// a record of count words, zeroed so that fields left unset are FLAT_NONE
+static uint32_t add_words(FlatBuilder *b, int count)
+{
+    FlatAst *ast = b->ast;
+    if (!reserve(b, (void **)&ast->words, &b->wordCapacity, (uint64_t)ast->wordCount + count, sizeof(uint32_t)))
+        return 0;
+    uint32_t at = ast->wordCount;
+    memset(ast->words + at, 0, count * sizeof(uint32_t));
+    ast->wordCount += count;
+    return at;
+}
+
+static uint32_t add_atom(FlatBuilder *b, Atom atom)
+{
+    FlatAst *ast = b->ast;
+    // keep the slot table at most half full
+    if ((ast->atomCount + 1) * 2 > b->atomSlotCount)
+    {
+        uint32_t count = b->atomSlotCount ? b->atomSlotCount * 2 : 256;
+        uint32_t *slots = calloc(count, sizeof(uint32_t));
+        if (!slots)
+        {
+            b->failed = 1;
+            return 0;
+        }
+        for (uint32_t i = 0; i < ast->atomCount; i++)
+        {
+            uint32_t s = (uint32_t)(((uintptr_t)ast->atoms[i] >> 3) * 2654435761u) & (count - 1);
+            while (slots[s])
+                s = (s + 1) & (count - 1);
+            slots[s] = i + 1;
+        }
+        free(b->atomSlots);
+        b->atomSlots = slots;
+        b->atomSlotCount = count;
+    }
+    uint32_t s = (uint32_t)(((uintptr_t)atom >> 3) * 2654435761u) & (b->atomSlotCount - 1);
+    while (b->atomSlots[s])
+    {
+        if (ast->atoms[b->atomSlots[s] - 1] == atom)
+            return b->atomSlots[s] - 1;
+        s = (s + 1) & (b->atomSlotCount - 1);
+    }
+    if (!reserve(b, (void **)&ast->atoms, &b->atomCapacity, (uint64_t)ast->atomCount + 1, sizeof(Atom)))
+        return 0;
+    ast->atoms[ast->atomCount] = atom;
+    b->atomSlots[s] = ++ast->atomCount;
+    return ast->atomCount - 1;
+}
+
+static uint32_t add_string(FlatBuilder *b, const char *text)
+{
+    FlatAst *ast = b->ast;
+    size_t length = strlen(text ? text : "") + 1;
+    if (!reserve(b, (void **)&ast->strings, &b->stringCapacity, (uint64_t)ast->stringBytes + length, 1))
+        return 0;
+    uint32_t at = ast->stringBytes;
+    memcpy(ast->strings + at, text ? text : "", length);
+    ast->stringBytes += (uint32_t)length;
+    return at;
+}
+
+// fields are written through the builder because adding records may move words[]
+static void set_field(FlatBuilder *b, FlatNode n, int field, uint32_t value)
+{
+    if (!b->failed)
+        b->ast->words[n + 1 + field] = value;
+}
+
+// words a record of this kind takes after its header; tag is the type kind
+// of an AST_TYPE
+static int field_words(ASTNodeType kind, int tag)
+{
+    switch (kind)
+    {
+    case AST_NUMBER:
+    case AST_STRING:
+    case AST_IMPORT:
+    case AST_IDENTIFIER:
+    case AST_UNARY_EXPR:
+    case AST_RETURN:
+    case AST_PRINT_STATEMENT:
+    case AST_EXPR_STMT:
+        return 1;
+    case AST_BINARY_EXPR:
+    case AST_PROGRAM:
+    case AST_ARRAY_LITERAL:
+    case AST_WHILE:
+        return 2;
+    case AST_VAR_DECL:
+    case AST_IF:
+    case AST_FUNCTION_CALL:
+        return 3;
+    case AST_FOR:
+        return 4;
+    case AST_FUNCTION:
+        return 5;
+    case AST_TYPE:
+        switch (tag)
+        {
+        case AST_TYPE_ARRAY:
+        case AST_TYPE_STRUCT:
+            return 1;
+        case AST_TYPE_TUPLE:
+            return 2;
+        default:
+            return 0;
+        }
+    default:
+        return 0;
+    }
+}
+
+// Records are laid out in pre-order, so a walk reads words[] front to back.
+// flatten_tree() keeps the subtrees still to lay out on a work stack instead
+// of recursing, so trees of any depth flatten. Each record pushes its
+// children, and the lists it needs, in field order, and the run is then
+// reversed so they pop in that order.
+typedef enum {
+    FLAT_WORK_NODE, // lay out node and store its index in the parent's field
+    FLAT_WORK_LIST, // give parent's list field room for count children
+} FlatWorkKind;
+
+typedef struct {
+    FlatWorkKind kind;
+    const ASTNode *node;
+    ASTNode *const *children; // FLAT_WORK_LIST
+    int count;
+    FlatNode parent; // FLAT_NONE for the root
+    int field;
+    int64_t slot; // FLAT_WORK_NODE in a list: its index in lists[], else -1
+} FlatWork;
+
+typedef struct {
+    FlatWork *items;
+    uint32_t count;
+    uint32_t capacity;
+} FlatWorkStack;
+
+static void push_work(FlatBuilder *b, FlatWorkStack *s, FlatWork work)
+{
+    if (!reserve(b, (void **)&s->items, &s->capacity, (uint64_t)s->count + 1, sizeof(FlatWork)))
+        return;
+    s->items[s->count++] = work;
+}
+
+static void push_child(FlatBuilder *b, FlatWorkStack *s, FlatNode parent, int field, const ASTNode *node)
+{
+    if (node)
+        push_work(b, s, (FlatWork){FLAT_WORK_NODE, node, NULL, 0, parent, field, -1});
+}
+
+static void push_list(FlatBuilder *b, FlatWorkStack *s, FlatNode parent, int field, ASTNode *const *children,
+                      int count)
+{
+    push_work(b, s, (FlatWork){FLAT_WORK_LIST, NULL, children, count, parent, field, -1});
+}
+
+// make the list of a FLAT_WORK_LIST item and push its children
+static void flatten_list(FlatBuilder *b, FlatWorkStack *s, const FlatWork *work)
+{
+    FlatAst *ast = b->ast;
+    if (!reserve(b, (void **)&ast->lists, &b->listCapacity, (uint64_t)ast->listCount + work->count,
+                 sizeof(uint32_t)))
+        return;
+    uint32_t start = ast->listCount;
+    ast->listCount += work->count;
+    memset(ast->lists + start, 0, work->count * sizeof(uint32_t));
+    set_field(b, work->parent, work->field, start);
+    set_field(b, work->parent, work->field + 1, (uint32_t)work->count);
+    for (int i = 0; i < work->count; i++)
+        if (work->children[i])
+            push_work(b, s, (FlatWork){FLAT_WORK_NODE, work->children[i], NULL, 0, work->parent, work->field,
+                                       (int64_t)start + i});
+}
+
+// lay out the record of node and push what goes below it
+static FlatNode flatten_node(FlatBuilder *b, FlatWorkStack *s, const ASTNode *node)
+{
+    int typeKind = node->type == AST_TYPE ? (int)node->data.type.typeKind : 0;
+    FlatNode n = add_words(b, 1 + field_words(node->type, typeKind));
+    if (b->failed)
+        return FLAT_NONE;
+
+    uint32_t tag = 0;
+    switch (node->type)
+    {
+    case AST_NUMBER:
+        tag = (uint32_t)node->data.number.kind;
+        if (node->data.number.kind == TOKEN_FLOAT)
+        {
+            uint32_t bits;
+            memcpy(&bits, &node->data.number.floatValue, sizeof bits);
+            set_field(b, n, FLAT_VALUE, bits);
+        }
+        else
+            set_field(b, n, FLAT_VALUE, (uint32_t)node->data.number.intValue);
+        break;
+    case AST_STRING:
+    case AST_IMPORT:
+        set_field(b, n, FLAT_VALUE, add_string(b, node->data.string));
+        break;
+    case AST_IDENTIFIER:
+        set_field(b, n, FLAT_VALUE, add_atom(b, node->data.identifier));
+        break;
+    case AST_BINARY_EXPR:
+        tag = (uint32_t)node->data.binary.op;
+        push_child(b, s, n, FLAT_LEFT, node->data.binary.left);
+        push_child(b, s, n, FLAT_RIGHT, node->data.binary.right);
+        break;
+    case AST_UNARY_EXPR:
+        tag = (uint32_t)node->data.unary.op;
+        push_child(b, s, n, FLAT_OPERAND, node->data.unary.operand);
+        break;
+    case AST_VAR_DECL:
+        set_field(b, n, FLAT_VAR_NAME, add_atom(b, node->data.varDecl.varName));
+        push_child(b, s, n, FLAT_VAR_TYPE, node->data.varDecl.varType);
+        push_child(b, s, n, FLAT_VAR_INIT, node->data.varDecl.initializer);
+        break;
+    case AST_RETURN:
+        push_child(b, s, n, FLAT_EXPR, node->data.returnStmt.expr);
+        break;
+    case AST_FUNCTION:
+        set_field(b, n, FLAT_FN_NAME, add_atom(b, node->data.function.name));
+        push_list(b, s, n, FLAT_FN_PARAMS, node->data.function.params, node->data.function.paramCount);
+        push_child(b, s, n, FLAT_FN_RETURN, node->data.function.returnType);
+        push_child(b, s, n, FLAT_FN_BODY, node->data.function.body);
+        break;
+    case AST_IF:
+        push_child(b, s, n, FLAT_CONDITION, node->data.ifStmt.condition);
+        push_child(b, s, n, FLAT_THEN, node->data.ifStmt.thenBranch);
+        push_child(b, s, n, FLAT_ELSE, node->data.ifStmt.elseBranch);
+        break;
+    case AST_PROGRAM:
+        push_list(b, s, n, FLAT_STATEMENTS, node->data.program.statements, node->data.program.count);
+        break;
+    case AST_TYPE:
+        tag = (uint32_t)node->data.type.typeKind;
+        if (node->data.type.typeKind == AST_TYPE_ARRAY)
+            push_child(b, s, n, FLAT_ELEMENT, node->data.type.elementType);
+        else if (node->data.type.typeKind == AST_TYPE_TUPLE)
+            push_list(b, s, n, FLAT_ELEMENT, node->data.type.tuple.elementTypes, node->data.type.tuple.elementCount);
+        else if (node->data.type.typeKind == AST_TYPE_STRUCT)
+            set_field(b, n, FLAT_ELEMENT, add_atom(b, node->data.type.structType.name));
+        break;
+    case AST_FUNCTION_CALL:
+        push_child(b, s, n, FLAT_CALLEE, node->data.call.callee);
+        push_list(b, s, n, FLAT_ARGUMENTS, node->data.call.arguments, node->data.call.argCount);
+        break;
+    case AST_PRINT_STATEMENT:
+        push_child(b, s, n, FLAT_EXPR, node->data.printStmt.expr);
+        break;
+    case AST_ARRAY_LITERAL:
+        push_list(b, s, n, FLAT_ELEMENTS, node->data.arrayLiteral.elements, node->data.arrayLiteral.elementCount);
+        break;
+    case AST_WHILE:
+        push_child(b, s, n, FLAT_LOOP_CONDITION, node->data.whileStmt.condition);
+        push_child(b, s, n, FLAT_LOOP_BODY, node->data.whileStmt.body);
+        break;
+    case AST_FOR:
+        push_child(b, s, n, FLAT_FOR_INIT, node->data.forStmt.init);
+        push_child(b, s, n, FLAT_FOR_CONDITION, node->data.forStmt.condition);
+        push_child(b, s, n, FLAT_FOR_INCREMENT, node->data.forStmt.increment);
+        push_child(b, s, n, FLAT_FOR_BODY, node->data.forStmt.body);
+        break;
+    case AST_EXPR_STMT:
+        push_child(b, s, n, FLAT_EXPR, node->data.ExprStmt.expr);
+        break;
+    default:
+        break;
+    }
+    if (!b->failed)
+        b->ast->words[n] = (uint32_t)node->type | tag << 8;
+    return n;
+}
+
+static FlatNode flatten_tree(FlatBuilder *b, const ASTNode *root)
+{
+    if (!root)
+        return FLAT_NONE;
+    FlatWorkStack s = {NULL, 0, 0};
+    FlatNode top = FLAT_NONE;
+    push_child(b, &s, FLAT_NONE, 0, root);
+    while (s.count > 0 && !b->failed)
+    {
+        FlatWork work = s.items[--s.count];
+        uint32_t mark = s.count;
+        if (work.kind == FLAT_WORK_LIST)
+            flatten_list(b, &s, &work);
+        else
+        {
+            FlatNode n = flatten_node(b, &s, work.node);
+            if (b->failed)
+                break;
+            if (work.slot >= 0)
+                b->ast->lists[work.slot] = n;
+            else if (work.parent != FLAT_NONE)
+                set_field(b, work.parent, work.field, n);
+            else
+                top = n;
+        }
+        for (uint32_t i = mark, j = s.count; i + 1 < j; i++, j--)
+        {
+            FlatWork swap = s.items[i];
+            s.items[i] = s.items[j - 1];
+            s.items[j - 1] = swap;
+        }
+    }
+    free(s.items);
+    return top;
+}
+
+int flatten_ast(const ASTNode *root, FlatAst *out)
+{
+    memset(out, 0, sizeof *out);
+    FlatBuilder b;
+    memset(&b, 0, sizeof b);
+    b.ast = out;
+    add_words(&b, 1); // index 0 stays "no node"
+    out->root = flatten_tree(&b, root);
+    free(b.atomSlots);
+    if (b.failed)
+    {
+        free_flat_ast(out);
+        return -1;
+    }
+    return 0;
+}
+
+void free_flat_ast(FlatAst *ast)
+{
+    free(ast->words);
+    free(ast->lists);
+    free(ast->atoms);
+    free(ast->strings);
+    memset(ast, 0, sizeof *ast);
+}
+
+// -------------------------
+// Printing
+// -------------------------
+
+// print_flat_ast() keeps the lines still to print on a stack of its own, like
+// printAST(): each record pushes its child lines in order and the run is then
+// reversed, so they pop in order.
+typedef struct {
+    FlatNode node;     // FLAT_NONE for a label line
+    const char *label; // a format taking number
+    int number;
+    int indent;
+} FlatPrintStep;
+
+typedef struct {
+    FlatPrintStep *steps;
+    int count;
+    int capacity;
+    int failed;
+} FlatPrintStack;
+
+static void push_print(FlatPrintStack *s, FlatNode node, const char *label, int number, int indent)
+{
+    if (s->count == s->capacity)
+    {
+        int capacity = s->capacity ? s->capacity * 2 : 64;
+        FlatPrintStep *steps = realloc(s->steps, capacity * sizeof(FlatPrintStep));
+        if (!steps)
+        {
+            s->failed = 1;
+            return;
+        }
+        s->steps = steps;
+        s->capacity = capacity;
+    }
+    s->steps[s->count++] = (FlatPrintStep){node, label, number, indent};
+}
+
+static void push_print_node(FlatPrintStack *s, FlatNode node, int indent)
+{
+    if (node != FLAT_NONE)
+        push_print(s, node, NULL, 0, indent);
+}
+
+static void push_print_label(FlatPrintStack *s, const char *label, int number, int indent)
+{
+    push_print(s, FLAT_NONE, label, number, indent);
+}
+
+static void print_indent(int indent)
+{
+    for (int i = 0; i < indent; i++)
+        printf("  ");
+}
+
+// print the line of record n and push the lines below it
+static void print_flat_node(FlatPrintStack *s, const FlatAst *ast, FlatNode n, int indent)
+{
+    print_indent(indent);
+    const FlatNode *list;
+    int count;
+    switch (flat_kind(ast, n))
+    {
+    case AST_PRINT_STATEMENT:
+        printf("PrintStmt:\n");
+        if (flat_child(ast, n, FLAT_EXPR) == FLAT_NONE)
+            push_print_label(s, "<empty expr>", 0, indent + 1);
+        else
+            push_print_node(s, flat_child(ast, n, FLAT_EXPR), indent + 1);
+        break;
+
+    case AST_NUMBER:
+        if (flat_tag(ast, n) == TOKEN_FLOAT)
+            printf("Number: %g\n", flat_float(ast, n));
+        else
+            printf("Number: %d\n", flat_int(ast, n));
+        break;
+
+    case AST_STRING:
+        printf("String: \"%s\"\n", flat_string(ast, n));
+        break;
+
+    case AST_IMPORT:
+        printf("Import: \"%s\"\n", flat_string(ast, n));
+        break;
+
+    case AST_IDENTIFIER:
+        printf("Identifier: %s\n", flat_name(ast, n, FLAT_VALUE));
+        break;
+
+    case AST_BINARY_EXPR:
+        printf("BinaryOp: %s\n", opSpelling((OpCode)flat_tag(ast, n)));
+        push_print_node(s, flat_child(ast, n, FLAT_LEFT), indent + 1);
+        push_print_node(s, flat_child(ast, n, FLAT_RIGHT), indent + 1);
+        break;
+
+    case AST_VAR_DECL:
+        printf("VarDecl: %s\n", flat_name(ast, n, FLAT_VAR_NAME));
+        if (flat_child(ast, n, FLAT_VAR_TYPE))
+        {
+            push_print_label(s, "TypeAnnotation:", 0, indent + 1);
+            push_print_node(s, flat_child(ast, n, FLAT_VAR_TYPE), indent + 2);
+        }
+        if (flat_child(ast, n, FLAT_VAR_INIT))
+        {
+            push_print_label(s, "Initializer:", 0, indent + 1);
+            push_print_node(s, flat_child(ast, n, FLAT_VAR_INIT), indent + 2);
+        }
+        break;
+
+    case AST_RETURN:
+        printf("Return:\n");
+        push_print_node(s, flat_child(ast, n, FLAT_EXPR), indent + 1);
+        break;
+
+    case AST_FUNCTION:
+        printf("Function: %s\n", flat_name(ast, n, FLAT_FN_NAME));
+        list = flat_list(ast, n, FLAT_FN_PARAMS, &count);
+        for (int i = 0; i < count; i++)
+        {
+            push_print_label(s, "Param %d:", i, indent + 1);
+            push_print_node(s, list[i], indent + 2);
+        }
+        if (flat_child(ast, n, FLAT_FN_RETURN))
+        {
+            push_print_label(s, "ReturnType:", 0, indent + 1);
+            push_print_node(s, flat_child(ast, n, FLAT_FN_RETURN), indent + 2);
+        }
+        push_print_node(s, flat_child(ast, n, FLAT_FN_BODY), indent + 1);
+        break;
+
+    case AST_FUNCTION_CALL:
+        printf("FunctionCall:\n");
+        push_print_label(s, "Callee:", 0, indent + 1);
+        push_print_node(s, flat_child(ast, n, FLAT_CALLEE), indent + 2);
+        list = flat_list(ast, n, FLAT_ARGUMENTS, &count);
+        for (int i = 0; i < count; i++)
+        {
+            push_print_label(s, "Arg %d:", i, indent + 1);
+            push_print_node(s, list[i], indent + 2);
+        }
+        break;
+
+    case AST_PROGRAM:
+        list = flat_list(ast, n, FLAT_STATEMENTS, &count);
+        printf("Program (%d stmts):\n", count);
+        for (int i = 0; i < count; i++)
+            push_print_node(s, list[i], indent + 1);
+        break;
+
+    case AST_EXPR_STMT:
+        printf("ExprStmt:\n");
+        push_print_node(s, flat_child(ast, n, FLAT_EXPR), indent + 2);
+        break;
+
+    case AST_IF:
+        printf("IfStmt:\n");
+        push_print_label(s, "Condition:", 0, indent + 1);
+        push_print_node(s, flat_child(ast, n, FLAT_CONDITION), indent + 2);
+        push_print_label(s, "Then:", 0, indent + 1);
+        push_print_node(s, flat_child(ast, n, FLAT_THEN), indent + 2);
+        if (flat_child(ast, n, FLAT_ELSE))
+        {
+            push_print_label(s, "Else:", 0, indent + 1);
+            push_print_node(s, flat_child(ast, n, FLAT_ELSE), indent + 2);
+        }
+        break;
+
+    case AST_WHILE:
+        printf("WhileStmt:\n");
+        push_print_label(s, "Condition:", 0, indent + 1);
+        push_print_node(s, flat_child(ast, n, FLAT_LOOP_CONDITION), indent + 2);
+        push_print_label(s, "Body:", 0, indent + 1);
+        push_print_node(s, flat_child(ast, n, FLAT_LOOP_BODY), indent + 2);
+        break;
+
+    case AST_FOR:
+        printf("ForStmt:\n");
+        push_print_label(s, "Init:", 0, indent + 1);
+        push_print_node(s, flat_child(ast, n, FLAT_FOR_INIT), indent + 2);
+        push_print_label(s, "Condition:", 0, indent + 1);
+        push_print_node(s, flat_child(ast, n, FLAT_FOR_CONDITION), indent + 2);
+        push_print_label(s, "Increment:", 0, indent + 1);
+        push_print_node(s, flat_child(ast, n, FLAT_FOR_INCREMENT), indent + 2);
+        push_print_label(s, "Body:", 0, indent + 1);
+        push_print_node(s, flat_child(ast, n, FLAT_FOR_BODY), indent + 2);
+        break;
+
+    case AST_ARRAY_LITERAL:
+        list = flat_list(ast, n, FLAT_ELEMENTS, &count);
+        printf("ArrayLiteral (%d elements):\n", count);
+        for (int i = 0; i < count; i++)
+        {
+            push_print_label(s, "Element %d:", i, indent + 1);
+            push_print_node(s, list[i], indent + 2);
+        }
+        break;
+
+    case AST_TYPE:
+        printf("Type: ");
+        switch (flat_tag(ast, n))
+        {
+        case AST_TYPE_INT:
+            printf("int\n");
+            break;
+        case AST_TYPE_FLOAT:
+            printf("float\n");
+            break;
+        case AST_TYPE_BOOL:
+            printf("bool\n");
+            break;
+        case AST_TYPE_STRING:
+            printf("string\n");
+            break;
+        case AST_TYPE_VOID:
+            printf("void\n");
+            break;
+        case AST_TYPE_ARRAY:
+            printf("array of:\n");
+            push_print_node(s, flat_child(ast, n, FLAT_ELEMENT), indent + 1);
+            break;
+        case AST_TYPE_STRUCT:
+            printf("struct %s\n", flat_name(ast, n, FLAT_ELEMENT));
+            break;
+        default:
+            printf("Unknown typeKind: %d\n", flat_tag(ast, n));
+            break;
+        }
+        break;
+
+    default:
+        printf("Unknown node type: %d\n", flat_kind(ast, n));
+        break;
+    }
+}
+
+void print_flat_ast(const FlatAst *ast, FlatNode n, int indent)
+{
+    FlatPrintStack s = {NULL, 0, 0, 0};
+    push_print_node(&s, n, indent);
+    while (s.count > 0 && !s.failed)
+    {
+        FlatPrintStep step = s.steps[--s.count];
+        if (step.node == FLAT_NONE)
+        {
+            print_indent(step.indent);
+            printf(step.label, step.number);
+            printf("\n");
+            continue;
+        }
+        int mark = s.count;
+        print_flat_node(&s, ast, step.node, step.indent);
+        for (int i = mark, j = s.count - 1; i < j; i++, j--)
+        {
+            FlatPrintStep swap = s.steps[i];
+            s.steps[i] = s.steps[j];
+            s.steps[j] = swap;
+        }
+    }
+    if (s.failed)
+        fprintf(stderr, "print_flat_ast: out of memory\n");
+    free(s.steps);
+}
+
+// -------------------------
+// Expanding
+// -------------------------
+
+// what lazily expanded function bodies come from; lives in the arena
+typedef struct {
+    const FlatAst *ast;
+    Arena *arena;
+} FlatSource;
+
+// a record still to expand, and the field its node goes in
+typedef struct {
+    FlatNode node;
+    ASTNode **to;
+} ExpandStep;
+
+// expand_tree() keeps the records still to expand on a stack instead of
+// recursing, so trees of any depth expand; like flatten_tree(), each node
+// pushes its children in field order and the run is reversed.
+// Images come from files, so every index is checked against its array as it
+// is read, rather than in a pass of its own before expanding.
+typedef struct {
+    const FlatAst *ast;
+    Arena *arena;
+    int failed; // 0, ENOMEM, or ENOEXEC for a damaged tree
+    FlatSource *lazySource; // NULL to expand function bodies right away
+    ExpandStep *steps;
+    int stepCount;
+    int stepCapacity;
+} Expander;
+
+static ASTNode *expand_tree(Expander *e, FlatNode parent, FlatNode n);
+
+static ASTNode *build_flat_body(LazyBody *lazy)
+{
+    FlatSource *source = lazy->context;
+    Expander e = {source->ast, source->arena, 0, source, NULL, 0, 0};
+    ASTNode *body = expand_tree(&e, FLAT_NONE, (FlatNode)lazy->start);
+    return e.failed ? NULL : body;
+}
+
+static void out_of_memory(Expander *e)
+{
+    e->failed = ENOMEM;
+}
+
+static void damaged(Expander *e)
+{
+    e->failed = ENOEXEC;
+}
+
+// records are laid out in pre-order, so a child comes after its parent; that
+// also keeps a damaged tree from looping back on itself
+static int valid_child(const Expander *e, FlatNode parent, FlatNode n)
+{
+    return n > parent && n < e->ast->wordCount;
+}
+
+// record n, a child of parent, is expanded later into *to, which stays NULL
+// until then
+static void push_expand(Expander *e, FlatNode parent, FlatNode n, ASTNode **to)
+{
+    *to = NULL;
+    if (n == FLAT_NONE || e->failed)
+        return;
+    if (!valid_child(e, parent, n))
+    {
+        damaged(e);
+        return;
+    }
+    if (e->stepCount == e->stepCapacity)
+    {
+        int capacity = e->stepCapacity ? e->stepCapacity * 2 : 64;
+        ExpandStep *steps = realloc(e->steps, capacity * sizeof(ExpandStep));
+        if (!steps)
+        {
+            out_of_memory(e);
+            return;
+        }
+        e->steps = steps;
+        e->stepCapacity = capacity;
+    }
+    e->steps[e->stepCount++] = (ExpandStep){n, to};
+}
+
+static ASTNode **expand_list(Expander *e, FlatNode n, int field, int *count)
+{
+    *count = 0;
+    uint32_t start = flat_child(e->ast, n, field);
+    uint32_t length = flat_child(e->ast, n, field + 1);
+    if ((uint64_t)start + length > e->ast->listCount)
+    {
+        damaged(e);
+        return NULL;
+    }
+    const FlatNode *list = flat_list(e->ast, n, field, count);
+    if (*count == 0)
+        return NULL;
+    ASTNode **children = arena_alloc(e->arena, *count * sizeof(ASTNode *));
+    if (!children)
+    {
+        out_of_memory(e);
+        return NULL;
+    }
+    for (int i = 0; i < *count; i++)
+        push_expand(e, n, list[i], &children[i]);
+    return children;
+}
+
+static Atom expand_name(Expander *e, FlatNode n, int field)
+{
+    if (flat_child(e->ast, n, field) >= e->ast->atomCount)
+    {
+        damaged(e);
+        return NULL;
+    }
+    return flat_name(e->ast, n, field);
+}
+
+// strings[] ends in a NUL, so any offset inside it starts a terminated string
+static char *expand_string(Expander *e, FlatNode n)
+{
+    if (flat_child(e->ast, n, FLAT_VALUE) >= e->ast->stringBytes)
+    {
+        damaged(e);
+        return NULL;
+    }
+    return (char *)flat_string(e->ast, n);
+}
+
+// is the header of record n one flatten_ast() could have written, and do its
+// fields fit in words[]?
+static int valid_record(const FlatAst *ast, FlatNode n)
+{
+    ASTNodeType kind = flat_kind(ast, n);
+    int tag = flat_tag(ast, n);
+    switch (kind)
+    {
+    case AST_NUMBER:
+        if (tag != TOKEN_INT && tag != TOKEN_FLOAT)
+            return 0;
+        break;
+    case AST_BINARY_EXPR:
+    case AST_UNARY_EXPR:
+        if (tag >= OP_COUNT)
+            return 0;
+        break;
+    case AST_TYPE:
+        if (tag < AST_TYPE_INT || tag > AST_TYPE_STRUCT)
+            return 0;
+        break;
+    default:
+        if (kind > AST_IMPORT)
+            return 0;
+        break;
+    }
+    return (uint64_t)n + 1 + field_words(kind, tag) <= ast->wordCount;
+}
+
+// the node of record n, its children pushed to be expanded
+static ASTNode *expand_node(Expander *e, FlatNode n)
+{
+    const FlatAst *ast = e->ast;
+    if (!valid_record(ast, n))
+    {
+        damaged(e);
+        return NULL;
+    }
+    ASTNode *node = arena_alloc(e->arena, sizeof(ASTNode));
+    if (!node)
+    {
+        out_of_memory(e);
+        return NULL;
+    }
+    node->type = flat_kind(ast, n);
+    memset(&node->data, 0, sizeof(node->data));
+    switch (node->type)
+    {
+    case AST_NUMBER:
+        node->data.number.kind = (TokenType)flat_tag(ast, n);
+        if (node->data.number.kind == TOKEN_FLOAT)
+            node->data.number.floatValue = flat_float(ast, n);
+        else
+            node->data.number.intValue = flat_int(ast, n);
+        break;
+    case AST_STRING:
+    case AST_IMPORT:
+        node->data.string = expand_string(e, n);
+        break;
+    case AST_IDENTIFIER:
+        node->data.identifier = expand_name(e, n, FLAT_VALUE);
+        break;
+    case AST_BINARY_EXPR:
+        node->data.binary.op = (OpCode)flat_tag(ast, n);
+        push_expand(e, n, flat_child(ast, n, FLAT_LEFT), &node->data.binary.left);
+        push_expand(e, n, flat_child(ast, n, FLAT_RIGHT), &node->data.binary.right);
+        break;
+    case AST_UNARY_EXPR:
+        node->data.unary.op = (OpCode)flat_tag(ast, n);
+        push_expand(e, n, flat_child(ast, n, FLAT_OPERAND), &node->data.unary.operand);
+        break;
+    case AST_VAR_DECL:
+        node->data.varDecl.varName = expand_name(e, n, FLAT_VAR_NAME);
+        push_expand(e, n, flat_child(ast, n, FLAT_VAR_TYPE), &node->data.varDecl.varType);
+        push_expand(e, n, flat_child(ast, n, FLAT_VAR_INIT), &node->data.varDecl.initializer);
+        break;
+    case AST_RETURN:
+        push_expand(e, n, flat_child(ast, n, FLAT_EXPR), &node->data.returnStmt.expr);
+        break;
+    case AST_FUNCTION:
+        node->data.function.name = expand_name(e, n, FLAT_FN_NAME);
+        node->data.function.params = expand_list(e, n, FLAT_FN_PARAMS, &node->data.function.paramCount);
+        push_expand(e, n, flat_child(ast, n, FLAT_FN_RETURN), &node->data.function.returnType);
+        if (e->lazySource && flat_child(ast, n, FLAT_FN_BODY) != FLAT_NONE)
+        {
+            if (!valid_child(e, n, flat_child(ast, n, FLAT_FN_BODY)))
+            {
+                damaged(e);
+                break;
+            }
+            LazyBody *lazy = arena_alloc(e->arena, sizeof(LazyBody));
+            if (!lazy)
+            {
+                out_of_memory(e);
+                break;
+            }
+            lazy->build = build_flat_body;
+            lazy->context = e->lazySource;
+            lazy->start = (int)flat_child(ast, n, FLAT_FN_BODY);
+            node->data.function.lazyBody = lazy;
+        }
+        else
+        {
+            push_expand(e, n, flat_child(ast, n, FLAT_FN_BODY), &node->data.function.body);
+        }
+        break;
+    case AST_IF:
+        push_expand(e, n, flat_child(ast, n, FLAT_CONDITION), &node->data.ifStmt.condition);
+        push_expand(e, n, flat_child(ast, n, FLAT_THEN), &node->data.ifStmt.thenBranch);
+        push_expand(e, n, flat_child(ast, n, FLAT_ELSE), &node->data.ifStmt.elseBranch);
+        break;
+    case AST_PROGRAM:
+        node->data.program.statements = expand_list(e, n, FLAT_STATEMENTS, &node->data.program.count);
+        break;
+    case AST_TYPE:
+        node->data.type.typeKind = (ASTNodeType)flat_tag(ast, n);
+        if (node->data.type.typeKind == AST_TYPE_ARRAY)
+            push_expand(e, n, flat_child(ast, n, FLAT_ELEMENT), &node->data.type.elementType);
+        else if (node->data.type.typeKind == AST_TYPE_TUPLE)
+            node->data.type.tuple.elementTypes =
+                expand_list(e, n, FLAT_ELEMENT, &node->data.type.tuple.elementCount);
+        else if (node->data.type.typeKind == AST_TYPE_STRUCT)
+            node->data.type.structType.name = expand_name(e, n, FLAT_ELEMENT);
+        break;
+    case AST_FUNCTION_CALL:
+        push_expand(e, n, flat_child(ast, n, FLAT_CALLEE), &node->data.call.callee);
+        node->data.call.arguments = expand_list(e, n, FLAT_ARGUMENTS, &node->data.call.argCount);
+        break;
+    case AST_PRINT_STATEMENT:
+        push_expand(e, n, flat_child(ast, n, FLAT_EXPR), &node->data.printStmt.expr);
+        break;
+    case AST_ARRAY_LITERAL:
+        node->data.arrayLiteral.elements =
+            expand_list(e, n, FLAT_ELEMENTS, &node->data.arrayLiteral.elementCount);
+        break;
+    case AST_WHILE:
+        push_expand(e, n, flat_child(ast, n, FLAT_LOOP_CONDITION), &node->data.whileStmt.condition);
+        push_expand(e, n, flat_child(ast, n, FLAT_LOOP_BODY), &node->data.whileStmt.body);
+        break;
+    case AST_FOR:
+        push_expand(e, n, flat_child(ast, n, FLAT_FOR_INIT), &node->data.forStmt.init);
+        push_expand(e, n, flat_child(ast, n, FLAT_FOR_CONDITION), &node->data.forStmt.condition);
+        push_expand(e, n, flat_child(ast, n, FLAT_FOR_INCREMENT), &node->data.forStmt.increment);
+        push_expand(e, n, flat_child(ast, n, FLAT_FOR_BODY), &node->data.forStmt.body);
+        break;
+    case AST_EXPR_STMT:
+        push_expand(e, n, flat_child(ast, n, FLAT_EXPR), &node->data.ExprStmt.expr);
+        break;
+    default:
+        break;
+    }
+    return node;
+}
+
+// parent is FLAT_NONE for a root; a lazy body was checked against its
+// function when it was put off
+static ASTNode *expand_tree(Expander *e, FlatNode parent, FlatNode n)
+{
+    ASTNode *root;
+    push_expand(e, parent, n, &root);
+    while (e->stepCount > 0 && !e->failed)
+    {
+        ExpandStep step = e->steps[--e->stepCount];
+        int mark = e->stepCount;
+        *step.to = expand_node(e, step.node);
+        for (int i = mark, j = e->stepCount - 1; i < j; i++, j--)
+        {
+            ExpandStep swap = e->steps[i];
+            e->steps[i] = e->steps[j];
+            e->steps[j] = swap;
+        }
+    }
+    free(e->steps);
+    e->steps = NULL;
+    e->stepCount = e->stepCapacity = 0;
+    return root;
+}
+
+ASTNode *expand_flat_ast(const FlatAst *ast, Arena *arena)
+{
+    Expander e = {ast, arena, 0, NULL, NULL, 0, 0};
+    ASTNode *root = expand_tree(&e, FLAT_NONE, ast->root);
+    if (e.failed)
+        errno = e.failed;
+    return e.failed ? NULL : root;
+}
+
+ASTNode *expand_flat_ast_lazily(const FlatAst *ast, Arena *arena)
+{
+    FlatSource *source = arena_alloc(arena, sizeof(FlatSource));
+    if (!source)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    source->ast = ast;
+    source->arena = arena;
+    Expander e = {ast, arena, 0, source, NULL, 0, 0};
+    ASTNode *root = expand_tree(&e, FLAT_NONE, ast->root);
+    if (e.failed)
+        errno = e.failed;
+    return e.failed ? NULL : root;
+}
@@ -0,0 +1,127 @@
+#ifndef FLATAST_H
+#define FLATAST_H
+
+#include "arena.h"
+#include "parser.h"
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Compact AST. Every node is a variable-length record in one array of 32-bit
+ * words, named by the index of its first word; index 0 means "no node".
+ * A record is a header word (the ASTNodeType in the low 8 bits, the tag
+ * above it) followed by only the fields its kind needs:
+ *
+ *   kind                tag           fields
+ *   AST_NUMBER          TOKEN_INT/FLOAT  value (int, or float bits)
+ *   AST_STRING                        string offset
+ *   AST_IDENTIFIER                    name
+ *   AST_BINARY_EXPR     OpCode        left, right
+ *   AST_UNARY_EXPR      OpCode        operand
+ *   AST_VAR_DECL                      name, type, initializer
+ *   AST_RETURN                        expr
+ *   AST_FUNCTION                      name, params (list), return type, body
+ *   AST_IF                            condition, then, else
+ *   AST_PROGRAM                       statements (list)
+ *   AST_TYPE            type kind     array: element; tuple: elements (list);
+ *                                     struct: name; otherwise none
+ *   AST_FUNCTION_CALL                 callee, arguments (list)
+ *   AST_PRINT_STATEMENT               expr
+ *   AST_ARRAY_LITERAL                 elements (list)
+ *   AST_WHILE                         condition, body
+ *   AST_FOR                           init, condition, increment, body
+ *   AST_EXPR_STMT                     expr
+ *   AST_IMPORT                        string offset of the path
+ *
+ * A list field takes two words, its start in lists[] and its length. Names
+ * index atoms[], strings are offsets into strings[]. Nothing else refers to
+ * memory, so the arrays can be written out and mapped back as they are.
+ */
+
+typedef uint32_t FlatNode;
+#define FLAT_NONE 0
+
+// field positions, counted in words after the header
+enum {
+    FLAT_VALUE = 0,                                      // AST_NUMBER, AST_STRING, AST_IDENTIFIER, AST_IMPORT
+    FLAT_LEFT = 0, FLAT_RIGHT = 1,                       // AST_BINARY_EXPR
+    FLAT_OPERAND = 0,                                    // AST_UNARY_EXPR
+    FLAT_EXPR = 0,                                       // AST_RETURN, AST_PRINT_STATEMENT, AST_EXPR_STMT
+    FLAT_VAR_NAME = 0, FLAT_VAR_TYPE = 1, FLAT_VAR_INIT = 2,
+    FLAT_FN_NAME = 0, FLAT_FN_PARAMS = 1, FLAT_FN_RETURN = 3, FLAT_FN_BODY = 4,
+    FLAT_CONDITION = 0, FLAT_THEN = 1, FLAT_ELSE = 2,    // AST_IF
+    FLAT_STATEMENTS = 0,                                 // AST_PROGRAM
+    FLAT_ELEMENT = 0,                                    // AST_TYPE: element, elements or name
+    FLAT_CALLEE = 0, FLAT_ARGUMENTS = 1,                 // AST_FUNCTION_CALL
+    FLAT_ELEMENTS = 0,                                   // AST_ARRAY_LITERAL
+    FLAT_LOOP_CONDITION = 0, FLAT_LOOP_BODY = 1,         // AST_WHILE
+    FLAT_FOR_INIT = 0, FLAT_FOR_CONDITION = 1, FLAT_FOR_INCREMENT = 2, FLAT_FOR_BODY = 3,
+};
+
+typedef struct {
+    uint32_t *words; // node records; words[0] is unused so that 0 is no node
+    uint32_t wordCount;
+    uint32_t *lists; // node indices of every child list, each list contiguous
+    uint32_t listCount;
+    Atom *atoms;     // distinct names, in order of first use
+    uint32_t atomCount;
+    char *strings;   // NUL-terminated string literals back to back
+    uint32_t stringBytes;
+    FlatNode root;
+} FlatAst;
+
+// build the compact form of a parsed tree; 0 on success, -1 when out of memory.
+// Function bodies left lazy by the parser must have been built first.
+int flatten_ast(const ASTNode *root, FlatAst *out);
+void free_flat_ast(FlatAst *ast);
+// same output as printAST() on the tree it was flattened from
+void print_flat_ast(const FlatAst *ast, FlatNode node, int indent);
+// rebuild an ASTNode tree in arena for passes written against ASTNode.
+// Strings point into ast, which must outlive the tree. Every index is checked
+// against its array as it is read, so ast may come from a file: NULL with
+// errno ENOEXEC when a record is malformed, ENOMEM when out of memory.
+ASTNode *expand_flat_ast(const FlatAst *ast, Arena *arena);
+// the same, except that function bodies are left to functionBody(), which
+// expands each on first use and returns NULL if that fails; ast and arena
+// must outlive the tree
+ASTNode *expand_flat_ast_lazily(const FlatAst *ast, Arena *arena);
+
+static inline ASTNodeType flat_kind(const FlatAst *ast, FlatNode n)
+{
+    return (ASTNodeType)(ast->words[n] & 0xff);
+}
+// operator, number kind or type kind, per the table above
+static inline int flat_tag(const FlatAst *ast, FlatNode n)
+{
+    return (int)(ast->words[n] >> 8);
+}
+static inline FlatNode flat_child(const FlatAst *ast, FlatNode n, int field)
+{
+    return ast->words[n + 1 + field];
+}
+static inline Atom flat_name(const FlatAst *ast, FlatNode n, int field)
+{
+    return ast->atoms[ast->words[n + 1 + field]];
+}
+static inline int flat_int(const FlatAst *ast, FlatNode n)
+{
+    return (int)ast->words[n + 1];
+}
+static inline float flat_float(const FlatAst *ast, FlatNode n)
+{
+    float f;
+    memcpy(&f, &ast->words[n + 1], sizeof f);
+    return f;
+}
+static inline const char *flat_string(const FlatAst *ast, FlatNode n)
+{
+    return ast->strings + ast->words[n + 1];
+}
+// children of a list field; their number goes to *count
+static inline const FlatNode *flat_list(const FlatAst *ast, FlatNode n, int field, int *count)
+{
+    *count = (int)ast->words[n + 2 + field];
+    return ast->lists + ast->words[n + 1 + field];
+}
+
+#endif // FLATAST_H
@@ -0,0 +1,171 @@
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#define yield_cpu() sched_yield()
+#else
+#define yield_cpu() ((void)0)
+#endif
+
+// -------------------------
+// Sharded hash table
+// -------------------------
+
+#define INTERN_SHARDS 16
+#define INTERN_CHUNK (64 * 1024)
+#define INTERN_CACHE 1024
+
+typedef struct {
+    Atom *slots;       // open addressing, NULL marks an empty slot
+    unsigned *hashes;  // full hash of each slot, checked before comparing text
+    size_t capacity;   // power of two
+    size_t count;
+    char *chunk;       // atom text is bump-allocated from chunks
+    size_t chunkUsed;
+    size_t chunkSize;
+    char lock;
+} InternShard;
+
+static InternShard shards[INTERN_SHARDS];
+
+// Per-thread direct-mapped cache of recent atoms. Names repeat a lot within
+// a script, so most lookups are answered here without touching a shard lock.
+typedef struct {
+    unsigned hash;
+    Atom atom;
+} InternCacheEntry;
+
+static __thread InternCacheEntry cache[INTERN_CACHE];
+
+// FNV-1a; the top bits pick the shard, the low bits the slot
+static unsigned hash_text(const char *text, size_t length)
+{
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        h = (h ^ (unsigned char)text[i]) * 16777619u;
+    return h;
+}
+
+static void lock_shard(InternShard *s)
+{
+    // yield rather than spin, so a preempted holder can finish
+    while (__atomic_test_and_set(&s->lock, __ATOMIC_ACQUIRE))
+        yield_cpu();
+}
+
+static void unlock_shard(InternShard *s)
+{
+    __atomic_clear(&s->lock, __ATOMIC_RELEASE);
+}
+
+// copy the text of a new atom, NUL-terminated, into the shard's current
+// chunk, or a block of its own when it is too long for one; NULL when out
+// of memory
+static char *store_text(InternShard *s, const char *text, size_t length)
+{
+    char *copy;
+    if (length + 1 > INTERN_CHUNK)
+    {
+        copy = malloc(length + 1);
+        if (!copy)
+            return NULL;
+    }
+    else
+    {
+        if (!s->chunk || s->chunkUsed + length + 1 > s->chunkSize)
+        {
+            // the old chunk stays reachable through the atoms stored in it
+            s->chunk = malloc(INTERN_CHUNK);
+            if (!s->chunk)
+                return NULL;
+            s->chunkUsed = 0;
+            s->chunkSize = INTERN_CHUNK;
+        }
+        copy = s->chunk + s->chunkUsed;
+        s->chunkUsed += length + 1;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static int same_text(Atom atom, const char *text, size_t length)
+{
+    return strncmp(atom, text, length) == 0 && atom[length] == '\0';
+}
+
+static int grow_shard(InternShard *s)
+{
+    size_t capacity = s->capacity ? s->capacity * 2 : 256;
+    Atom *slots = calloc(capacity, sizeof(Atom));
+    unsigned *hashes = malloc(capacity * sizeof(unsigned));
+    if (!slots || !hashes)
+    {
+        free(slots);
+        free(hashes);
+        return -1;
+    }
+    for (size_t i = 0; i < s->capacity; i++)
+    {
+        if (!s->slots[i])
+            continue;
+        size_t j = s->hashes[i] & (capacity - 1);
+        while (slots[j])
+            j = (j + 1) & (capacity - 1);
+        slots[j] = s->slots[i];
+        hashes[j] = s->hashes[i];
+    }
+    free(s->slots);
+    free(s->hashes);
+    s->slots = slots;
+    s->hashes = hashes;
+    s->capacity = capacity;
+    return 0;
+}
+
+Atom intern(const char *text, size_t length)
+{
+    unsigned h = hash_text(text, length);
+    InternCacheEntry *cached = &cache[h & (INTERN_CACHE - 1)];
+    if (cached->atom && cached->hash == h && same_text(cached->atom, text, length))
+        return cached->atom;
+
+    InternShard *s = &shards[h >> 28];
+    Atom atom = NULL;
+
+    lock_shard(s);
+    // keep the load factor under 1/2
+    if ((s->count + 1) * 2 > s->capacity && grow_shard(s) != 0)
+        goto done;
+    size_t i = h & (s->capacity - 1);
+    while (s->slots[i])
+    {
+        if (s->hashes[i] == h && same_text(s->slots[i], text, length))
+        {
+            atom = s->slots[i];
+            goto done;
+        }
+        i = (i + 1) & (s->capacity - 1);
+    }
+    char *copy = store_text(s, text, length);
+    if (!copy)
+        goto done;
+    s->slots[i] = copy;
+    s->hashes[i] = h;
+    s->count++;
+    atom = copy;
+done:
+    unlock_shard(s);
+    if (atom)
+    {
+        cached->hash = h;
+        cached->atom = atom;
+    }
+    return atom;
+}
+
+Atom intern_cstr(const char *text)
+{
+    return intern(text, strlen(text));
+}
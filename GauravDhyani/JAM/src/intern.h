@@ -0,0 +1,23 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+/*
+ * Identifier interning. Every distinct name is stored once; the returned
+ * pointer ("atom") is the canonical NUL-terminated copy of that text, so two
+ * names are equal exactly when their atoms are the same pointer.
+ *
+ * Atoms are never freed and stay valid until the process exits. The table
+ * is split into independently locked shards, so sources lexed on different
+ * threads can intern at the same time.
+ */
+
+typedef const char *Atom;
+
+// atom for text[0..length); NULL only when out of memory
+Atom intern(const char *text, size_t length);
+// atom for a NUL-terminated string
+Atom intern_cstr(const char *text);
+
+#endif // INTERN_H
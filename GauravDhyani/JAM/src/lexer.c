@@ -1,418 +1,1318 @@
 #include "./lexer.h"
+#include "./lexscan.h"
+#include "./sourceloader.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <pthread.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#include <unistd.h>
+#define yield_cpu() sched_yield()
+#else
+#define yield_cpu() ((void)0)
+#include <io.h>
+#define read _read
+#endif
 /*
   Name:Jai Yadav
 
 */
-typedef struct
+static Token create_token(TokenType, int, int, int, int);
+static Token identifier(JamLexer *);
+static Token number(JamLexer *);
+static void skip_comments(JamLexer *);
+static Token string_lit(JamLexer *);
+static void skip_whitespaces(JamLexer *);
+static void advance(JamLexer *);
+static void advance_by(JamLexer *, int);
+static char curr_char(JamLexer *);
+static char next(JamLexer *);
+// initialize a JAM lexer context over a buffer of known length
+// source[length] must be '\0'; a loaded SourceBuffer also pads beyond it
+void jam_lexer_init(JamLexer *lx, const char *source, size_t length)
 {
-    char *source;
-    int line, pos, col;
-} Lexer;
-
-static Lexer lexer;
-Token *get_next_token();
-Token *create_token(TokenType, char *, int, int);
-Token *identifier();
-Token *number();
-Token *string();
-void skip_comments();
-void init_lexer(const char *source);
-Token *string_lit();
-void skip_whitespaces();
-void advance();
-char curr_char();
-char next();
-void initlexer(char *);
-// initialize JAM lexer
-void initlexer(char *src)
+    lx->source = source;
+    lx->length = (int)length;
+    lx->line = 1;
+    lx->pos = 0;
+    lx->col = 1;
+    lx->quiet = 0;
+    lx->errors = 0;
+    lx->errorPos = -1;
+}
+// report a lexical error found at source offset at; a quiet lexer only counts it
+static void lex_error(JamLexer *lx, int at, const char *format, ...)
 {
-    lexer.source = src;
-    lexer.line = 1;
-    lexer.pos = 0;
-    lexer.col = 1;
+    lx->errors++;
+    lx->errorPos = at;
+    if (lx->quiet)
+        return;
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
 }
 // returns current character
-char curr_char()
+static char curr_char(JamLexer *lx)
 {
-    return lexer.source[lexer.pos];
+    return lx->source[lx->pos];
 }
 // advance's pointer over tokens
-void advance()
+static void advance(JamLexer *lx)
+{
+    if (curr_char(lx) == '\n')
+    {
+        lx->line++;
+        lx->col = 1;
+    }
+    else
+        lx->col++;
+    lx->pos++;
+}
+// advance's pointer over n bytes found by a scan kernel; the line count is
+// recomputed from the newlines in the skipped run instead of byte by byte
+static void advance_by(JamLexer *lx, int n)
 {
-    if (curr_char() == '\n')
+    size_t last = 0;
+    size_t lines = count_newlines(lx->source + lx->pos, n, &last);
+    if (lines)
     {
-        lexer.line++;
-        lexer.col = 1;
+        lx->line += (int)lines;
+        lx->col = n - (int)last;
     }
     else
-        lexer.col++;
-    lexer.pos++;
+        lx->col += n;
+    lx->pos += n;
 }
 // move's to the next character
-char next()
+static char next(JamLexer *lx)
 {
-    return lexer.source[lexer.pos + 1];
+    return lx->source[lx->pos + 1];
 }
 // skip whitespace's
-void skip_whitespaces()
+static void skip_whitespaces(JamLexer *lx)
 {
-    while (isspace(curr_char()))
-        advance();
+    advance_by(lx, (int)scan_whitespace(lx->source + lx->pos, lx->length - lx->pos));
 }
 // skip comments in the source code
-void skip_comments()
+static void skip_comments(JamLexer *lx)
 {
-    if (curr_char() == '*' && next() == '*')
+    if (curr_char(lx) == '*' && next(lx) == '*')
     {
-        advance();
-        advance();
-        while (curr_char() != '\n' && next() != '\0')
-        {
-            advance();
-        }
+        advance(lx);
+        advance(lx);
+        advance_by(lx, (int)scan_line_end(lx->source + lx->pos, lx->length - lx->pos));
         return;
     }
     // multiline comments
-    if (curr_char() == '*' && next() == '-')
+    if (curr_char(lx) == '*' && next(lx) == '-')
     {
-        advance();
-        advance();
-        while (!(curr_char() == '-' && next() == '*') && curr_char() != '\0')
-        {
-            advance();
-        }
-        if (curr_char() == '-' && next() == '*')
+        advance(lx);
+        advance(lx);
+        advance_by(lx, (int)scan_block_end(lx->source + lx->pos, lx->length - lx->pos));
+        if (curr_char(lx) == '-' && next(lx) == '*')
         {
-            advance();
-            advance();
+            advance(lx);
+            advance(lx);
         }
         return;
     }
 }
-// create a Token
-Token *create_token(TokenType type, char *lexeme, int line, int col)
+// character classes of the table-driven core; identifier bytes continue a
+// name when their class is CC_DIGIT or above
+enum { CC_OTHER, CC_SPACE, CC_QUOTE, CC_DIGIT, CC_IDENT };
+static const unsigned char charClass[256] = {
+    [' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\n'] = CC_SPACE,
+    ['\v'] = CC_SPACE, ['\f'] = CC_SPACE, ['\r'] = CC_SPACE,
+    ['"'] = CC_QUOTE,
+    ['0' ... '9'] = CC_DIGIT,
+    ['a' ... 'z'] = CC_IDENT, ['A' ... 'Z'] = CC_IDENT, ['_'] = CC_IDENT,
+};
+#define CLASS_OF(c) charClass[(unsigned char)(c)]
+// operator DFA generated from tokens.def: the lead char either completes a
+// one-char token or moves to a state whose only transition is opFollow[c]
+static const unsigned char opSingle[256] = {
+#define PUNCT1(name, spelling, c) [(unsigned char)(c)] = name,
+#include "tokens.def"
+};
+static const unsigned char opFollow[256] = {
+#define PUNCT2(name, spelling, c1, c2) [(unsigned char)(c1)] = (c2),
+#include "tokens.def"
+};
+static const unsigned char opPair[256] = {
+#define PUNCT2(name, spelling, c1, c2) [(unsigned char)(c1)] = name,
+#include "tokens.def"
+};
+// create a Token slicing [offset, offset + length) of the source
+static Token create_token(TokenType type, int offset, int length, int line, int col)
 {
-    Token *token = (Token *)malloc(sizeof(Token));
-    token->type = type;
-    token->lexeme = strdup(lexeme);
-    token->line = line;
-    token->col = col;
+    Token token;
+    token.type = type;
+    token.offset = offset;
+    token.length = length;
+    token.line = line;
+    token.col = col;
+    token.value.atom = NULL;
     return token;
 }
-Token *identifier()
-{
-    int begin = lexer.pos;
-    int col = lexer.col;
-    while (isalnum(curr_char()) || curr_char() == '_')
-        advance();
-    int len = lexer.pos - begin;
-    char *lexeme = (char *)malloc(len + 1);
-    strncpy(lexeme, lexer.source + begin, len);
-    lexeme[len] = '\0';
-    TokenType type = TOKEN_IDENTIFIER;
-    if (strcmp(lexeme, "fn") == 0)
-        type = TOKEN_KEYWORD_FN;
-    else if (strcmp(lexeme, "if") == 0)
-        type = TOKEN_KEYWORD_IF;
-    else if (strcmp(lexeme, "else") == 0)
-        type = TOKEN_KEYWORD_ELSE;
-    else if (strcmp(lexeme, "var") == 0)
-        type = TOKEN_KEYWORD_VAR;
-    else if (strcmp(lexeme, "return") == 0)
-        type = TOKEN_KEYWORD_RETURN;
-    else if (strcmp(lexeme, "import") == 0)
-        type = TOKEN_KEYWORD_IMPORT;
-    else if (strcmp(lexeme, "while") == 0)
-        type = TOKEN_KEYWORD_LOOP;
-    else if (strcmp(lexeme, "for") == 0)
-        type = TOKEN_KEYWORD_FORLOOP;
-    else if (strcmp(lexeme, "Int") == 0)
-        type = TOKEN_KEYWORD_INT;
-    else if (strcmp(lexeme, "Float") == 0)
-        type = TOKEN_KEYWORD_FLOAT;
-    else if (strcmp(lexeme, "Bool") == 0)
-        type = TOKEN_KEYWORD_BOOL;
-    else if (strcmp(lexeme, "Void") == 0)
-        type = TOKEN_KEYWORD_VOID;
-    else if (strcmp(lexeme, "String") == 0)
-        type = TOKEN_KEYWORD_STRING;
-    else if (strcmp(lexeme, "struct") == 0)
-        type = TOKEN_KEYWORD_STRUCT;
-    else if (strcmp(lexeme, "true") == 0)
-        type = TOKEN_KEYWORD_TRUE;
-    else if (strcmp(lexeme, "false") == 0)
-        type = TOKEN_KEYWORD_FALSE;
-    else if (strcmp(lexeme, "null") == 0)
-        type = TOKEN_KEYWORD_NULL;
-    Token *token = create_token(type, lexeme, lexer.line, col);
-    return token;
+// compare a source slice against a keyword
+static int keyword_is(const char *lexeme, int len, const char *keyword)
+{
+    return (int)strlen(keyword) == len && memcmp(lexeme, keyword, len) == 0;
+}
+// keyword classifier generated from tokens.def: keywordFirst[len][c] is the
+// first keyword of length len starting with c and keywordNext chains any
+// others that do, so an identifier costs one lookup and usually at most one
+// short memcmp. TOKEN_EOF, never a keyword, ends a chain.
+#define KEYWORD_MAX_LENGTH 7
+#define KEYWORD(name, spelling) \
+    _Static_assert(sizeof(spelling) - 1 <= KEYWORD_MAX_LENGTH, "keyword " spelling " needs a larger KEYWORD_MAX_LENGTH");
+#include "tokens.def"
+static const char *const keywordSpellings[TOKEN_TYPE_COUNT] = {
+#define KEYWORD(name, spelling) [name] = spelling,
+#include "tokens.def"
+};
+static unsigned char keywordFirst[KEYWORD_MAX_LENGTH + 1][128];
+static unsigned char keywordNext[TOKEN_TYPE_COUNT];
+static pthread_once_t keywordTableOnce = PTHREAD_ONCE_INIT;
+static void build_keyword_table(void)
+{
+    for (int k = 0; k < TOKEN_TYPE_COUNT; k++)
+    {
+        const char *keyword = keywordSpellings[k];
+        if (!keyword)
+            continue;
+        unsigned char *first = &keywordFirst[strlen(keyword)][(unsigned char)keyword[0] & 127];
+        keywordNext[k] = *first;
+        *first = (unsigned char)k;
+    }
+}
+// classify an identifier slice: length and first char pick the candidate
+// keywords, whose tails are then compared
+TokenType keyword_type(const char *lexeme, int len)
+{
+    if (len <= 0 || len > KEYWORD_MAX_LENGTH || (unsigned char)lexeme[0] >= 128)
+        return TOKEN_IDENTIFIER;
+    pthread_once(&keywordTableOnce, build_keyword_table);
+    for (int k = keywordFirst[len][(unsigned char)lexeme[0]]; k != TOKEN_EOF; k = keywordNext[k])
+        if (memcmp(lexeme + 1, keywordSpellings[k] + 1, len - 1) == 0)
+            return (TokenType)k;
+    return TOKEN_IDENTIFIER;
+}
+static Token identifier(JamLexer *lx)
+{
+    int begin = lx->pos;
+    int col = lx->col;
+    const char *p = lx->source + begin;
+    while (CLASS_OF(*p) >= CC_DIGIT)
+        p++;
+    int len = (int)(p - (lx->source + begin));
+    lx->pos += len;
+    lx->col += len;
+    TokenType type = keyword_type(lx->source + begin, len);
+    return create_token(type, begin, len, lx->line, col);
+}
+static int digit_run(JamLexer *lx)
+{
+    const char *p = lx->source + lx->pos;
+    while (CLASS_OF(*p) == CC_DIGIT)
+        p++;
+    int n = (int)(p - (lx->source + lx->pos));
+    lx->pos += n;
+    lx->col += n;
+    return n;
+}
+// exact powers of ten for the float fast path below
+static const double pow10Exact[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+// decode a "digits.digits" lexeme; a mantissa below 2^53 divided by an exact
+// power of ten is correctly rounded, anything longer goes through strtod
+static double decode_float(const char *p, int len)
+{
+    unsigned long long mantissa = 0;
+    int digits = 0, fraction = 0, seenDot = 0;
+    for (int i = 0; i < len; i++)
+    {
+        if (p[i] == '.')
+        {
+            seenDot = 1;
+            continue;
+        }
+        if (mantissa == 0 && p[i] == '0' && !seenDot)
+            continue;
+        if (++digits > 19)
+            break;
+        mantissa = mantissa * 10 + (unsigned)(p[i] - '0');
+        fraction += seenDot;
+    }
+    if (digits <= 19 && mantissa < (1ULL << 53) && fraction <= 22)
+        return (double)mantissa / pow10Exact[fraction];
+    // copy the lexeme: the source may continue with something strtod reads
+    // as part of the number (an identifier like e5 right after it)
+    char small[64];
+    char *copy = len < (int)sizeof small ? small : (char *)malloc(len + 1);
+    if (!copy)
+        return 0.0;
+    memcpy(copy, p, len);
+    copy[len] = '\0';
+    double value = strtod(copy, NULL);
+    if (copy != small)
+        free(copy);
+    return value;
 }
-Token *number()
+// integer or float literal, decoded here once so later phases never reparse it
+static Token number(JamLexer *lx)
 {
-    int s = lexer.pos;
-    int col = lexer.col;
-    while (isdigit(curr_char()))
-        advance();
-    if (curr_char() == '.')
+    int s = lx->pos;
+    int col = lx->col;
+    long long value = 0;
+    for (const char *p = lx->source + s; CLASS_OF(*p) == CC_DIGIT; p++)
+        if (value <= INT_MAX)
+            value = value * 10 + (*p - '0');
+    digit_run(lx);
+    if (curr_char(lx) == '.')
+    {
+        advance(lx);
+        digit_run(lx);
+        Token token = create_token(TOKEN_FLOAT, s, lx->pos - s, lx->line, col);
+        token.value.f = decode_float(lx->source + s, lx->pos - s);
+        return token;
+    }
+    Token token = create_token(TOKEN_INT, s, lx->pos - s, lx->line, col);
+    if (value > INT_MAX)
     {
-        advance();
-        while (isdigit(curr_char()))
-            advance();
+        lex_error(lx, s, "Integer literal at line %d, col %d is out of range\n", lx->line, col);
+        value = INT_MAX;
     }
-    int len = lexer.pos - s;
-    char *lexeme = (char *)malloc(len + 1);
-    strncpy(lexeme, lexer.source + s, len);
-    lexeme[len] = '\0';
-    Token *token = create_token(TOKEN_NUMBER, lexeme, lexer.line, col);
+    token.value.i = (int)value;
     return token;
 }
-Token *string_lit()
+// Strings are sliced raw; escapes are decoded on demand by token_string_value()
+static Token string_lit(JamLexer *lx)
 {
-    int startLine = lexer.line;
-    int startCol = lexer.col;
-    advance(); // skip opening quote '"'
+    int startLine = lx->line;
+    int startCol = lx->col;
+    advance(lx); // skip opening quote '"'
 
-    char buffer[1024];
-    int buf_pos = 0;
+    int begin = lx->pos;
+    while (1)
+    {
+        advance_by(lx, (int)scan_string_end(lx->source + lx->pos, lx->length - lx->pos));
+        if (curr_char(lx) != '\\')
+            break;
+        advance(lx); // skip the backslash and the escaped char
+        if (curr_char(lx) != '\0')
+            advance(lx);
+    }
+    int len = lx->pos - begin;
 
-    while (curr_char() != '"' && curr_char() != '\0')
+    if (curr_char(lx) == '"')
+        advance(lx); // skip closing quote
+
+    return create_token(TOKEN_STRING, begin, len, startLine, startCol);
+}
+
+// lex one token starting at the current position; whitespace and comments
+// must already have been skipped
+static Token lex_token(JamLexer *lx)
+{
+    while (curr_char(lx) != '\0')
     {
-        if (curr_char() == '\\')
+        int tokenLine = lx->line;
+        int tokenCol = lx->col;
+        int tokenPos = lx->pos;
+        unsigned char c = (unsigned char)curr_char(lx);
+
+        switch (CLASS_OF(c))
         {
-            advance();
-            switch (curr_char())
-            {
-            case 'n':
-                buffer[buf_pos++] = '\n';
-                break;
-            case 't':
-                buffer[buf_pos++] = '\t';
-                break;
-            case '\\':
-                buffer[buf_pos++] = '\\';
-                break;
-            case '"':
-                buffer[buf_pos++] = '"';
-                break;
-            default:
-                // Unrecognized escape sequence, keep literal char or error
-                buffer[buf_pos++] = curr_char();
-                break;
-            }
-            advance();
+        case CC_IDENT:
+            return identifier(lx);
+        case CC_DIGIT:
+            return number(lx);
+        case CC_QUOTE:
+            return string_lit(lx);
         }
-        else
+
+        // operators and delimiters never contain a newline, so line stays put
+        unsigned char follow = opFollow[c];
+        if (follow && (unsigned char)next(lx) == follow)
         {
-            buffer[buf_pos++] = curr_char();
-            advance();
+            lx->pos += 2;
+            lx->col += 2;
+            return create_token((TokenType)opPair[c], tokenPos, 2, tokenLine, tokenCol);
         }
-
-        if (buf_pos >= sizeof(buffer) - 1)
+        if (opSingle[c])
         {
-            // Optionally handle buffer overflow error
-            break;
+            lx->pos++;
+            lx->col++;
+            return create_token((TokenType)opSingle[c], tokenPos, 1, tokenLine, tokenCol);
         }
+        // may be whitespace following an earlier bad char, so keep line counting
+        advance(lx);
+        // a lone '&' or '|' (lead char of a two-char operator only) is dropped
+        if (!follow)
+            lex_error(lx, tokenPos, "Unrecognized character: '%c' at line %d, col %d\n", c, tokenLine, tokenCol);
     }
-
-    if (curr_char() == '"')
-        advance(); // skip closing quote
-
-    buffer[buf_pos] = '\0';
-
-    return create_token(TOKEN_STRING, strdup(buffer), startLine, startCol);
+    return create_token(TOKEN_EOF, lx->pos, 0, lx->line, lx->col);
 }
-
-Token *get_next_token()
+// produce the next token of a lexer context
+Token jam_lexer_next(JamLexer *lx)
 {
     while (1)
     {
         // Skip whitespace.
-        if (isspace(curr_char()))
+        if (CLASS_OF(curr_char(lx)) == CC_SPACE)
         {
-            skip_whitespaces();
+            skip_whitespaces(lx);
             continue; // keep skipping if still whitespace
         }
         // Check and skip comments.
-        if (curr_char() == '*' && (next() == '*' || next() == '-'))
+        if (curr_char(lx) == '*' && (next(lx) == '*' || next(lx) == '-'))
         {
-            skip_comments();
+            skip_comments(lx);
             continue; // keep skipping if still comment
         }
         break; // no more whitespace/comments, break out
     }
-
-    while (curr_char() != '\0')
+    return lex_token(lx);
+}
+// compatibility shim: the original single global lexer
+static JamLexer lexer;
+// initialize JAM lexer
+void initlexer(char *src)
+{
+    jam_lexer_init(&lexer, src, strlen(src));
+}
+Token get_next_token()
+{
+    return jam_lexer_next(&lexer);
+}
+// streaming lexer: the input is read through a fixed window; consumed bytes
+// are dropped by moving the unread tail to the front before each refill
+enum { STREAM_CODE, STREAM_LINE_COMMENT, STREAM_BLOCK_COMMENT };
+#define STREAM_MIN_WINDOW 256
+// keep window[from, length), read more input behind it and re-pad
+static void stream_refill(JamStreamLexer *s, int from)
+{
+    JamLexer *lx = &s->lexer;
+    int keep = lx->length - from;
+    memmove(s->window, s->window + from, keep);
+    s->base += from;
+    lx->pos -= from;
+    lx->length = keep;
+    while (!s->eof && lx->length < s->capacity)
     {
-        int tokenLine = lexer.line;
-        int tokenCol = lexer.col;
-        char c = curr_char();
-
-        // Recognize identifiers and keywords.
-        if (isalpha(c) || c == '_')
-            return identifier();
-
-        // Recognize numbers.
-        if (isdigit(c))
-            return number();
-
-        // Recognize strings.
-        if (c == '"')
-            return string_lit();
-
-        // Recognize operators and delimiters.
-        switch (c)
+        long got = (long)read(s->fd, s->window + lx->length, s->capacity - lx->length);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
         {
-        case '+':
+            if (got < 0)
+                s->error = 1;
+            s->eof = 1;
+            break;
+        }
+        lx->length += (int)got;
+    }
+    memset(s->window + lx->length, 0, SOURCE_PADDING);
+}
+// open a streaming lexer over fd with a window of the given size (0 = default)
+// the descriptor stays owned by the caller
+int jam_stream_init(JamStreamLexer *s, int fd, size_t window)
+{
+    if (window == 0)
+        window = JAM_STREAM_WINDOW;
+    if (window < STREAM_MIN_WINDOW)
+        window = STREAM_MIN_WINDOW;
+    s->window = (char *)malloc(window + SOURCE_PADDING);
+    if (!s->window)
+        return -1;
+    s->capacity = (int)window;
+    s->base = 0;
+    s->fd = fd;
+    s->eof = 0;
+    s->error = 0;
+    s->state = STREAM_CODE;
+    jam_lexer_init(&s->lexer, s->window, 0);
+    stream_refill(s, 0);
+    return s->error ? -1 : 0;
+}
+// skip whitespace and comments, refilling as they run off the window; a
+// comment can be longer than the window, so being inside one is kept in state
+static void stream_skip_trivia(JamStreamLexer *s)
+{
+    JamLexer *lx = &s->lexer;
+    while (1)
+    {
+        int remaining = lx->length - lx->pos;
+        if (s->state == STREAM_LINE_COMMENT)
         {
-            advance();
-            return create_token(TOKEN_OPERATOR_PLUS, "+", tokenLine, tokenCol);
+            advance_by(lx, (int)scan_line_end(lx->source + lx->pos, remaining));
+            if (lx->pos < lx->length || s->eof)
+                s->state = STREAM_CODE;
+            else
+                stream_refill(s, lx->pos);
+            continue;
         }
-        case '-':
+        if (s->state == STREAM_BLOCK_COMMENT)
         {
-            advance();
-            // Check for arrow operator "->"
-            if (curr_char() == '>')
+            int n = (int)scan_block_end(lx->source + lx->pos, remaining);
+            if (n < remaining || s->eof)
             {
-                advance();
-                return create_token(TOKEN_ARROW, "->", tokenLine, tokenCol);
+                // closing "-*", or an unterminated comment running to EOF
+                advance_by(lx, n);
+                if (n < remaining)
+                {
+                    advance(lx);
+                    advance(lx);
+                }
+                s->state = STREAM_CODE;
             }
-            return create_token(TOKEN_OPERATOR_MINUS, "-", tokenLine, tokenCol);
-        }
-        case '*':
-        {
-            advance();
-            return create_token(TOKEN_OPERATOR_MUL, "*", tokenLine, tokenCol);
-        }
-        case '/':
-        {
-            advance();
-            return create_token(TOKEN_OPERATOR_DIV, "/", tokenLine, tokenCol);
-        }
-        case '%':
-        {
-            advance();
-            return create_token(TOKEN_OPERATOR_MOD, "%", tokenLine, tokenCol);
-        }
-        case '=':
-        {
-            advance();
-            if (curr_char() == '=')
+            else
             {
-                advance();
-                return create_token(TOKEN_OPERATOR_EQ, "==", tokenLine, tokenCol);
+                // hold back the last byte: it may be the '-' of a split "-*"
+                if (remaining > 1)
+                    advance_by(lx, remaining - 1);
+                stream_refill(s, lx->pos);
             }
-            return create_token(TOKEN_OPERATOR_ASSIGN, "=", tokenLine, tokenCol);
+            continue;
         }
-        case '!':
+        // "**" and "*-" need one byte of lookahead
+        if (remaining < 2 && !s->eof)
         {
-            advance();
-            if (curr_char() == '=')
-            {
-                advance();
-                return create_token(TOKEN_OPERATOR_NEQ, "!=", tokenLine, tokenCol);
-            }
-            return create_token(TOKEN_OPERATOR_NOT, "!", tokenLine, tokenCol);
+            stream_refill(s, lx->pos);
+            continue;
         }
-        case '<':
+        if (CLASS_OF(curr_char(lx)) == CC_SPACE)
         {
-            advance();
-            if (curr_char() == '=')
-            {
-                advance();
-                return create_token(TOKEN_OPERATOR_LTE, "<=", tokenLine, tokenCol);
-            }
-            return create_token(TOKEN_OPERATOR_LT, "<", tokenLine, tokenCol);
+            skip_whitespaces(lx);
+            continue;
         }
-        case '>':
+        if (curr_char(lx) == '*' && (next(lx) == '*' || next(lx) == '-'))
         {
-            advance();
-            if (curr_char() == '=')
-            {
-                advance();
-                return create_token(TOKEN_OPERATOR_GTE, ">=", tokenLine, tokenCol);
-            }
-            return create_token(TOKEN_OPERATOR_GT, ">", tokenLine, tokenCol);
+            s->state = next(lx) == '*' ? STREAM_LINE_COMMENT : STREAM_BLOCK_COMMENT;
+            advance(lx);
+            advance(lx);
+            continue;
         }
-        case '&':
+        return;
+    }
+}
+// produce the next token of a stream; offsets are relative to stream->window
+Token jam_stream_next(JamStreamLexer *s)
+{
+    JamLexer *lx = &s->lexer;
+    while (1)
+    {
+        stream_skip_trivia(s);
+        JamLexer start = *lx;
+        Token t = lex_token(lx);
+        // a token ending at the window edge may continue in unread input:
+        // rewind, make room in front of it and lex it again
+        if (lx->pos < lx->length || s->eof)
+            return t;
+        *lx = start;
+        if (lx->pos == 0)
         {
-            advance();
-            if (curr_char() == '&')
-            {
-                advance();
-                return create_token(TOKEN_OPERATOR_AND, "&&", tokenLine, tokenCol);
-            }
-            break;
+            fprintf(stderr, "Token at line %d, col %d is longer than the %d-byte stream window\n",
+                    lx->line, lx->col, s->capacity);
+            s->error = 1;
+            s->eof = 1;
+            lx->pos = lx->length;
+            return create_token(TOKEN_EOF, lx->pos, 0, lx->line, lx->col);
         }
-        case '|':
+        stream_refill(s, lx->pos);
+    }
+}
+// release the window; the descriptor is left open
+void jam_stream_free(JamStreamLexer *s)
+{
+    free(s->window);
+    s->window = NULL;
+}
+// tokenize a NUL-terminated source buffer
+int tokenize(const char *source, TokenStream *stream)
+{
+    return tokenize_n(source, strlen(source), stream);
+}
+// (re)allocate the parallel token arrays as one block: values, offsets,
+// lengths, then the type bytes, so a stream is released with a single free
+static int grow_token_stream(TokenStream *stream, int capacity)
+{
+    char *block = (char *)malloc((size_t)capacity * (sizeof(TokenValue) + 2 * sizeof(int) + 1));
+    if (!block)
+        return -1;
+    TokenValue *values = (TokenValue *)block;
+    int *offsets = (int *)(values + capacity);
+    int *lengths = offsets + capacity;
+    unsigned char *types = (unsigned char *)(lengths + capacity);
+    if (stream->count)
+    {
+        memcpy(values, stream->values, stream->count * sizeof(TokenValue));
+        memcpy(offsets, stream->offsets, stream->count * sizeof(int));
+        memcpy(lengths, stream->lengths, stream->count * sizeof(int));
+        memcpy(types, stream->types, stream->count);
+    }
+    free(stream->values);
+    stream->values = values;
+    stream->offsets = offsets;
+    stream->lengths = lengths;
+    stream->types = types;
+    stream->capacity = capacity;
+    return 0;
+}
+// empty stream over source with room for capacity tokens
+static int start_token_stream(TokenStream *stream, const char *source, size_t length, int capacity)
+{
+    stream->source = source;
+    stream->sourceLength = (int)length;
+    stream->values = NULL;
+    stream->count = 0;
+    stream->lineStarts = NULL;
+    stream->lineCount = 0;
+    stream->shiftFrom = 0;
+    stream->shiftBy = 0;
+    stream->lineShiftFrom = 0;
+    stream->lineShiftBy = 0;
+    return grow_token_stream(stream, capacity);
+}
+// append one lexed token; identifiers are interned here, once, so later
+// phases compare names by pointer
+static int push_token(TokenStream *stream, Token t)
+{
+    if (stream->count == stream->capacity && grow_token_stream(stream, stream->capacity * 2) != 0)
+        return -1;
+    int i = stream->count++;
+    stream->types[i] = (unsigned char)t.type;
+    stream->offsets[i] = t.offset;
+    stream->lengths[i] = t.length;
+    stream->values[i] = t.value;
+    if (t.type == TOKEN_IDENTIFIER && !(stream->values[i].atom = intern(stream->source + t.offset, t.length)))
+        return -1;
+    return 0;
+}
+// tokenize a whole source buffer into dense parallel token arrays
+// the arrays are sized from the source length up front, so a typical file
+// costs one allocation and pathological ones only a few doublings
+// uses its own lexer context, so independent buffers can be tokenized on
+// different threads at the same time
+int tokenize_n(const char *source, size_t length, TokenStream *stream)
+{
+    if (start_token_stream(stream, source, length, (int)(length / 4) + 16) != 0)
+        return -1;
+
+    JamLexer lx;
+    jam_lexer_init(&lx, source, length);
+    while (1)
+    {
+        Token t = jam_lexer_next(&lx);
+        if (push_token(stream, t) != 0)
+            return -1;
+        if (t.type == TOKEN_EOF)
+            break;
+    }
+    return stream->count;
+}
+// parallel tokenizer: the buffer is cut into chunks just after a newline and
+// every chunk is lexed on its own thread, speculating that it starts between
+// tokens (or, if a "-*" shows up before any "*-", just after a comment).
+// The lexer's state between tokens is nothing but its position, so a chunk's
+// tokens are right from the point where the true token sequence ends exactly
+// where a speculative token ends. A sequential pass walks the chunks, keeps
+// the tokens after that point and relexes only the stretch before it.
+#ifndef JAM_PARALLEL_MIN_CHUNK
+#define JAM_PARALLEL_MIN_CHUNK (256 * 1024)
+#endif
+#define JAM_PARALLEL_MAX_THREADS 64
+
+typedef struct {
+    const char *source;
+    size_t length;
+    int begin, end;  // chunk bytes [begin, end)
+    int specStart;   // where speculative lexing started
+    int lines;       // newlines in [begin, end)
+    int last;        // the final chunk lexes on to EOF
+    int errors, errorPos; // diagnostics held back by the quiet lexer
+    int status;
+    TokenStream tokens;
+    pthread_t thread;
+} LexChunk;
+
+// offset just past the last byte the lexer consumed for token i, whose text
+// is in source
+static int token_end(const TokenStream *stream, const char *source, int i)
+{
+    int end = token_offset(stream, i) + stream->lengths[i];
+    return stream->types[i] == TOKEN_STRING && source[end] == '"' ? end + 1 : end;
+}
+// first "-*" of the chunk if no "*-" comes before it, i.e. the chunk most
+// likely opens inside a block comment; -1 otherwise
+static int comment_exit(const char *source, int begin, int end)
+{
+    int close = begin + (int)scan_block_end(source + begin, end - begin);
+    if (close >= end)
+        return -1;
+    for (const char *p = memchr(source + begin, '*', close - begin); p; p = memchr(p + 1, '*', source + close - (p + 1)))
+        if (p[1] == '-')
+            return -1;
+    return close + 2;
+}
+static void *lex_chunk(void *arg)
+{
+    LexChunk *c = arg;
+    size_t last;
+    c->lines = (int)count_newlines(c->source + c->begin, c->end - c->begin, &last);
+    c->specStart = c->begin;
+    if (c->begin > 0)
+    {
+        int after = comment_exit(c->source, c->begin, c->end);
+        if (after >= 0 && after < c->end)
+            c->specStart = after;
+    }
+    c->status = start_token_stream(&c->tokens, c->source, c->length, (c->end - c->begin) / 4 + 16);
+    if (c->status != 0)
+        return NULL;
+
+    JamLexer lx;
+    jam_lexer_init(&lx, c->source, c->length);
+    lx.pos = c->specStart;
+    lx.quiet = 1;
+    // a token that starts in the chunk belongs to it, even if it runs past the end
+    while (c->last || lx.pos < c->end)
+    {
+        Token t = jam_lexer_next(&lx);
+        if ((c->status = push_token(&c->tokens, t)) != 0 || t.type == TOKEN_EOF)
+            break;
+    }
+    c->errors = lx.errors;
+    c->errorPos = lx.errorPos;
+    return NULL;
+}
+// append tokens [from, count) of a chunk
+static int append_tokens(TokenStream *stream, const TokenStream *chunk, int from)
+{
+    int n = chunk->count - from;
+    int capacity = stream->capacity;
+    while (stream->count + n > capacity)
+        capacity *= 2;
+    if (capacity != stream->capacity && grow_token_stream(stream, capacity) != 0)
+        return -1;
+    memcpy(stream->values + stream->count, chunk->values + from, n * sizeof(TokenValue));
+    memcpy(stream->offsets + stream->count, chunk->offsets + from, n * sizeof(int));
+    memcpy(stream->lengths + stream->count, chunk->lengths + from, n * sizeof(int));
+    memcpy(stream->types + stream->count, chunk->types + from, n);
+    stream->count += n;
+    return 0;
+}
+// index of the first chunk token to keep when the true lexer stands at pos,
+// or -1 if no speculative token ends there; held-back diagnostics at or
+// after pos would be lost, so then the chunk must be relexed out loud
+static int sync_point(const LexChunk *c, int pos)
+{
+    if (c->errors && c->errorPos >= pos)
+        return -1;
+    if (pos == c->specStart)
+        return 0;
+    int lo = 0, hi = c->tokens.count - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        int end = token_end(&c->tokens, c->source, mid);
+        if (end == pos && c->tokens.types[mid] != TOKEN_EOF)
+            return mid + 1;
+        if (end < pos)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+// stitch the chunks into one stream; returns 1 once TOKEN_EOF is in, 0 if
+// the chunks ran out first (cannot happen: the last one lexes to EOF), -1
+// on allocation failure
+static int stitch_chunks(TokenStream *stream, LexChunk *chunks, int count)
+{
+    int pos = 0;  // the true lexer stands here, between two tokens
+    int line = 1; // line number at chunks[k].begin
+    for (int k = 0; k < count; line += chunks[k].lines, k++)
+    {
+        LexChunk *c = &chunks[k];
+        if (!c->last && pos >= c->end)
+            continue; // covered by a token or comment of an earlier chunk
+        int from = sync_point(c, pos);
+        if (from < 0)
         {
-            advance();
-            if (curr_char() == '|')
+            // lex for real from pos until it meets the chunk's tokens
+            size_t last;
+            int lines = (int)count_newlines(c->source + c->begin, pos - c->begin, &last);
+            JamLexer lx;
+            jam_lexer_init(&lx, c->source, c->length);
+            lx.pos = pos;
+            lx.line = line + lines;
+            lx.col = lines ? pos - (c->begin + (int)last) : pos - c->begin + 1;
+            while (from < 0)
             {
-                advance();
-                return create_token(TOKEN_OPERATOR_OR, "||", tokenLine, tokenCol);
+                Token t = jam_lexer_next(&lx);
+                if (push_token(stream, t) != 0)
+                    return -1;
+                if (t.type == TOKEN_EOF)
+                    return 1;
+                pos = lx.pos;
+                if (!c->last && pos >= c->end)
+                    break;
+                from = sync_point(c, pos);
             }
-            break;
-        }
-        case '(':
-        {
-            advance();
-            return create_token(TOKEN_DELIM_OPEN_PAREN, "(", tokenLine, tokenCol);
-        }
-        case ')':
-        {
-            advance();
-            return create_token(TOKEN_DELIM_CLOSE_PAREN, ")", tokenLine, tokenCol);
+            if (from < 0)
+                continue;
         }
-        case '{':
+        if (append_tokens(stream, &c->tokens, from) != 0)
+            return -1;
+        if (stream->count && stream->types[stream->count - 1] == TOKEN_EOF)
+            return 1;
+        pos = token_end(stream, stream->source, stream->count - 1);
+    }
+    return 0;
+}
+int tokenize_parallel(const char *source, size_t length, TokenStream *stream, int threads)
+{
+    if (threads <= 0)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+        threads = 1;
+#endif
+    }
+    if (threads > JAM_PARALLEL_MAX_THREADS)
+        threads = JAM_PARALLEL_MAX_THREADS;
+    if ((size_t)threads > length / JAM_PARALLEL_MIN_CHUNK)
+        threads = (int)(length / JAM_PARALLEL_MIN_CHUNK);
+    if (threads < 2)
+        return tokenize_n(source, length, stream);
+
+    if (start_token_stream(stream, source, length, (int)(length / 4) + 16) != 0)
+        return -1;
+
+    // cut just after the first newline at or past each even split point
+    LexChunk chunks[JAM_PARALLEL_MAX_THREADS];
+    int count = 0;
+    int begin = 0;
+    for (int k = 1; k <= threads && begin < (int)length; k++)
+    {
+        int end = (int)length;
+        if (k < threads)
         {
-            advance();
-            return create_token(TOKEN_DELIM_OPEN_BRACE, "{", tokenLine, tokenCol);
+            size_t split = length / threads * k;
+            const char *nl = split > (size_t)begin ? memchr(source + split, '\n', length - split) : NULL;
+            if (!nl)
+                continue;
+            end = (int)(nl + 1 - source);
         }
-        case '}':
+        LexChunk *c = &chunks[count++];
+        memset(c, 0, sizeof *c);
+        c->source = source;
+        c->length = length;
+        c->begin = begin;
+        c->end = end;
+        begin = end;
+    }
+    chunks[count - 1].last = 1;
+    chunks[count - 1].end = (int)length;
+
+    // chunk 0 is lexed on the calling thread
+    int started = 1;
+    for (; started < count; started++)
+        if (pthread_create(&chunks[started].thread, NULL, lex_chunk, &chunks[started]) != 0)
+            break;
+    for (int k = started; k < count; k++)
+        lex_chunk(&chunks[k]); // out of threads: lex the rest here
+    lex_chunk(&chunks[0]);
+    for (int k = 1; k < started; k++)
+        pthread_join(chunks[k].thread, NULL);
+
+    int status = 0;
+    for (int k = 0; k < count; k++)
+        status |= chunks[k].status;
+    if (status == 0)
+        status = stitch_chunks(stream, chunks, count) == 1 ? 0 : -1;
+    for (int k = 0; k < count; k++)
+        free(chunks[k].tokens.values);
+    if (status != 0)
+    {
+        free_token_stream(stream);
+        return -1;
+    }
+    return stream->count;
+}
+// pipelined lexing: the lexer thread fills ring slots and publishes them
+// with a release store of head; the consumer hands slots back the same way
+// through tail. Each side only ever writes its own counter, so neither takes
+// a lock, and both publish in batches to keep the counters' cache line from
+// bouncing on every token.
+#define JAM_PIPE_BATCH 256
+
+static int pipe_load(const int *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+}
+static void pipe_store(int *counter, int value)
+{
+    __atomic_store_n(counter, value, __ATOMIC_RELEASE);
+}
+// wait for the slot of token head to be free; the index past the last slot
+// that may be filled without asking again, or -1 when told to stop
+static int pipe_room(TokenPipe *pipe, int head)
+{
+    int size = pipe->mask + 1;
+    for (int spins = 0;; spins++)
+    {
+        int tail = pipe_load(&pipe->tail);
+        if (head - tail < size)
+            return tail + size;
+        if (pipe_load(&pipe->stop))
+            return -1;
+        if (spins >= 64)
+            yield_cpu();
+    }
+}
+static void *pipe_lexer(void *arg)
+{
+    TokenPipe *pipe = (TokenPipe *)arg;
+    TokenStream *ring = &pipe->ring;
+    int head = 0, limit = 0;
+    while (1)
+    {
+        Token t = jam_lexer_next(&pipe->lexer);
+        if (head == limit)
         {
-            advance();
-            return create_token(TOKEN_DELIM_CLOSE_BRACE, "}", tokenLine, tokenCol);
+            pipe_store(&pipe->head, head);
+            if ((limit = pipe_room(pipe, head)) < 0)
+                break;
         }
-        case '[':
+        int i = head & pipe->mask;
+        ring->types[i] = (unsigned char)t.type;
+        ring->offsets[i] = t.offset;
+        ring->lengths[i] = t.length;
+        ring->values[i] = t.value;
+        if (t.type == TOKEN_IDENTIFIER && !(ring->values[i].atom = intern(ring->source + t.offset, t.length)))
         {
-            advance();
-            return create_token(TOKEN_DELIM_OPEN_SQUARE, "[", tokenLine, tokenCol);
+            // end the stream here, so the consumer is not left waiting
+            pipe->status = -1;
+            ring->types[i] = TOKEN_EOF;
+            t.type = TOKEN_EOF;
         }
-        case ']':
+        head++;
+        if (t.type == TOKEN_EOF)
+            break;
+        if (head % JAM_PIPE_BATCH == 0)
+            pipe_store(&pipe->head, head);
+    }
+    pipe_store(&pipe->head, head);
+    pipe_store(&pipe->done, 1);
+    return NULL;
+}
+int token_pipe_start(TokenPipe *pipe, const char *source, size_t length, int capacity)
+{
+    memset(pipe, 0, sizeof *pipe);
+    if (capacity < 64 || (capacity & (capacity - 1)) != 0 || start_token_stream(&pipe->ring, source, length, capacity) != 0)
+        return -1;
+    pipe->ring.count = capacity;
+    pipe->mask = capacity - 1;
+    jam_lexer_init(&pipe->lexer, source, length);
+    if (pthread_create(&pipe->thread, NULL, pipe_lexer, pipe) != 0)
+    {
+        free_token_stream(&pipe->ring);
+        return -1;
+    }
+    return 0;
+}
+int token_pipe_wait(TokenPipe *pipe, int index)
+{
+    for (int spins = 0;; spins++)
+    {
+        int head = pipe_load(&pipe->head);
+        if (head > index)
+            return head;
+        if (pipe_load(&pipe->done))
+            return pipe_load(&pipe->head);
+        if (spins >= 64)
+            yield_cpu();
+    }
+}
+void token_pipe_release(TokenPipe *pipe, int index)
+{
+    if (index > pipe->tail)
+        pipe_store(&pipe->tail, index);
+}
+int token_pipe_finish(TokenPipe *pipe)
+{
+    pipe_store(&pipe->stop, 1);
+    pthread_join(pipe->thread, NULL);
+    free_token_stream(&pipe->ring);
+    return pipe->status;
+}
+// release the token arrays; the source buffer is owned by the caller
+void free_token_stream(TokenStream *stream)
+{
+    free(stream->values);
+    free(stream->lineStarts);
+    stream->values = NULL;
+    stream->offsets = NULL;
+    stream->lengths = NULL;
+    stream->types = NULL;
+    stream->lineStarts = NULL;
+    stream->count = 0;
+    stream->capacity = 0;
+    stream->lineCount = 0;
+    stream->shiftFrom = 0;
+    stream->shiftBy = 0;
+    stream->lineShiftFrom = 0;
+    stream->lineShiftBy = 0;
+}
+// table of the line start offsets of src behind token_position(), built on
+// first use
+static int build_line_starts(TokenStream *stream, const char *src, int n)
+{
+    if (stream->lineStarts)
+        return 0;
+    size_t last;
+    int lines = (int)count_newlines(src, n, &last) + 1;
+    stream->lineStarts = (int *)malloc(lines * sizeof(int));
+    if (!stream->lineStarts)
+        return -1;
+    stream->lineStarts[0] = 0;
+    int k = 1;
+    for (const char *nl = memchr(src, '\n', n); nl; nl = memchr(nl + 1, '\n', n - (nl + 1 - src)))
+        stream->lineStarts[k++] = (int)(nl + 1 - src);
+    stream->lineCount = lines;
+    stream->lineShiftFrom = 0;
+    stream->lineShiftBy = 0;
+    return 0;
+}
+// offset at which line k starts
+static int line_start(const TokenStream *stream, int k)
+{
+    return stream->lineStarts[k] + (k >= stream->lineShiftFrom ? stream->lineShiftBy : 0);
+}
+// index of the last line starting at or before offset
+static int line_index(const TokenStream *stream, int offset)
+{
+    int lo = 0, hi = stream->lineCount - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (line_start(stream, mid) <= offset)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+// add the pending shift into the tail's offsets
+void settle_token_offsets(TokenStream *stream)
+{
+    for (int i = stream->shiftFrom; i < stream->count; i++)
+        stream->offsets[i] += stream->shiftBy;
+    stream->shiftFrom = 0;
+    stream->shiftBy = 0;
+}
+// line and column of a token, as the lexer counts them: the first call builds
+// a table of line start offsets, later calls binary-search it
+void token_position(TokenStream *stream, int index, int *line, int *col)
+{
+    if (build_line_starts(stream, stream->source, stream->sourceLength) != 0)
+    {
+        *line = *col = -1;
+        return;
+    }
+    // a string token is positioned at its opening quote
+    int offset = token_offset(stream, index) - (stream->types[index] == TOKEN_STRING);
+    int lo = line_index(stream, offset);
+    *line = lo + 1;
+    *col = offset - line_start(stream, lo) + 1;
+}
+// incremental relexing: after an edit, lexing restarts at the end of the last
+// token the edit cannot have changed and stops as soon as the lexer stands,
+// past the edit, where an old token ended; from there on the old tokens are
+// still right and only need shifting by the change in length. Only the new
+// text is read: bytes before the edit are the same in both, and the offsets
+// and lengths of the old tokens say the rest.
+// The shift is not applied to the tail but left pending (shiftFrom, shiftBy,
+// and the same for the line table); the next edit only settles the tokens
+// and lines between the two edits, so a run of edits in one place never
+// walks the rest of the file.
+// old token j ends at this offset of the edited source; only valid for
+// tokens that start after the edit, whose bytes all moved by delta
+static int shifted_end(const TokenStream *stream, int j, const char *source, int delta)
+{
+    int end = token_offset(stream, j) + stream->lengths[j] + delta;
+    return stream->types[j] == TOKEN_STRING && source[end] == '"' ? end + 1 : end;
+}
+// replace line starts in (start, start + removed] by those of the inserted
+// text and shift the later ones, lazily like the token offsets
+static int splice_line_starts(TokenStream *stream, const char *source, int start, int removed, int inserted)
+{
+    int delta = inserted - removed;
+    int first = line_index(stream, start) + 1; // first line start after start
+    int stop = first;
+    while (stop < stream->lineCount && line_start(stream, stop) <= start + removed)
+        stop++;
+    size_t last;
+    int added = (int)count_newlines(source + start, inserted, &last);
+    int count = stream->lineCount - (stop - first) + added;
+    if (count > stream->lineCount)
+    {
+        int *grown = (int *)realloc(stream->lineStarts, count * sizeof(int));
+        if (!grown)
+            return -1;
+        stream->lineStarts = grown;
+    }
+    int *lines = stream->lineStarts;
+    int from = stream->lineShiftFrom, by = stream->lineShiftBy;
+    if (by != 0)
+    {
+        for (int k = from; k < first; k++)
+            lines[k] += by;
+        for (int k = stop; k < from && k < stream->lineCount; k++)
+            lines[k] -= by;
+    }
+    if (first + added != stop)
+        memmove(lines + first + added, lines + stop, (stream->lineCount - stop) * sizeof(int));
+    stream->lineShiftFrom = first + added;
+    stream->lineShiftBy = by + delta;
+    int k = first;
+    for (const char *nl = memchr(source + start, '\n', inserted); nl; nl = memchr(nl + 1, '\n', source + start + inserted - (nl + 1)))
+        lines[k++] = (int)(nl + 1 - source);
+    stream->lineCount = count;
+    return 0;
+}
+int retokenize_edit(TokenStream *stream, const char *source, size_t length, int start, int removed, int inserted)
+{
+    TokenEdit changed;
+    return retokenize_edit_tokens(stream, source, length, start, removed, inserted, &changed);
+}
+int retokenize_edit_tokens(TokenStream *stream, const char *source, size_t length, int start, int removed, int inserted,
+                           TokenEdit *changed)
+{
+    int delta = inserted - removed;
+    if (start < 0 || removed < 0 || inserted < 0 || start + removed > stream->sourceLength ||
+        (int)length != stream->sourceLength + delta)
+        return -1;
+    // with no line table yet, it is built from the new text, which needs no
+    // splicing afterwards; lines before the edit are the same in either
+    int freshLines = !stream->lineStarts;
+    if (build_line_starts(stream, source, (int)length) != 0)
+        return -1;
+
+    // last token that ends before the edit: the byte after a token can still
+    // decide where it ends, so a token ending right at start is not safe.
+    // token_end() only reads source below start, where nothing changed.
+    int lo = 0, hi = stream->count - 2; // never the EOF token
+    int keep = -1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (token_offset(stream, mid) + stream->lengths[mid] < start && token_end(stream, source, mid) < start)
         {
-            advance();
-            return create_token(TOKEN_DELIM_CLOSE_SQUARE, "]", tokenLine, tokenCol);
+            keep = mid;
+            lo = mid + 1;
         }
-        case ',':
+        else
+            hi = mid - 1;
+    }
+    int pos = keep >= 0 ? token_end(stream, source, keep) : 0;
+
+    // first old token that lies wholly after the edit
+    int j = keep + 1;
+    while (j < stream->count && token_offset(stream, j) - (stream->types[j] == TOKEN_STRING) < start + removed)
+        j++;
+
+    JamLexer lx;
+    jam_lexer_init(&lx, source, length);
+    int line = line_index(stream, pos);
+    lx.pos = pos;
+    lx.line = line + 1;
+    lx.col = pos - line_start(stream, line) + 1;
+    TokenStream fresh;
+    if (start_token_stream(&fresh, source, length, inserted / 4 + 16) != 0)
+        goto failed;
+    int resume = stream->count; // first old token kept after the new ones
+    while (1)
+    {
+        Token t = jam_lexer_next(&lx);
+        if (push_token(&fresh, t) != 0)
         {
-            advance();
-            return create_token(TOKEN_DELIM_COMMA, ",", tokenLine, tokenCol);
+            free_token_stream(&fresh);
+            goto failed;
         }
-        case ':':
+        if (t.type == TOKEN_EOF)
+            break;
+        if (lx.pos < start + inserted)
+            continue;
+        while (j < stream->count - 1 && shifted_end(stream, j, source, delta) < lx.pos)
+            j++;
+        if (j < stream->count - 1 && shifted_end(stream, j, source, delta) == lx.pos)
         {
-            advance();
-            return create_token(TOKEN_DELIM_COLON, ":", tokenLine, tokenCol);
+            resume = j + 1;
+            break;
         }
-        case ';':
+    }
+
+    // splice: old tokens (keep, resume) give way to the fresh ones
+    int tail = stream->count - resume;
+    int count = keep + 1 + fresh.count + tail;
+    if (count > stream->capacity)
+    {
+        int capacity = stream->capacity;
+        while (capacity < count)
+            capacity *= 2;
+        if (grow_token_stream(stream, capacity) != 0)
         {
-            advance();
-            return create_token(TOKEN_DELIM_SEMICOLON, ";", tokenLine, tokenCol);
+            free_token_stream(&fresh);
+            goto failed;
         }
-        case '.':
+    }
+    int at = keep + 1;
+    int moved = at + fresh.count;
+    // move the pending shift's boundary to resume: settle the kept tokens
+    // below at, or unsettle tail tokens the last edit left behind it
+    int *offsets = stream->offsets;
+    int from = stream->shiftFrom, by = stream->shiftBy;
+    if (by != 0)
+    {
+        for (int k = from; k < at; k++)
+            offsets[k] += by;
+        for (int k = resume; k < from && k < stream->count; k++)
+            offsets[k] -= by;
+    }
+    if (moved != resume)
+    {
+        memmove(stream->values + moved, stream->values + resume, tail * sizeof(TokenValue));
+        memmove(stream->offsets + moved, stream->offsets + resume, tail * sizeof(int));
+        memmove(stream->lengths + moved, stream->lengths + resume, tail * sizeof(int));
+        memmove(stream->types + moved, stream->types + resume, tail);
+    }
+    stream->shiftFrom = moved;
+    stream->shiftBy = by + delta;
+    memcpy(stream->values + at, fresh.values, fresh.count * sizeof(TokenValue));
+    memcpy(stream->offsets + at, fresh.offsets, fresh.count * sizeof(int));
+    memcpy(stream->lengths + at, fresh.lengths, fresh.count * sizeof(int));
+    memcpy(stream->types + at, fresh.types, fresh.count);
+    stream->count = count;
+    changed->first = at;
+    changed->removed = resume - at;
+    changed->inserted = fresh.count;
+    free_token_stream(&fresh);
+
+    stream->source = source;
+    stream->sourceLength = (int)length;
+    if (!freshLines && splice_line_starts(stream, source, start, removed, inserted) != 0)
+    {
+        free(stream->lineStarts);
+        stream->lineStarts = NULL; // rebuilt on the next token_position()
+        stream->lineCount = 0;
+    }
+    return count;
+
+failed:
+    if (freshLines)
+    {
+        // the table describes the new text, which the stream does not yet
+        free(stream->lineStarts);
+        stream->lineStarts = NULL;
+        stream->lineCount = 0;
+    }
+    return -1;
+}
+// fixed spelling of operators, delimiters and keywords; NULL for literal tokens
+static const char *const tokenSpellings[TOKEN_TYPE_COUNT] = {
+#define TOKEN(name, spelling) [name] = spelling,
+#define KEYWORD(name, spelling) [name] = spelling,
+#define PUNCT1(name, spelling, c) [name] = spelling,
+#define PUNCT2(name, spelling, c1, c2) [name] = spelling,
+#include "tokens.def"
+};
+const char *token_spelling(TokenType type)
+{
+    return (unsigned)type < TOKEN_TYPE_COUNT ? tokenSpellings[type] : NULL;
+}
+// heap copy of a raw lexeme slice
+static char *slice_text(const char *lexeme, int length)
+{
+    char *text = (char *)malloc(length + 1);
+    if (!text)
+        return NULL;
+    memcpy(text, lexeme, length);
+    text[length] = '\0';
+    return text;
+}
+// decode escapes of raw[0..length) into out, which needs length + 1 bytes
+static int decode_string(const char *raw, int length, char *value)
+{
+    int out = 0;
+    for (int i = 0; i < length; i++)
+    {
+        if (raw[i] == '\\' && i + 1 < length)
         {
-            advance();
-            return create_token(TOKEN_DELIM_DOT, ".", tokenLine, tokenCol);
-        }
-        default:
-            // Handle unrecognized characters.
-            fprintf(stderr, "Unrecognized character: '%c' at line %d, col %d\n", c, tokenLine, tokenCol);
-            advance();
-            break;
+            i++;
+            switch (raw[i])
+            {
+            case 'n':
+                value[out++] = '\n';
+                break;
+            case 't':
+                value[out++] = '\t';
+                break;
+            default:
+                // \\, \" and unrecognized escapes keep the escaped char
+                value[out++] = raw[i];
+                break;
+            }
         }
+        else
+            value[out++] = raw[i];
     }
-    return create_token(TOKEN_EOF, "EOF", lexer.line, lexer.col);
+    value[out] = '\0';
+    return out;
+}
+// decode the escape sequences of a raw string slice into a fresh heap string
+static char *slice_string_value(const char *raw, int length)
+{
+    char *value = (char *)malloc(length + 1);
+    if (!value)
+        return NULL;
+    decode_string(raw, length, value);
+    return value;
+}
+// heap copy of the raw lexeme, for names that must outlive the source buffer
+char *token_text(const char *source, const Token *token)
+{
+    return slice_text(source + token->offset, token->length);
+}
+// compare the raw lexeme with a NUL-terminated string without copying
+int token_equals(const char *source, const Token *token, const char *text)
+{
+    return keyword_is(source + token->offset, token->length, text);
+}
+// decode the escape sequences of a string token into a fresh heap string
+char *token_string_value(const char *source, const Token *token)
+{
+    return slice_string_value(source + token->offset, token->length);
+}
+int token_equals_at(const TokenStream *stream, int index, const char *text)
+{
+    return keyword_is(stream->source + token_offset(stream, index), stream->lengths[index], text);
+}
+char *token_string_value_at(const TokenStream *stream, int index)
+{
+    return slice_string_value(stream->source + token_offset(stream, index), stream->lengths[index]);
+}
+int token_string_decode_at(const TokenStream *stream, int index, char *out)
+{
+    return decode_string(stream->source + token_offset(stream, index), stream->lengths[index], out);
 }
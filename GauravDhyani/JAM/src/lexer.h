@@ -17,80 +17,217 @@
 
 
 #ifndef LEXER_H
+#include "intern.h"
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
 #include<ctype.h>
+#include<pthread.h>
 
 
 /* 
  * TokenType: Enum of all token types that our lexer can produce.
+ * Generated from the token specification in tokens.def.
  */
 typedef enum {
-    TOKEN_EOF,
-    TOKEN_IDENTIFIER,
-    TOKEN_NUMBER,
-    TOKEN_STRING,
-    TOKEN_KEYWORD_FN,
-    TOKEN_KEYWORD_IF,
-    TOKEN_KEYWORD_ELSE,
-    TOKEN_KEYWORD_VAR,
-    TOKEN_KEYWORD_RETURN,
-    TOKEN_KEYWORD_IMPORT,
-    TOKEN_KEYWORD_LOOP,
-    TOKEN_KEYWORD_FORLOOP,
-    TOKEN_KEYWORD_INT,
-    TOKEN_KEYWORD_FLOAT,
-    TOKEN_KEYWORD_BOOL,
-    TOKEN_OPERATOR_PLUS,
-    TOKEN_OPERATOR_MINUS,
-    TOKEN_OPERATOR_MUL,
-    TOKEN_OPERATOR_DIV,
-    TOKEN_OPERATOR_MOD,
-    TOKEN_OPERATOR_ASSIGN,
-    TOKEN_OPERATOR_EQ,
-    TOKEN_OPERATOR_NEQ,
-    TOKEN_OPERATOR_LT,
-    TOKEN_OPERATOR_LTE,
-    TOKEN_OPERATOR_GT,
-    TOKEN_OPERATOR_GTE,
-    TOKEN_OPERATOR_AND,
-    TOKEN_OPERATOR_OR,
-    TOKEN_OPERATOR_NOT,
-    TOKEN_DELIM_OPEN_PAREN,
-    TOKEN_DELIM_CLOSE_PAREN,
-    TOKEN_DELIM_OPEN_BRACE,
-    TOKEN_DELIM_CLOSE_BRACE,
-    TOKEN_DELIM_OPEN_SQUARE,
-    TOKEN_DELIM_CLOSE_SQUARE,
-    TOKEN_DELIM_COMMA,
-    TOKEN_DELIM_COLON,
-    TOKEN_DELIM_SEMICOLON,
-    TOKEN_DELIM_DOT,
-    TOKEN_ARROW,
-    TOKEN_KEYWORD_VOID,
-    TOKEN_KEYWORD_STRUCT,
-    TOKEN_KEYWORD_STRING,
-    TOKEN_KEYWORD_TRUE,
-    TOKEN_KEYWORD_FALSE,
-    TOKEN_KEYWORD_NULL
+#define TOKEN(name, spelling) name,
+#define KEYWORD(name, spelling) name,
+#define PUNCT1(name, spelling, c) name,
+#define PUNCT2(name, spelling, c1, c2) name,
+#include "tokens.def"
+    TOKEN_TYPE_COUNT
 } TokenType;
 
+/* 
+ * TokenValue: Decoded payload of a token: the value of an integer or float
+ * literal, or the interned name of an identifier in a TokenStream.
+ */
+typedef union {
+    Atom atom;
+    int i;
+    double f;
+} TokenValue;
+
 /* 
  * Token: A struct that represents a token produced by the lexer.
+ * Tokens do not own their text; they slice the source buffer they were lexed from.
  * type: The type of the token.
- * lexeme: The string that the token represents.
+ * offset: Byte offset of the lexeme in the source buffer. For strings this is
+ *         the first byte after the opening quote.
+ * length: Length of the lexeme in bytes (string quotes excluded, escapes still raw).
  * line: The line number in the source code where the token was found.
  * col: The column number in the source code where the token was found.
+ * value: i for TOKEN_INT and f for TOKEN_FLOAT, decoded once by the lexer.
  */
 
 typedef struct {
     TokenType type;
-    char* lexeme;
+    int offset;
+    int length;
     int line;
     int col;
+    TokenValue value;
 } Token;
+
+/*
+ * TokenStream: All tokens of one source buffer as parallel arrays (struct of
+ * arrays) sharing one allocation, always terminated by a TOKEN_EOF token.
+ * source: The buffer the tokens slice; must outlive the stream.
+ * types: TokenType of each token, one byte per token.
+ * offsets, lengths: Lexeme slice of each token, as in Token. Read offsets
+ *                   through token_offset(): an edit leaves the shift of the
+ *                   tokens after it pending in shiftFrom and shiftBy.
+ * values: Decoded value of each numeric literal and interned name (atom) of
+ *         each identifier; unused for other tokens.
+ * Line and column are not stored; token_position() derives them from the
+ * offset through a table of line starts built on first use.
+ */
+typedef struct {
+    const char *source;
+    int sourceLength;
+    unsigned char *types;
+    TokenValue *values;
+    int *offsets;
+    int *lengths;
+    int count;
+    int capacity;
+    int *lineStarts; // lazily built by token_position()
+    int lineCount;
+    int shiftFrom; // offsets[i] for i >= shiftFrom still lack shiftBy
+    int shiftBy;
+    int lineShiftFrom; // the same for lineStarts
+    int lineShiftBy;
+} TokenStream;
+
+// source offset of token i of a stream
+static inline int token_offset(const TokenStream *stream, int i)
+{
+    return stream->offsets[i] + (i >= stream->shiftFrom ? stream->shiftBy : 0);
+}
+
+/*
+ * JamLexer: State of one lexing pass over a source buffer.
+ * Each context is independent, so several sources can be lexed at once,
+ * including on different threads.
+ * quiet: Count diagnostics instead of printing them (speculative lexing).
+ * errors, errorPos: Number of diagnostics so far and the source offset of
+ *                   the last one.
+ */
+typedef struct {
+    const char *source;
+    int length;
+    int line, pos, col;
+    int quiet;
+    int errors;
+    int errorPos;
+} JamLexer;
+
+/*
+ * JamStreamLexer: Lexes a file descriptor through a fixed-size window, so
+ * memory use does not grow with the input. Comments may be any length;
+ * a single token (e.g. a string literal) must fit in the window.
+ * window: Buffered input, NUL-padded; returned tokens slice it and stay
+ *         valid only until the next call. base + token.offset is the
+ *         absolute byte offset of a token, while line/col are absolute.
+ * error: Set on a read error or a token longer than the window.
+ */
+#define JAM_STREAM_WINDOW (64 * 1024)
+
+typedef struct {
+    JamLexer lexer; // positions are relative to window
+    char *window;
+    int capacity;
+    size_t base;
+    int fd;
+    int eof;
+    int error;
+    int state; // inside a comment that continues past the window
+} JamStreamLexer;
+
+/*
+ * TokenPipe: Tokens of one source buffer handed from a lexer thread to a
+ * single consumer through a lock-free ring, so lexing overlaps with parsing
+ * and token memory stays at the ring size whatever the length of the file.
+ * ring: A TokenStream over the slots; token number i of the source lives in
+ *       slot i & mask. Its source is the whole buffer, so the *_at helpers
+ *       and token_position() work on a slot index.
+ * head: Tokens published so far, stored by the lexer thread only.
+ * tail: Tokens the consumer is done with; their slots may be refilled.
+ * done: The EOF token has been published (or lexing had to stop early).
+ * status: -1 if the lexer ran out of memory; it then ends the stream early.
+ */
+typedef struct {
+    TokenStream ring;
+    int mask;
+    int head;
+    int tail;
+    int done;
+    int stop;
+    int status;
+    JamLexer lexer;
+    pthread_t thread;
+} TokenPipe;
+void jam_lexer_init(JamLexer *lexer, const char *source, size_t length);
+Token jam_lexer_next(JamLexer *lexer);
+int jam_stream_init(JamStreamLexer *stream, int fd, size_t window);
+Token jam_stream_next(JamStreamLexer *stream);
+void jam_stream_free(JamStreamLexer *stream);
+// single global lexer kept for existing callers; not thread-safe
 void initlexer(char *source);
-Token *get_next_token(void);
+Token get_next_token(void);
+int tokenize(const char *source, TokenStream *stream);
+int tokenize_n(const char *source, size_t length, TokenStream *stream);
+// tokenize_n() on several threads at once; threads <= 0 uses every online CPU.
+// Opt-in: no caller uses it by default until splitlexbench shows it scaling
+int tokenize_parallel(const char *source, size_t length, TokenStream *stream, int threads);
+void free_token_stream(TokenStream *stream);
+// start lexing source on a new thread into a ring of capacity tokens (a power
+// of two, at least 64); 0 on success, -1 when out of memory or threads
+int token_pipe_start(TokenPipe *pipe, const char *source, size_t length, int capacity);
+// wait until token index has been published or the stream has ended;
+// returns the number of tokens published
+int token_pipe_wait(TokenPipe *pipe, int index);
+// hand the slots of every token before index back to the lexer
+void token_pipe_release(TokenPipe *pipe, int index);
+// stop the lexer if it is still running, join it and free the ring; -1 if
+// it ran out of memory, so the consumer saw the stream end early
+int token_pipe_finish(TokenPipe *pipe);
+// bring a stream up to date after an edit replaced old bytes [start, start +
+// removed) with the inserted bytes now at source[start, start + inserted);
+// source is the whole edited buffer. Only the tokens around the edit are
+// relexed; the shift of the later ones is left pending and settled a bit at
+// a time, for the tokens between one edit and the next. An edit that keeps
+// the token count therefore costs the edit, not the file, while one that
+// adds or drops tokens still moves the arrays of the tokens after it. The
+// old text is never read, so it may have been edited in place or freed
+// already. Returns the new token count, or -1 with the stream left as it was.
+int retokenize_edit(TokenStream *stream, const char *source, size_t length, int start, int removed, int inserted);
+/*
+ * TokenEdit: The tokens an edit changed: old tokens [first, first + removed)
+ * were replaced by the new tokens [first, first + inserted). Tokens before
+ * first kept their index, later ones moved by inserted - removed.
+ */
+typedef struct {
+    int first;
+    int removed;
+    int inserted;
+} TokenEdit;
+// retokenize_edit() that also says which tokens changed
+int retokenize_edit_tokens(TokenStream *stream, const char *source, size_t length, int start, int removed, int inserted,
+                           TokenEdit *changed);
+// apply the shift edits left pending, so offsets[] holds plain source
+// offsets again, e.g. before comparing the arrays of two streams
+void settle_token_offsets(TokenStream *stream);
+void token_position(TokenStream *stream, int index, int *line, int *col);
+const char *token_spelling(TokenType type);
+TokenType keyword_type(const char *lexeme, int len);
+char *token_text(const char *source, const Token *token);
+int token_equals(const char *source, const Token *token, const char *text);
+char *token_string_value(const char *source, const Token *token);
+// the same helpers for token number index of a stream
+int token_equals_at(const TokenStream *stream, int index, const char *text);
+char *token_string_value_at(const TokenStream *stream, int index);
+// decode into caller memory of at least lengths[index] + 1 bytes; returns the length
+int token_string_decode_at(const TokenStream *stream, int index, char *out);
 #define LEXER_H
 #endif
\ No newline at end of file
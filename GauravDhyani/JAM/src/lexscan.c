@@ -0,0 +1,312 @@
+#include "lexscan.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEXSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// -------------------------
+// Scalar kernels
+// -------------------------
+
+static size_t scalar_whitespace(const char *p, size_t n)
+{
+    size_t i = 0;
+    while (i < n && (p[i] == ' ' || (unsigned char)(p[i] - '\t') <= '\r' - '\t'))
+        i++;
+    return i;
+}
+
+static size_t scalar_line_end(const char *p, size_t n)
+{
+    const char *nl = memchr(p, '\n', n);
+    return nl ? (size_t)(nl - p) : n;
+}
+
+static size_t scalar_block_end(const char *p, size_t n)
+{
+    for (size_t i = 0; i + 1 < n; i++)
+        if (p[i] == '-' && p[i + 1] == '*')
+            return i;
+    return n;
+}
+
+static size_t scalar_string_end(const char *p, size_t n)
+{
+    size_t i = 0;
+    while (i < n && p[i] != '"' && p[i] != '\\')
+        i++;
+    return i;
+}
+
+static size_t scalar_newlines(const char *p, size_t n, size_t *last)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+        if (p[i] == '\n')
+        {
+            count++;
+            *last = i;
+        }
+    return count;
+}
+
+#ifdef LEXSCAN_X86
+
+// -------------------------
+// SSE2 kernels (16 bytes per step)
+// -------------------------
+
+// mask of bytes that are ' ' or in '\t'..'\r'
+__attribute__((target("sse2"))) static inline int sse2_space_mask(__m128i v)
+{
+    __m128i ctrl = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    __m128i isCtrl = _mm_cmpeq_epi8(_mm_max_epu8(ctrl, _mm_set1_epi8('\r' - '\t')), _mm_set1_epi8('\r' - '\t'));
+    __m128i isSpace = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    return _mm_movemask_epi8(_mm_or_si128(isCtrl, isSpace));
+}
+
+__attribute__((target("sse2"))) static size_t sse2_whitespace(const char *p, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        int stop = ~sse2_space_mask(_mm_loadu_si128((const __m128i *)(p + i))) & 0xFFFF;
+        if (stop)
+            return i + __builtin_ctz(stop);
+    }
+    return i + scalar_whitespace(p + i, n - i);
+}
+
+__attribute__((target("sse2"))) static size_t sse2_line_end(const char *p, size_t n)
+{
+    size_t i = 0;
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16)
+    {
+        int hit = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), nl));
+        if (hit)
+            return i + __builtin_ctz(hit);
+    }
+    return i + scalar_line_end(p + i, n - i);
+}
+
+__attribute__((target("sse2"))) static size_t sse2_block_end(const char *p, size_t n)
+{
+    size_t i = 0;
+    const __m128i dash = _mm_set1_epi8('-');
+    const __m128i star = _mm_set1_epi8('*');
+    // the shifted load reads p[i + 16], so keep one byte of slack
+    for (; i + 17 <= n; i += 16)
+    {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), dash);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 1)), star);
+        int hit = _mm_movemask_epi8(_mm_and_si128(a, b));
+        if (hit)
+            return i + __builtin_ctz(hit);
+    }
+    return i + scalar_block_end(p + i, n - i);
+}
+
+__attribute__((target("sse2"))) static size_t sse2_string_end(const char *p, size_t n)
+{
+    size_t i = 0;
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        int hit = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)));
+        if (hit)
+            return i + __builtin_ctz(hit);
+    }
+    return i + scalar_string_end(p + i, n - i);
+}
+
+__attribute__((target("sse2,popcnt"))) static size_t sse2_newlines(const char *p, size_t n, size_t *last)
+{
+    size_t i = 0, count = 0;
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16)
+    {
+        unsigned hit = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), nl));
+        if (hit)
+        {
+            count += __builtin_popcount(hit);
+            *last = i + 31 - __builtin_clz(hit);
+        }
+    }
+    size_t tailLast;
+    size_t tail = scalar_newlines(p + i, n - i, &tailLast);
+    if (tail)
+        *last = i + tailLast;
+    return count + tail;
+}
+
+// -------------------------
+// AVX2 kernels (32 bytes per step)
+// -------------------------
+
+__attribute__((target("avx2"))) static size_t avx2_whitespace(const char *p, size_t n)
+{
+    size_t i = 0;
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i span = _mm256_set1_epi8('\r' - '\t');
+    const __m256i space = _mm256_set1_epi8(' ');
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i ctrl = _mm256_sub_epi8(v, tab);
+        __m256i isCtrl = _mm256_cmpeq_epi8(_mm256_max_epu8(ctrl, span), span);
+        __m256i isSpace = _mm256_cmpeq_epi8(v, space);
+        unsigned stop = ~(unsigned)_mm256_movemask_epi8(_mm256_or_si256(isCtrl, isSpace));
+        if (stop)
+            return i + __builtin_ctz(stop);
+    }
+    return i + scalar_whitespace(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t avx2_line_end(const char *p, size_t n)
+{
+    size_t i = 0;
+    const __m256i nl = _mm256_set1_epi8('\n');
+    for (; i + 32 <= n; i += 32)
+    {
+        unsigned hit = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), nl));
+        if (hit)
+            return i + __builtin_ctz(hit);
+    }
+    return i + scalar_line_end(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t avx2_block_end(const char *p, size_t n)
+{
+    size_t i = 0;
+    const __m256i dash = _mm256_set1_epi8('-');
+    const __m256i star = _mm256_set1_epi8('*');
+    for (; i + 33 <= n; i += 32)
+    {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), dash);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i + 1)), star);
+        unsigned hit = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+        if (hit)
+            return i + __builtin_ctz(hit);
+    }
+    return i + scalar_block_end(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t avx2_string_end(const char *p, size_t n)
+{
+    size_t i = 0;
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i slash = _mm256_set1_epi8('\\');
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        unsigned hit = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash)));
+        if (hit)
+            return i + __builtin_ctz(hit);
+    }
+    return i + scalar_string_end(p + i, n - i);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t avx2_newlines(const char *p, size_t n, size_t *last)
+{
+    size_t i = 0, count = 0;
+    const __m256i nl = _mm256_set1_epi8('\n');
+    for (; i + 32 <= n; i += 32)
+    {
+        unsigned hit = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), nl));
+        if (hit)
+        {
+            count += __builtin_popcount(hit);
+            *last = i + 31 - __builtin_clz(hit);
+        }
+    }
+    size_t tailLast;
+    size_t tail = scalar_newlines(p + i, n - i, &tailLast);
+    if (tail)
+        *last = i + tailLast;
+    return count + tail;
+}
+
+#endif // LEXSCAN_X86
+
+// -------------------------
+// Runtime dispatch
+// -------------------------
+
+typedef struct {
+    size_t (*whitespace)(const char *, size_t);
+    size_t (*line_end)(const char *, size_t);
+    size_t (*block_end)(const char *, size_t);
+    size_t (*string_end)(const char *, size_t);
+    size_t (*newlines)(const char *, size_t, size_t *);
+} ScanKernels;
+
+static const ScanKernels scalarKernels = {
+    scalar_whitespace, scalar_line_end, scalar_block_end, scalar_string_end, scalar_newlines};
+#ifdef LEXSCAN_X86
+static const ScanKernels sse2Kernels = {
+    sse2_whitespace, sse2_line_end, sse2_block_end, sse2_string_end, sse2_newlines};
+static const ScanKernels avx2Kernels = {
+    avx2_whitespace, avx2_line_end, avx2_block_end, avx2_string_end, avx2_newlines};
+#endif
+
+// NULL until the first call picks the best level for this CPU. Lexers on
+// several threads may race to pick it; they all store the same table, and
+// the atomic accesses keep that race well-defined.
+static const ScanKernels *kernels = NULL;
+static ScanLevel currentLevel = SCAN_SCALAR;
+
+ScanLevel scan_best_level(void)
+{
+#ifdef LEXSCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return SCAN_AVX2;
+    if (__builtin_cpu_supports("sse2") && __builtin_cpu_supports("popcnt"))
+        return SCAN_SSE2;
+#endif
+    return SCAN_SCALAR;
+}
+
+void scan_set_level(ScanLevel level)
+{
+    ScanLevel best = scan_best_level();
+    if (level > best)
+        level = best;
+    const ScanKernels *chosen = &scalarKernels;
+#ifdef LEXSCAN_X86
+    if (level == SCAN_AVX2)
+        chosen = &avx2Kernels;
+    else if (level == SCAN_SSE2)
+        chosen = &sse2Kernels;
+#endif
+    __atomic_store_n(&currentLevel, level, __ATOMIC_RELAXED);
+    __atomic_store_n(&kernels, chosen, __ATOMIC_RELEASE);
+}
+
+static inline const ScanKernels *active(void)
+{
+    const ScanKernels *k = __atomic_load_n(&kernels, __ATOMIC_ACQUIRE);
+    if (!k)
+    {
+        scan_set_level(SCAN_AVX2);
+        k = __atomic_load_n(&kernels, __ATOMIC_ACQUIRE);
+    }
+    return k;
+}
+
+ScanLevel scan_level(void)
+{
+    active();
+    return __atomic_load_n(&currentLevel, __ATOMIC_RELAXED);
+}
+
+size_t scan_whitespace(const char *p, size_t n) { return active()->whitespace(p, n); }
+size_t scan_line_end(const char *p, size_t n) { return active()->line_end(p, n); }
+size_t scan_block_end(const char *p, size_t n) { return active()->block_end(p, n); }
+size_t scan_string_end(const char *p, size_t n) { return active()->string_end(p, n); }
+size_t count_newlines(const char *p, size_t n, size_t *last) { return active()->newlines(p, n, last); }
@@ -0,0 +1,39 @@
+#ifndef LEXSCAN_H
+#define LEXSCAN_H
+
+#include <stddef.h>
+
+/*
+ * Bulk scanning kernels used by the lexer to jump over runs of bytes that
+ * produce no tokens (whitespace, comment bodies, plain string characters).
+ * Every kernel looks at p[0..n) only and returns the index of the first
+ * significant byte, or n if there is none.
+ *
+ * SSE2 and AVX2 versions are picked at runtime from the CPU features; the
+ * scalar versions are used everywhere else.
+ */
+
+typedef enum {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+} ScanLevel;
+
+// first byte that is not ' ', '\t', '\n', '\v', '\f' or '\r'
+size_t scan_whitespace(const char *p, size_t n);
+// first '\n' (end of a ** line comment)
+size_t scan_line_end(const char *p, size_t n);
+// first '-' that is followed by '*' (end of a *- -* block comment)
+size_t scan_block_end(const char *p, size_t n);
+// first '"' or '\\' inside a string literal
+size_t scan_string_end(const char *p, size_t n);
+// number of '\n' in p[0..n); *last receives the index of the last one
+size_t count_newlines(const char *p, size_t n, size_t *last);
+
+// best level supported by this CPU, and the level currently in use
+ScanLevel scan_best_level(void);
+ScanLevel scan_level(void);
+// force a level (clamped to what the CPU supports), mainly for benchmarks
+void scan_set_level(ScanLevel level);
+
+#endif // LEXSCAN_H
@@ -0,0 +1,676 @@
+#include "moduleloader.h"
+#include "sourceloader.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MODULE_MAX_THREADS 16
+// A script this large is compiled on more than one thread. With three CPUs
+// or more it is lexed with tokenize_n() and its function bodies are parsed
+// in parallel; otherwise it is parsed while a second thread lexes it,
+// through a ring of MODULE_PIPE_TOKENS tokens (about 1 MB) instead of a
+// whole token array. Smaller scripts are lexed, then parsed.
+// tokenize_parallel() is not used: it has yet to beat tokenize_n() in
+// splitlexbench.
+#define MODULE_THREADED_MIN_BYTES (256 * 1024)
+#define MODULE_PARALLEL_MIN_CPUS 3
+#define MODULE_PIPE_TOKENS (64 * 1024)
+
+// -------------------------
+// Content hash
+// -------------------------
+
+// 64-bit hash of a loaded source, eight bytes at a time; the zero padding
+// after the text makes reading a whole last word safe. Not cryptographic:
+// the cache compares the text itself before it takes a match.
+static uint64_t content_hash(const char *data, size_t length)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ length;
+    for (size_t i = 0; i < length; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof word);
+        h = (h ^ word) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// -------------------------
+// Compiled modules
+// -------------------------
+
+// getType() returns shared statics for scalar types and allocates the rest
+static void free_signature_type(Type *type)
+{
+    if (!type)
+        return;
+    switch (type->kind)
+    {
+    case TYPE_ARRAY:
+        free_signature_type(type->array.elementType);
+        break;
+    case TYPE_TUPLE:
+        for (int i = 0; i < type->tuple.count; i++)
+            free_signature_type(type->tuple.elements[i]);
+        free(type->tuple.elements);
+        break;
+    case TYPE_STRUCT:
+        for (int i = 0; i < type->structType.count; i++)
+            free_signature_type(type->structType.fieldTypes[i]);
+        free(type->structType.fieldNames);
+        free(type->structType.fieldTypes);
+        break;
+    case TYPE_FUNCTION:
+        for (int i = 0; i < type->function.paramCount; i++)
+            free_signature_type(type->function.paramTypes[i]);
+        free(type->function.paramTypes);
+        free_signature_type(type->function.returnType);
+        break;
+    default:
+        return;
+    }
+    free(type);
+}
+
+static void free_module(Module *m)
+{
+    for (int i = 0; i < m->signatureCount; i++)
+        free_signature_type(m->signatures[i].type);
+    free(m->signatures);
+    free(m->imports);
+    freeParser(&m->parser);
+    free_token_stream(&m->tokens);
+    release_source(&m->source);
+    free(m);
+}
+
+// collect the import paths and function signatures of a parsed module
+static int index_module(Module *m)
+{
+    int count = m->ast->data.program.count;
+    ASTNode **statements = m->ast->data.program.statements;
+    m->imports = malloc((count + 1) * sizeof *m->imports);
+    m->signatures = malloc((count + 1) * sizeof *m->signatures);
+    if (!m->imports || !m->signatures)
+        return -1;
+
+    for (int i = 0; i < count; i++)
+    {
+        ASTNode *node = statements[i];
+        if (node->type == AST_IMPORT)
+        {
+            m->imports[m->importCount++] = node->data.string;
+        }
+        else if (node->type == AST_FUNCTION)
+        {
+            int paramCount = node->data.function.paramCount;
+            Type **paramTypes = malloc((paramCount + 1) * sizeof *paramTypes);
+            if (!paramTypes)
+                return -1;
+            for (int k = 0; k < paramCount; k++)
+                paramTypes[k] = getType(node->data.function.params[k]->data.varDecl.varType);
+
+            ModuleSignature *s = &m->signatures[m->signatureCount++];
+            s->name = node->data.function.name;
+            s->function = node;
+            s->type = createFunctionType(paramTypes, paramCount, getType(node->data.function.returnType));
+        }
+    }
+    return 0;
+}
+
+// lex and parse one source, taking it over; NULL only when out of memory.
+// Parse errors are kept in the module. The script itself is parsed eagerly,
+// as it is lexed if it is large; libraries are parsed lazily.
+static Module *compile_module(SourceBuffer *source, uint64_t hash, int script)
+{
+    Module *m = calloc(1, sizeof *m);
+    if (!m)
+    {
+        release_source(source);
+        return NULL;
+    }
+    m->hash = hash;
+    m->length = source->length;
+    m->source = *source;
+
+    TokenPipe pipe;
+    int threaded = script && m->source.length >= MODULE_THREADED_MIN_BYTES;
+    int parallel = threaded && sysconf(_SC_NPROCESSORS_ONLN) >= MODULE_PARALLEL_MIN_CPUS;
+    if (parallel)
+    {
+        if (tokenize_n(m->source.data, m->source.length, &m->tokens) < 0)
+        {
+            free_module(m);
+            return NULL;
+        }
+        initParser(&m->parser, &m->tokens);
+        m->ast = parseScriptParallel(&m->parser, 0).ast;
+    }
+    else if (threaded && token_pipe_start(&pipe, m->source.data, m->source.length, MODULE_PIPE_TOKENS) == 0)
+    {
+        initPipelinedParser(&m->parser, &pipe);
+        m->ast = parseScript(&m->parser).ast;
+        if (token_pipe_finish(&pipe) != 0)
+        {
+            free_module(m);
+            return NULL;
+        }
+    }
+    else
+    {
+        if (tokenize_n(m->source.data, m->source.length, &m->tokens) < 0)
+        {
+            free_module(m);
+            return NULL;
+        }
+        initParser(&m->parser, &m->tokens);
+        m->parser.lazyBodies = !script;
+        // sharing slows parsing down, and only pays off in a module the
+        // cache keeps; the script itself never is
+        m->parser.shareExpressions = !script;
+        m->ast = parseScript(&m->parser).ast;
+    }
+    if (script)
+    {
+        // the AST points into neither the tokens nor the source
+        free_token_stream(&m->tokens);
+        release_source(&m->source);
+    }
+
+    if (m->ast && m->parser.diagnosticCount == 0 && index_module(m) != 0)
+    {
+        free_module(m);
+        return NULL;
+    }
+    return m;
+}
+
+int load_function_bodies(Module *m)
+{
+    int firstDiagnostic = m->parser.diagnosticCount;
+    int status = buildFunctionBodies(&m->parser, m->ast, 0);
+    if (m->parser.diagnosticCount > firstDiagnostic)
+    {
+        ParseResult result;
+        result.ast = NULL;
+        result.diagnostics = m->parser.diagnostics + firstDiagnostic;
+        result.diagnosticCount = m->parser.diagnosticCount - firstDiagnostic;
+        printParseDiagnostics(&result);
+        status = -1;
+    }
+    return status;
+}
+
+static int module_ok(const Module *m)
+{
+    return m && m->ast && m->parser.diagnosticCount == 0;
+}
+
+// -------------------------
+// Cache
+// -------------------------
+
+void init_module_cache(ModuleCache *cache)
+{
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->slots = NULL;
+    cache->capacity = 0;
+    cache->count = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+}
+
+void free_module_cache(ModuleCache *cache)
+{
+    for (size_t i = 0; i < cache->capacity; i++)
+        if (cache->slots[i])
+            free_module(cache->slots[i]);
+    free(cache->slots);
+    cache->slots = NULL;
+    cache->capacity = 0;
+    cache->count = 0;
+    pthread_mutex_destroy(&cache->lock);
+}
+
+// the cached module with the content of source, or NULL; the caller holds
+// the lock. Cached modules keep their source, so a hash match is confirmed
+// against the text and a collision is only a miss.
+static Module *cache_find(ModuleCache *cache, uint64_t hash, const SourceBuffer *source)
+{
+    if (cache->capacity == 0)
+        return NULL;
+    size_t mask = cache->capacity - 1;
+    for (size_t i = hash & mask; cache->slots[i]; i = (i + 1) & mask)
+    {
+        Module *m = cache->slots[i];
+        if (m->hash == hash && m->length == source->length &&
+            memcmp(m->source.data, source->data, source->length) == 0)
+            return m;
+    }
+    return NULL;
+}
+
+static void cache_place(Module **slots, size_t capacity, Module *m)
+{
+    size_t i = m->hash & (capacity - 1);
+    while (slots[i])
+        i = (i + 1) & (capacity - 1);
+    slots[i] = m;
+}
+
+// the caller holds the lock; -1 when out of memory
+static int cache_insert(ModuleCache *cache, Module *m)
+{
+    if ((cache->count + 1) * 2 > cache->capacity)
+    {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+        Module **slots = calloc(capacity, sizeof *slots);
+        if (!slots)
+            return -1;
+        for (size_t i = 0; i < cache->capacity; i++)
+            if (cache->slots[i])
+                cache_place(slots, capacity, cache->slots[i]);
+        free(cache->slots);
+        cache->slots = slots;
+        cache->capacity = capacity;
+    }
+    cache_place(cache->slots, cache->capacity, m);
+    cache->count++;
+    return 0;
+}
+
+// the compiled module for a file: a lookup when its content was seen before
+static Module *load_module(ModuleCache *cache, const char *path, int *error)
+{
+    SourceBuffer source;
+    if (load_source(path, &source) != 0)
+    {
+        *error = errno ? errno : EIO;
+        return NULL;
+    }
+    uint64_t hash = content_hash(source.data, source.length);
+
+    pthread_mutex_lock(&cache->lock);
+    Module *m = cache_find(cache, hash, &source);
+    if (m)
+        cache->hits++;
+    pthread_mutex_unlock(&cache->lock);
+
+    if (m)
+    {
+        release_source(&source);
+    }
+    else
+    {
+        Module *compiled = compile_module(&source, hash, 0);
+        pthread_mutex_lock(&cache->lock);
+        // another worker may have compiled the same content in the meantime
+        m = compiled ? cache_find(cache, hash, &compiled->source) : NULL;
+        if (!m && compiled && cache_insert(cache, compiled) == 0)
+        {
+            m = compiled;
+            compiled = NULL;
+            cache->misses++;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        if (compiled)
+            free_module(compiled);
+    }
+    if (!m)
+        *error = ENOMEM;
+    return m;
+}
+
+// -------------------------
+// Import graph
+// -------------------------
+
+typedef struct {
+    ModuleCache *cache;
+    ModuleGraph *graph;
+    pthread_mutex_t lock; // guards graph, next and busy
+    pthread_cond_t wake;
+    int next;             // first node no worker has claimed
+    int busy;             // workers loading a node
+} LoadJob;
+
+// an import path relative to the importing file, canonical when it exists
+static char *resolve_import(const char *importer, const char *path)
+{
+    size_t dir = 0;
+    if (path[0] != '/' && strcmp(importer, "-") != 0)
+    {
+        const char *slash = strrchr(importer, '/');
+        dir = slash ? (size_t)(slash - importer) + 1 : 0;
+    }
+    size_t length = strlen(path);
+    char *joined = malloc(dir + length + 1);
+    if (!joined)
+        return NULL;
+    memcpy(joined, importer, dir);
+    memcpy(joined + dir, path, length + 1);
+
+    char *real = realpath(joined, NULL);
+    if (!real)
+        return joined; // loading it will report why
+    free(joined);
+    return real;
+}
+
+// resolved paths of every import of m; NULL when there are none or out of memory
+static char **resolve_imports(const char *importer, const Module *m)
+{
+    if (!module_ok(m) || m->importCount == 0)
+        return NULL;
+    char **paths = calloc(m->importCount, sizeof *paths);
+    if (!paths)
+        return NULL;
+    for (int i = 0; i < m->importCount; i++)
+    {
+        if (!(paths[i] = resolve_import(importer, m->imports[i])))
+        {
+            for (int k = 0; k < i; k++)
+                free(paths[k]);
+            free(paths);
+            return NULL;
+        }
+    }
+    return paths;
+}
+
+// index of the node for path, added if new; takes ownership of path
+static int add_node(ModuleGraph *graph, char *path)
+{
+    for (int i = 0; i < graph->count; i++)
+    {
+        if (strcmp(graph->nodes[i].path, path) == 0)
+        {
+            free(path);
+            return i;
+        }
+    }
+    if (graph->count == graph->capacity)
+    {
+        int capacity = graph->capacity ? graph->capacity * 2 : 8;
+        ModuleNode *nodes = realloc(graph->nodes, capacity * sizeof *nodes);
+        if (!nodes)
+        {
+            free(path);
+            return -1;
+        }
+        graph->nodes = nodes;
+        graph->capacity = capacity;
+    }
+    ModuleNode *node = &graph->nodes[graph->count];
+    memset(node, 0, sizeof *node);
+    node->path = path;
+    return graph->count++;
+}
+
+// record a loaded node and queue what it imports; the caller holds the lock
+static void link_node(ModuleGraph *graph, int index, Module *m, int error, char **imports)
+{
+    graph->nodes[index].module = m;
+    graph->nodes[index].error = error;
+    if (!module_ok(m) || m->importCount == 0)
+        return;
+
+    int *deps = imports ? malloc(m->importCount * sizeof *deps) : NULL;
+    if (!deps)
+    {
+        graph->failed = 1;
+        if (imports)
+            for (int i = 0; i < m->importCount; i++)
+                free(imports[i]);
+        free(imports);
+        return;
+    }
+    int depCount = 0;
+    for (int i = 0; i < m->importCount; i++)
+    {
+        int dep = add_node(graph, imports[i]);
+        if (dep < 0)
+            graph->failed = 1;
+        else
+            deps[depCount++] = dep;
+    }
+    free(imports);
+    graph->nodes[index].deps = deps;
+    graph->nodes[index].depCount = depCount;
+}
+
+static void *load_worker(void *arg)
+{
+    LoadJob *job = arg;
+    ModuleGraph *graph = job->graph;
+    pthread_mutex_lock(&job->lock);
+    while (1)
+    {
+        if (job->next < graph->count && !graph->failed)
+        {
+            int index = job->next++;
+            const char *path = graph->nodes[index].path; // never moves, unlike the node
+            job->busy++;
+            pthread_mutex_unlock(&job->lock);
+
+            int error = 0;
+            Module *m = load_module(job->cache, path, &error);
+            char **imports = resolve_imports(path, m);
+
+            pthread_mutex_lock(&job->lock);
+            job->busy--;
+            link_node(graph, index, m, error, imports);
+            pthread_cond_broadcast(&job->wake);
+        }
+        else if (job->busy == 0)
+        {
+            // nothing queued and nothing running that could queue more
+            pthread_cond_broadcast(&job->wake);
+            break;
+        }
+        else
+        {
+            pthread_cond_wait(&job->wake, &job->lock);
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+// load every node the script's imports reach, on up to one thread per CPU
+static void load_imports(ModuleCache *cache, ModuleGraph *graph)
+{
+    LoadJob job;
+    job.cache = cache;
+    job.graph = graph;
+    job.next = 1;
+    job.busy = 0;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.wake, NULL);
+
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > graph->count - 1)
+        threads = graph->count - 1;
+    if (threads > MODULE_MAX_THREADS)
+        threads = MODULE_MAX_THREADS;
+
+    // the calling thread is one of the workers
+    pthread_t workers[MODULE_MAX_THREADS];
+    int started = 0;
+    for (; started < threads - 1; started++)
+        if (pthread_create(&workers[started], NULL, load_worker, &job) != 0)
+            break;
+    load_worker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    pthread_cond_destroy(&job.wake);
+    pthread_mutex_destroy(&job.lock);
+}
+
+// depth-first, so every module lands in the order after all it imports
+static void order_node(ModuleGraph *graph, int index)
+{
+    ModuleNode *node = &graph->nodes[index];
+    if (node->state == 2)
+        return;
+    if (node->state == 1)
+    {
+        if (graph->cycle < 0)
+            graph->cycle = index;
+        return;
+    }
+    node->state = 1;
+    for (int i = 0; i < node->depCount; i++)
+        order_node(graph, node->deps[i]);
+    node->state = 2;
+    graph->order[graph->orderCount++] = index;
+}
+
+// find a function that two modules both define, using their signature tables
+static int find_conflict(ModuleGraph *graph)
+{
+    size_t total = 0;
+    for (int i = 0; i < graph->orderCount; i++)
+        total += graph->nodes[graph->order[i]].module->signatureCount;
+    size_t capacity = 16;
+    while (capacity < total * 2)
+        capacity *= 2;
+
+    struct { Atom name; int node; } *seen = calloc(capacity, sizeof *seen);
+    if (!seen)
+        return -1;
+    for (int i = 0; i < graph->orderCount && !graph->conflict; i++)
+    {
+        int index = graph->order[i];
+        const Module *m = graph->nodes[index].module;
+        for (int k = 0; k < m->signatureCount; k++)
+        {
+            Atom name = m->signatures[k].name;
+            size_t slot = ((uintptr_t)name >> 4) * 0x9e3779b97f4a7c15ull & (capacity - 1);
+            while (seen[slot].name && seen[slot].name != name)
+                slot = (slot + 1) & (capacity - 1);
+            if (!seen[slot].name)
+            {
+                seen[slot].name = name;
+                seen[slot].node = index;
+            }
+            else if (seen[slot].node != index)
+            {
+                graph->conflict = name;
+                graph->conflictNodes[0] = seen[slot].node;
+                graph->conflictNodes[1] = index;
+                break;
+            }
+        }
+    }
+    free(seen);
+    return 0;
+}
+
+int load_module_graph(ModuleCache *cache, const char *filename, ModuleGraph *graph)
+{
+    memset(graph, 0, sizeof *graph);
+    graph->cycle = -1;
+
+    char *path = strcmp(filename, "-") == 0 ? NULL : realpath(filename, NULL);
+    if (!path)
+        path = strdup(filename);
+    if (!path || add_node(graph, path) < 0)
+    {
+        graph->failed = 1;
+        return -1;
+    }
+
+    // the script itself is compiled here and not cached: it is usually run
+    // once, unlike the libraries it imports
+    SourceBuffer source;
+    Module *root = NULL;
+    int error = 0;
+    if (load_source(filename, &source) != 0)
+    {
+        error = errno ? errno : EIO;
+    }
+    else
+    {
+        root = compile_module(&source, content_hash(source.data, source.length), 1);
+        if (!root)
+            error = ENOMEM;
+    }
+    link_node(graph, 0, root, error, resolve_imports(graph->nodes[0].path, root));
+    if (graph->count > 1)
+        load_imports(cache, graph);
+
+    int ok = !graph->failed;
+    for (int i = 0; i < graph->count; i++)
+        ok &= module_ok(graph->nodes[i].module);
+    if (!ok)
+        return -1;
+
+    graph->order = malloc(graph->count * sizeof *graph->order);
+    if (!graph->order)
+    {
+        graph->failed = 1;
+        return -1;
+    }
+    order_node(graph, 0);
+    if (graph->cycle >= 0)
+        return -1;
+    if (find_conflict(graph) != 0)
+        graph->failed = 1;
+    return graph->failed || graph->conflict ? -1 : 0;
+}
+
+void print_module_errors(const ModuleGraph *graph)
+{
+    if (graph->failed)
+        fprintf(stderr, "Module loading failed: out of memory.\n");
+    for (int i = 0; i < graph->count; i++)
+    {
+        const ModuleNode *node = &graph->nodes[i];
+        if (node->error)
+        {
+            if (i == 0)
+                fprintf(stderr, "Script open error: %s\n", strerror(node->error));
+            else
+                fprintf(stderr, "Import error: '%s': %s\n", node->path, strerror(node->error));
+            continue;
+        }
+        if (!node->module || module_ok(node->module))
+            continue;
+        if (i > 0)
+            fprintf(stderr, "In module '%s':\n", node->path);
+        ParseResult result;
+        result.ast = node->module->ast;
+        result.diagnostics = node->module->parser.diagnostics;
+        result.diagnosticCount = node->module->parser.diagnosticCount;
+        printParseDiagnostics(&result);
+    }
+    if (graph->cycle >= 0)
+        fprintf(stderr, "Import error: '%s' is part of an import cycle\n", graph->nodes[graph->cycle].path);
+    if (graph->conflict)
+        fprintf(stderr, "Import error: function '%s' is defined in both '%s' and '%s'\n", graph->conflict,
+                graph->nodes[graph->conflictNodes[0]].path, graph->nodes[graph->conflictNodes[1]].path);
+}
+
+void free_module_graph(ModuleGraph *graph)
+{
+    if (graph->count > 0 && graph->nodes[0].module)
+        free_module(graph->nodes[0].module);
+    for (int i = 0; i < graph->count; i++)
+    {
+        free(graph->nodes[i].path);
+        free(graph->nodes[i].deps);
+    }
+    free(graph->nodes);
+    free(graph->order);
+    memset(graph, 0, sizeof *graph);
+    graph->cycle = -1;
+}
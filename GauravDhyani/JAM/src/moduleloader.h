@@ -0,0 +1,101 @@
+#ifndef MODULE_LOADER_H
+#define MODULE_LOADER_H
+
+#include "parser.h"
+#include "semanticanalyser.h"
+#include "sourceloader.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Module loader for `import "path";`.
+ *
+ * Loading a script builds its import graph: every module is read, hashed
+ * and, unless a module with the same content is already in the cache,
+ * lexed and parsed. Modules discovered at the same time are compiled in
+ * parallel on a small thread pool. A compiled module (AST plus signature
+ * table) is cached by content hash, so importing a library that other
+ * scripts already loaded costs a read, a hash and a lookup, not a reparse.
+ *
+ * Import paths are relative to the importing file. Imported modules run
+ * before the module importing them, each once per script, and share its
+ * global scope. Their function bodies are parsed lazily, on first call, so
+ * loading a large library costs little more than the code that runs.
+ * Imported modules are parsed with shareExpressions on, so an expression
+ * repeated throughout generated code is one node in the cached AST. The
+ * script itself is not cached, and is parsed without it.
+ */
+
+typedef struct {
+    Atom name;
+    ASTNode *function; // the declaration, in the module's AST
+    Type *type;        // TYPE_FUNCTION from the declared parameter and return types
+} ModuleSignature;
+
+typedef struct {
+    uint64_t hash;        // content hash of the source
+    size_t length;        // source length, part of the cache key
+    Parser parser;        // owns the AST and its diagnostics
+    ASTNode *ast;         // NULL when parsing had to stop
+    SourceBuffer source;  // source and tokens stay while bodies are lazy
+    TokenStream tokens;
+    const char **imports; // paths as written in the import statements
+    int importCount;
+    ModuleSignature *signatures; // one per top-level function
+    int signatureCount;
+} Module;
+
+typedef struct {
+    pthread_mutex_t lock;
+    Module **slots; // open addressing on the hash, NULL marks an empty slot
+    size_t capacity;
+    size_t count;
+    size_t hits;
+    size_t misses;
+} ModuleCache;
+
+typedef struct {
+    char *path;     // resolved against the importing module's directory
+    Module *module; // NULL if the file could not be loaded
+    int error;      // errno from loading, 0 otherwise
+    int *deps;      // indices of the nodes this module imports
+    int depCount;
+    int state;      // used while ordering
+} ModuleNode;
+
+typedef struct {
+    ModuleNode *nodes; // nodes[0] is the script itself; it is not cached
+    int count;
+    int capacity;
+    int *order;        // node indices, every module after the ones it imports
+    int orderCount;
+    int failed;        // ran out of memory while building the graph
+    int cycle;         // a node on an import cycle, or -1
+    Atom conflict;     // a function defined by two modules, or NULL
+    int conflictNodes[2];
+} ModuleGraph;
+
+// C++ linkage-aware section
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void init_module_cache(ModuleCache *cache);
+void free_module_cache(ModuleCache *cache);
+// load filename and everything it imports, directly or not. 0 when every
+// module parsed cleanly and links, -1 otherwise; see print_module_errors().
+// The graph is filled in either way and must be freed.
+int load_module_graph(ModuleCache *cache, const char *filename, ModuleGraph *graph);
+// everything that made load_module_graph() fail, to stderr
+void print_module_errors(const ModuleGraph *graph);
+// release the graph and the script's own module; cached modules stay
+void free_module_graph(ModuleGraph *graph);
+// parse every function body of m still left lazy; -1 if any has errors
+int load_function_bodies(Module *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODULE_LOADER_H
@@ -1,8 +1,14 @@
 #include "parser.h"
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
 
 // --- Forward declarations ---
 ASTNode *parseProgram(Parser *p);
@@ -11,22 +17,22 @@ static ASTNode *parseFunction(Parser *p);
 static ASTNode *parseStatement(Parser *p);
 static ASTNode *parseVarDecl(Parser *p);
 static ASTNode *parseExpression(Parser *p);
-static ASTNode *parseUnary(Parser *p);
-static ASTNode *parseBinaryExpr(Parser *p, int prec);
-static ASTNode *parsePrimary(Parser *p);
-static ASTNode *parseIfStatement(Parser *p);
 static ASTNode *parseType(Parser *p);
-static ASTNode *parseBlock(Parser *p);
-static int getPrecedence(Token *op);
+static ASTNode *parseBlockBody(Parser *p, const char *closeMessage);
+static void skipBlock(Parser *p, const char *closeMessage);
+static ASTNode *parseLazyBody(LazyBody *lazy);
+static int getPrecedence(TokenType op);
 bool check(Parser *p, TokenType t);
-static ASTNode* parseAssignment(Parser *p);
-static ASTNode *parseWhileStatement(Parser *p);
-static ASTNode *parseForStatement(Parser *p);
-static bool isAtEnd(Parser *p);
 
-static int getPrecedence(Token *op) {
+// a script with this many syntax errors is not worth parsing further
+#define PARSER_MAX_DIAGNOSTICS 100
+// buildFunctionBodies(): thread cap, and functions a thread must have to be worth starting
+#define PARSER_MAX_THREADS 16
+#define PARSER_BODIES_PER_THREAD 32
+
+static int getPrecedence(TokenType op) {
     // Return an int indicating operator precedence, for example:
-    switch (op->type) {
+    switch (op) {
         case TOKEN_OPERATOR_OR: return 1;
         case TOKEN_OPERATOR_AND: return 2;
         case TOKEN_OPERATOR_EQ:
@@ -44,23 +50,190 @@ static int getPrecedence(Token *op) {
     }
 }
 
+static OpCode binaryOpCode(TokenType op) {
+    switch (op) {
+        case TOKEN_OPERATOR_OR: return OP_OR;
+        case TOKEN_OPERATOR_AND: return OP_AND;
+        case TOKEN_OPERATOR_EQ: return OP_EQ;
+        case TOKEN_OPERATOR_NEQ: return OP_NEQ;
+        case TOKEN_OPERATOR_LT: return OP_LT;
+        case TOKEN_OPERATOR_LTE: return OP_LTE;
+        case TOKEN_OPERATOR_GT: return OP_GT;
+        case TOKEN_OPERATOR_GTE: return OP_GTE;
+        case TOKEN_OPERATOR_PLUS: return OP_ADD;
+        case TOKEN_OPERATOR_MINUS: return OP_SUB;
+        case TOKEN_OPERATOR_MUL: return OP_MUL;
+        case TOKEN_OPERATOR_DIV: return OP_DIV;
+        default: return OP_MOD; // the only other operator with a precedence
+    }
+}
+
+static const char *const opSpellings[OP_COUNT] = {
+    "=", "+", "-", "*", "/", "%", "<", "<=", ">", ">=", "==", "!=", "&&", "||", "-", "!",
+};
+
+const char *opSpelling(OpCode op) {
+    return (unsigned)op < OP_COUNT ? opSpellings[op] : "?";
+}
+
 // --- Lexer lookahead helpers ---
-static Token *peek(Parser *p)
+// Tokens are indices into the stream's parallel arrays; -1 means past the end.
+// A pipelined parser reads a token at most PARSER_PIPE_BEHIND tokens back,
+// so the lexer may refill every slot before that.
+#define PARSER_PIPE_BEHIND 16
+
+// slot of token tok in the stream's arrays
+static inline int slot(const Parser *p, int tok)
+{
+    return tok & p->tokenMask;
+}
+// wait for the lexer thread to publish the current token, giving back the
+// slots behind it; false once the stream has ended
+static bool pullTokens(Parser *p)
+{
+    token_pipe_release(p->pipe, p->current - PARSER_PIPE_BEHIND);
+    int published = token_pipe_wait(p->pipe, p->current);
+    // come back for more within a quarter ring, so the lexer never waits
+    // on a full ring for long
+    int step = (p->pipe->mask + 1) / 4;
+    p->tokenCount = published - p->current > step ? p->current + step : published;
+    return p->current < p->tokenCount;
+}
+static inline bool haveToken(Parser *p)
+{
+    return p->current < p->tokenCount || (p->pipe && pullTokens(p));
+}
+static int peek(Parser *p)
+{
+    return (haveToken(p)
+                ? p->current
+                : -1);
+}
+static int advance(Parser *p)
+{
+    return (haveToken(p)
+                ? p->current++
+                : -1);
+}
+static TokenType peekType(Parser *p)
+{
+    return (haveToken(p)
+                ? (TokenType)p->types[slot(p, p->current)]
+                : TOKEN_EOF);
+}
+// Lexeme of a token for diagnostics: fixed spelling, or the sliced source text
+static const char *lexemeOf(Parser *p, int tok, int *len)
+{
+    const char *spelling = tok >= 0 ? token_spelling((TokenType)p->types[slot(p, tok)]) : "EOF";
+    if (spelling) {
+        *len = (int)strlen(spelling);
+        return spelling;
+    }
+    *len = p->stream->lengths[slot(p, tok)];
+    return p->source + token_offset(p->stream, slot(p, tok));
+}
+// Line and column of a token for diagnostics, -1 past the end
+static void positionOf(Parser *p, int tok, int *line, int *col)
 {
-    return (p->current < p->tokenCount
-                ? p->tokens[p->current]
-                : NULL);
+    if (tok < 0) {
+        *line = *col = -1;
+        return;
+    }
+    token_position(p->stream, slot(p, tok), line, col);
 }
-static Token *advance(Parser *p)
+
+// --- Diagnostics ---
+// The AST lives in the arena, so unwinding with longjmp leaks nothing; a
+// half-built statement is simply left unreferenced until the arena resets.
+static void addDiagnostic(Parser *p, int tok, const char *message)
 {
-    return (p->current < p->tokenCount
-                ? p->tokens[p->current++]
-                : NULL);
+    if (p->diagnosticCount == p->diagnosticCapacity) {
+        int capacity = p->diagnosticCapacity ? p->diagnosticCapacity * 2 : 8;
+        ParseDiagnostic *grown = realloc(p->diagnostics, capacity * sizeof(ParseDiagnostic));
+        if (!grown)
+            return;
+        p->diagnostics = grown;
+        p->diagnosticCapacity = capacity;
+    }
+    size_t length = strlen(message) + 1;
+    char *copy = arena_alloc(&p->arena, length);
+    ParseDiagnostic *d = &p->diagnostics[p->diagnosticCount++];
+    d->token = tok;
+    positionOf(p, tok, &d->line, &d->col);
+    d->message = copy ? memcpy(copy, message, length) : "Out of memory";
 }
+
+// give up on the whole parse; parseProgram() returns NULL
+static _Noreturn void parserAbort(Parser *p, int tok, const char *message)
+{
+    addDiagnostic(p, tok, message);
+    longjmp(*p->abort, 1);
+}
+
+// record a syntax error at token tok, then unwind to the statement being parsed
+static _Noreturn void syntaxError(Parser *p, int tok, const char *format, ...)
+{
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof message, format, args);
+    va_end(args);
+    addDiagnostic(p, tok, message);
+    if (p->diagnosticCount >= PARSER_MAX_DIAGNOSTICS)
+        parserAbort(p, tok, "Too many errors, giving up");
+    longjmp(p->recover ? *p->recover : *p->abort, 1);
+}
+
+// Panic mode: skip to just past the ';' ending the broken statement, or past
+// the '}' of a block it opened, or up to the '}' closing the enclosing block
+static void synchronize(Parser *p)
+{
+    int depth = 0;
+    while (peekType(p) != TOKEN_EOF) {
+        TokenType t = peekType(p);
+        if (t == TOKEN_DELIM_OPEN_BRACE) {
+            depth++;
+        } else if (t == TOKEN_DELIM_CLOSE_BRACE) {
+            if (depth == 0)
+                return;
+            if (--depth == 0) {
+                advance(p);
+                return;
+            }
+        } else if (t == TOKEN_DELIM_SEMICOLON && depth == 0) {
+            advance(p);
+            return;
+        }
+        advance(p);
+    }
+}
+
+// Run parse for one statement. On a syntax error inside it, skip ahead and
+// return NULL so the caller's statement list carries on with the next one.
+static ASTNode *parseRecovering(Parser *p, ASTNode *(*parse)(Parser *))
+{
+    jmp_buf here;
+    jmp_buf *outer = p->recover;
+    int start = p->current;
+    int base = p->scratchCount;
+    p->recover = &here;
+    if (setjmp(here)) {
+        p->recover = outer;
+        p->scratchCount = base;
+        p->exprCount = 0;
+        synchronize(p);
+        if (p->current == start && peekType(p) != TOKEN_EOF)
+            advance(p); // e.g. a stray '}' at top level
+        return NULL;
+    }
+    ASTNode *node = parse(p);
+    p->recover = outer;
+    return node;
+}
+
 static int match(Parser *p, TokenType t)
 {
-    Token *tok = peek(p);
-    if (tok && tok->type == t)
+    if (check(p, t))
     {
         advance(p);
         return 1;
@@ -71,211 +244,407 @@ static void consume(Parser *p, TokenType t, const char *msg)
 {
     if (!match(p, t))
     {
-        Token *tok = peek(p);
-        fprintf(stderr,
-                "Parse error at line %d col %d: %s (got '%s')\n",
-                tok ? tok->line : -1,
-                tok ? tok->col : -1,
-                msg,
-                tok ? tok->lexeme : "EOF");
-        exit(1);
+        int tok = peek(p);
+        int len;
+        const char *lexeme = lexemeOf(p, tok, &len);
+        syntaxError(p, tok, "%s (got '%.*s')", msg, len, lexeme);
     }
 }
 
 bool check(Parser *p, TokenType t) {
-    Token *curr = peek(p);
-    if (!curr) return false;
-    return curr->type == t;
+    return haveToken(p) && p->types[slot(p, p->current)] == t;
 }
 
 // --- AST node constructors ---
-static ASTNode* makeNode(ASTNodeType type) {
-    ASTNode* node = malloc(sizeof(ASTNode));
-    if (!node) {
-        fprintf(stderr, "Out of memory\n");
-        exit(1);
-    }
+// Everything a parse produces lives in the parser's arena
+static void *parserAlloc(Parser *p, size_t size) {
+    void *block = arena_alloc(&p->arena, size);
+    if (!block)
+        parserAbort(p, peek(p), "Out of memory");
+    return block;
+}
+
+static ASTNode* makeNode(Parser *p, ASTNodeType type) {
+    ASTNode* node = parserAlloc(p, sizeof(ASTNode));
     node->type = type;
     memset(&node->data, 0, sizeof(node->data));  // zero init union
     return node;
 }
 
-static ASTNode *binaryNode(ASTNode *left, Token *op, ASTNode *right)
+// --- Hash-consing ---
+// With p->shareExpressions, a number, an identifier, or a unary or binary
+// operator other than '=' over shared operands is looked up in p->shared
+// before it is built, and an identical node already built is used instead.
+// Operands are shared before the operator over them, so two such subtrees
+// are identical exactly when their roots have the same operator and the same
+// operand nodes: the table is keyed on that and never walks a subtree.
+// Calls, array literals, strings and assignments always get a node of their
+// own, and so does any operator over one of them; two occurrences of one
+// node are therefore the same side-effect-free expression.
+static uint64_t sharedHash(const ASTNode *n)
 {
-    ASTNode *n = makeNode(AST_BINARY_EXPR);
-    n->data.binary.left = left;
-    n->data.binary.op = op;
-    n->data.binary.right = right;
-    return n;
+    uint64_t key[3] = {(uint64_t)n->type, 0, 0};
+    switch (n->type) {
+    case AST_NUMBER:
+        // the bits of either kind of value, through the union
+        key[1] = (uint64_t)n->data.number.kind << 32 | (uint32_t)n->data.number.intValue;
+        break;
+    case AST_IDENTIFIER:
+        key[1] = (uintptr_t)n->data.identifier;
+        break;
+    case AST_UNARY_EXPR:
+        key[1] = n->data.unary.op;
+        key[2] = (uintptr_t)n->data.unary.operand;
+        break;
+    default: // AST_BINARY_EXPR
+        key[0] |= (uint64_t)n->data.binary.op << 8;
+        key[1] = (uintptr_t)n->data.binary.left;
+        key[2] = (uintptr_t)n->data.binary.right;
+        break;
+    }
+    uint64_t h = 0;
+    for (int i = 0; i < 3; i++)
+        h = (h ^ key[i]) * 0x9E3779B97F4A7C15ull;
+    // the slot comes from the low bits, which the products alone leave
+    // depending only on the low bits of aligned pointers
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ull;
+    return h ^ h >> 27;
 }
 
-// --- Parsing functions ---
-
-// primary ::= NUMBER | STRING | IDENTIFIER | '(' expression ')'
-static ASTNode *parsePrimary(Parser *p)
+static bool sameShared(const ASTNode *a, const ASTNode *b)
 {
-    Token *t = peek(p);
-    if (!t)
-        return NULL;
-
-    if (t->type == TOKEN_NUMBER)
-    {
-        advance(p);
-        ASTNode *node = makeNode(AST_NUMBER);
-        node->data.number = atoi(t->lexeme);
-        return node;
-    }
-
-    if (t->type == TOKEN_STRING)
-    {
-        advance(p);
-        ASTNode *node = makeNode(AST_STRING);
-        node->data.string = strdup(t->lexeme);
-        return node;
+    if (a->type != b->type)
+        return false;
+    switch (a->type) {
+    case AST_NUMBER:
+        return a->data.number.kind == b->data.number.kind && a->data.number.intValue == b->data.number.intValue;
+    case AST_IDENTIFIER:
+        return a->data.identifier == b->data.identifier;
+    case AST_UNARY_EXPR:
+        return a->data.unary.op == b->data.unary.op && a->data.unary.operand == b->data.unary.operand;
+    default:
+        return a->data.binary.op == b->data.binary.op && a->data.binary.left == b->data.binary.left &&
+               a->data.binary.right == b->data.binary.right;
     }
+}
 
-    if (t->type == TOKEN_IDENTIFIER)
-    {
-        char *idName = strdup(t->lexeme);
-        advance(p);
-
-        if (match(p, TOKEN_DELIM_OPEN_PAREN))
-        {
-            ASTNode **args = NULL;
-            int argCount = 0;
-
-            if (!check(p, TOKEN_DELIM_CLOSE_PAREN))
-            {
-                do
-                {
-                    ASTNode *arg = parseExpression(p);
-                    args = realloc(args, sizeof(ASTNode *) * (argCount + 1));
-                    args[argCount++] = arg;
-                } while (match(p, TOKEN_DELIM_COMMA));
-            }
+// a slot of p->shared; the hash spares looking at the nodes of other slots
+typedef struct SharedNode {
+    uint64_t hash;
+    ASTNode *node; // NULL marks an empty slot
+} SharedNode;
 
-            consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')' after function call arguments");
+// the slot of the node identical to n, or the empty slot it would go in
+static SharedNode *sharedSlot(Parser *p, const ASTNode *n, uint64_t hash)
+{
+    int mask = p->sharedCapacity - 1;
+    for (int i = (int)(hash & mask);; i = (i + 1) & mask) {
+        SharedNode *slot = &p->shared[i];
+        if (!slot->node || (slot->hash == hash && sameShared(slot->node, n)))
+            return slot;
+    }
+}
 
-            ASTNode *callNode = makeNode(AST_FUNCTION_CALL);
-            callNode->data.call.callee = makeNode(AST_IDENTIFIER);
-            callNode->data.call.callee->data.identifier = idName;
-            callNode->data.call.arguments = args;
-            callNode->data.call.argCount = argCount;
-            return callNode;
-        }
+// whether n is a node of p->shared (numbers and identifiers always are)
+static bool isShared(Parser *p, const ASTNode *n)
+{
+    if (!n)
+        return false;
+    if (n->type == AST_NUMBER || n->type == AST_IDENTIFIER)
+        return true;
+    if (n->type != AST_UNARY_EXPR && n->type != AST_BINARY_EXPR)
+        return false;
+    return p->sharedCount > 0 && sharedSlot(p, n, sharedHash(n))->node == n;
+}
 
-        ASTNode *idNode = makeNode(AST_IDENTIFIER);
-        idNode->data.identifier = idName;
-        return idNode;
+static void growShared(Parser *p)
+{
+    int capacity = p->sharedCapacity ? p->sharedCapacity * 2 : 256;
+    SharedNode *old = p->shared;
+    int oldCapacity = p->sharedCapacity;
+    p->shared = calloc(capacity, sizeof(SharedNode));
+    if (!p->shared) {
+        p->shared = old;
+        parserAbort(p, peek(p), "Out of memory");
     }
-
-    if (match(p, TOKEN_DELIM_OPEN_PAREN))
-    {
-        ASTNode *expr = parseExpression(p);
-        consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')'");
-        return expr;
+    p->sharedCapacity = capacity;
+    int mask = capacity - 1;
+    for (int i = 0; i < oldCapacity; i++) {
+        if (!old[i].node)
+            continue;
+        int j = (int)(old[i].hash & mask);
+        while (p->shared[j].node)
+            j = (j + 1) & mask;
+        p->shared[j] = old[i];
     }
-    if (match(p, TOKEN_DELIM_OPEN_SQUARE)) {
-        ASTNode **elements = NULL;
-        int count = 0;
-
-        if (!check(p, TOKEN_DELIM_CLOSE_SQUARE)) {
-            do {
-                ASTNode *elem = parseExpression(p);
-                elements = realloc(elements, sizeof(ASTNode *) * (count + 1));
-                elements[count++] = elem;
-            } while (match(p, TOKEN_DELIM_COMMA));
-        }
-
-        consume(p, TOKEN_DELIM_CLOSE_SQUARE, "Expected ']' after array literal");
+    free(old);
+}
 
-        ASTNode *arrayNode = makeNode(AST_ARRAY_LITERAL);
-        arrayNode->data.arrayLiteral.elements = elements;
-        arrayNode->data.arrayLiteral.elementCount = count;
-        return arrayNode;
+// an arena copy of the expression node n, or the identical one already built
+static ASTNode *expressionNode(Parser *p, const ASTNode *n)
+{
+    bool share = p->shareExpressions;
+    if (share && n->type == AST_UNARY_EXPR)
+        share = isShared(p, n->data.unary.operand);
+    else if (share && n->type == AST_BINARY_EXPR)
+        share = n->data.binary.op != OP_ASSIGN && isShared(p, n->data.binary.left) &&
+                isShared(p, n->data.binary.right);
+    if (!share) {
+        ASTNode *node = parserAlloc(p, sizeof(ASTNode));
+        *node = *n;
+        return node;
     }
 
-    fprintf(stderr, "Unexpected token '%s' in primary expression\n", t->lexeme);
-    exit(1);
+    if ((p->sharedCount + 1) * 2 > p->sharedCapacity)
+        growShared(p);
+    uint64_t hash = sharedHash(n);
+    SharedNode *slot = sharedSlot(p, n, hash);
+    if (!slot->node) {
+        slot->node = parserAlloc(p, sizeof(ASTNode));
+        *slot->node = *n;
+        slot->hash = hash;
+        p->sharedCount++;
+    }
+    return slot->node;
 }
 
-// expression ::= term ( (+|-) term )*
-static ASTNode* parseExpression(Parser *p) {
-    return parseAssignment(p);
+static ASTNode *binaryNode(Parser *p, ASTNode *left, OpCode op, ASTNode *right)
+{
+    ASTNode n = {.type = AST_BINARY_EXPR};
+    n.data.binary.left = left;
+    n.data.binary.op = op;
+    n.data.binary.right = right;
+    return expressionNode(p, &n);
 }
 
-static Token *previous(Parser *p) {
-    if (p->current > 0)
-        return p->tokens[p->current - 1];
-    return NULL;
+// Child lists are collected on the scratch stack, which nested lists share,
+// and copied into the arena once their length is known.
+static void pushChild(Parser *p, ASTNode *child) {
+    if (p->scratchCount == p->scratchCapacity) {
+        int capacity = p->scratchCapacity ? p->scratchCapacity * 2 : 64;
+        ASTNode **scratch = realloc(p->scratch, capacity * sizeof(ASTNode *));
+        if (!scratch)
+            parserAbort(p, peek(p), "Out of memory");
+        p->scratch = scratch;
+        p->scratchCapacity = capacity;
+    }
+    p->scratch[p->scratchCount++] = child;
 }
 
-static ASTNode* parseAssignment(Parser *p) {
-    ASTNode *left = parseBinaryExpr(p, 0);
-
-    if (match(p, TOKEN_OPERATOR_ASSIGN)) { // '='
-        if (left->type != AST_IDENTIFIER) {
-            fprintf(stderr, "Invalid assignment target\n");
-            exit(1);
-        }
+// the children pushed since base, as an arena array (NULL when there are none)
+static ASTNode **popChildren(Parser *p, int base, int *count) {
+    int n = p->scratchCount - base;
+    *count = n;
+    if (n == 0)
+        return NULL;
+    ASTNode **list = parserAlloc(p, n * sizeof(ASTNode *));
+    memcpy(list, p->scratch + base, n * sizeof(ASTNode *));
+    p->scratchCount = base;
+    return list;
+}
 
-        Token *assignOp = previous(p); // '=' token
-        ASTNode *right = parseAssignment(p); // right-associative
+// --- Parsing functions ---
 
-        ASTNode *node = makeNode(AST_BINARY_EXPR);
-        node->data.binary.op = assignOp;
-        node->data.binary.left = left;
-        node->data.binary.right = right;
-        return node;
+// --- Expressions ---
+// Expressions are parsed without recursion, so a long operator chain or deep
+// nesting costs heap instead of C stack. Finished operands wait on the
+// scratch stack, where an argument or element list collects its children
+// anyway; what is still open above them (a prefix operator, a binary
+// operator waiting for its right operand, '=', '(', a call or an array
+// literal) waits on p->exprFrames.
+//
+// expression ::= assignment
+// assignment ::= binary ( '=' assignment )?      target must be an IDENTIFIER
+// binary     ::= unary ( OP unary )*             by getPrecedence(), left-associative
+// unary      ::= ( '-' | '!' ) unary | primary
+// primary    ::= INT | FLOAT | STRING | IDENTIFIER | IDENTIFIER '(' args? ')'
+//              | '(' expression ')' | '[' args? ']'
+typedef enum {
+    EXPR_UNARY,  // '-' or '!' waiting for its operand
+    EXPR_BINARY, // left operand on the scratch stack, right one to come
+    EXPR_ASSIGN, // '=' after an identifier, value to come
+    EXPR_PAREN,
+    EXPR_CALL,   // arguments collect on the scratch stack from base
+    EXPR_ARRAY,  // elements collect on the scratch stack from base
+} ExprFrameKind;
+
+typedef struct ExprFrame {
+    ExprFrameKind kind;
+    OpCode op;  // EXPR_UNARY, EXPR_BINARY
+    int prec;   // EXPR_BINARY
+    int base;   // EXPR_CALL, EXPR_ARRAY
+    Atom callee; // EXPR_CALL
+} ExprFrame;
+
+static ExprFrame *pushExprFrame(Parser *p, ExprFrameKind kind)
+{
+    if (p->exprCount == p->exprCapacity) {
+        int capacity = p->exprCapacity ? p->exprCapacity * 2 : 32;
+        ExprFrame *frames = realloc(p->exprFrames, capacity * sizeof(ExprFrame));
+        if (!frames)
+            parserAbort(p, peek(p), "Out of memory");
+        p->exprFrames = frames;
+        p->exprCapacity = capacity;
     }
-
-    return left;
+    ExprFrame *f = &p->exprFrames[p->exprCount++];
+    f->kind = kind;
+    return f;
 }
 
-static ASTNode* parseUnary(Parser *p) {
-    Token *t = peek(p);
-    if (!t) return NULL;
+static inline ASTNode *popOperand(Parser *p)
+{
+    return p->scratch[--p->scratchCount];
+}
 
-    if (t->type == TOKEN_OPERATOR_NOT || t->type == TOKEN_OPERATOR_MINUS) {
-        advance(p);
-        ASTNode *operand = parseUnary(p);
-        ASTNode *node = makeNode(AST_UNARY_EXPR);
-        node->data.unary.op = t;
-        node->data.unary.operand = operand;
-        return node;
+// the list of a finished call or array literal replaces its children
+static void closeList(Parser *p, const ExprFrame *f)
+{
+    if (f->kind == EXPR_CALL) {
+        ASTNode *call = makeNode(p, AST_FUNCTION_CALL);
+        call->data.call.callee = makeNode(p, AST_IDENTIFIER);
+        call->data.call.callee->data.identifier = f->callee;
+        call->data.call.arguments = popChildren(p, f->base, &call->data.call.argCount);
+        pushChild(p, call);
+    } else {
+        ASTNode *array = makeNode(p, AST_ARRAY_LITERAL);
+        array->data.arrayLiteral.elements = popChildren(p, f->base, &array->data.arrayLiteral.elementCount);
+        pushChild(p, array);
     }
-
-    return parsePrimary(p);
 }
 
-static ASTNode* parseBinaryExpr(Parser *p, int prec) {
-    ASTNode *left = parseUnary(p);
-
-    while (1) {
-        Token *op = peek(p);
-        int opPrec = getPrecedence(op);
+static ASTNode *parseExpression(Parser *p)
+{
+    int bottom = p->exprCount;
+    for (;;) {
+        // operand position: prefix operators and openers, then one operand
+        int t = peek(p);
+        if (t < 0) {
+            pushChild(p, NULL);
+        } else {
+            TokenType type = (TokenType)p->types[slot(p, t)];
+            if (type == TOKEN_OPERATOR_NOT || type == TOKEN_OPERATOR_MINUS) {
+                advance(p);
+                pushExprFrame(p, EXPR_UNARY)->op = type == TOKEN_OPERATOR_MINUS ? OP_NEG : OP_NOT;
+                continue;
+            }
+            if (type == TOKEN_INT || type == TOKEN_FLOAT) {
+                advance(p);
+                ASTNode node = {.type = AST_NUMBER};
+                node.data.number.kind = type;
+                if (type == TOKEN_INT)
+                    node.data.number.intValue = p->stream->values[slot(p, t)].i;
+                else
+                    node.data.number.floatValue = (float)p->stream->values[slot(p, t)].f;
+                pushChild(p, expressionNode(p, &node));
+            } else if (type == TOKEN_STRING) {
+                advance(p);
+                ASTNode *node = makeNode(p, AST_STRING);
+                node->data.string = parserAlloc(p, p->stream->lengths[slot(p, t)] + 1);
+                token_string_decode_at(p->stream, slot(p, t), node->data.string);
+                pushChild(p, node);
+            } else if (type == TOKEN_IDENTIFIER) {
+                Atom name = p->stream->values[slot(p, t)].atom;
+                advance(p);
+                if (match(p, TOKEN_DELIM_OPEN_PAREN)) {
+                    ExprFrame *f = pushExprFrame(p, EXPR_CALL);
+                    f->callee = name;
+                    f->base = p->scratchCount;
+                    if (!check(p, TOKEN_DELIM_CLOSE_PAREN))
+                        continue;
+                    advance(p);
+                    closeList(p, &p->exprFrames[--p->exprCount]);
+                } else {
+                    ASTNode node = {.type = AST_IDENTIFIER};
+                    node.data.identifier = name;
+                    pushChild(p, expressionNode(p, &node));
+                }
+            } else if (type == TOKEN_DELIM_OPEN_PAREN) {
+                advance(p);
+                pushExprFrame(p, EXPR_PAREN);
+                continue;
+            } else if (type == TOKEN_DELIM_OPEN_SQUARE) {
+                advance(p);
+                pushExprFrame(p, EXPR_ARRAY)->base = p->scratchCount;
+                if (!check(p, TOKEN_DELIM_CLOSE_SQUARE))
+                    continue;
+                advance(p);
+                closeList(p, &p->exprFrames[--p->exprCount]);
+            } else {
+                int len;
+                const char *lexeme = lexemeOf(p, t, &len);
+                syntaxError(p, t, "Unexpected token '%.*s' in primary expression", len, lexeme);
+            }
+        }
 
-        if (opPrec == 0 || opPrec <= prec)
-            break;
+        // operator position: until an operator asks for another operand
+        for (;;) {
+            while (p->exprCount > bottom && p->exprFrames[p->exprCount - 1].kind == EXPR_UNARY) {
+                ASTNode node = {.type = AST_UNARY_EXPR};
+                node.data.unary.op = p->exprFrames[--p->exprCount].op;
+                node.data.unary.operand = popOperand(p);
+                pushChild(p, expressionNode(p, &node));
+            }
 
-        advance(p);
-        ASTNode *right = parseBinaryExpr(p, opPrec);
+            TokenType type = peekType(p);
+            int prec = getPrecedence(type);
+            while (p->exprCount > bottom && p->exprFrames[p->exprCount - 1].kind == EXPR_BINARY &&
+                   (prec == 0 || p->exprFrames[p->exprCount - 1].prec >= prec)) {
+                ASTNode *right = popOperand(p);
+                ASTNode *left = popOperand(p);
+                pushChild(p, binaryNode(p, left, p->exprFrames[--p->exprCount].op, right));
+            }
+            if (prec > 0) {
+                advance(p);
+                ExprFrame *f = pushExprFrame(p, EXPR_BINARY);
+                f->op = binaryOpCode(type);
+                f->prec = prec;
+                break;
+            }
+            if (type == TOKEN_OPERATOR_ASSIGN) {
+                advance(p);
+                ASTNode *target = p->scratch[p->scratchCount - 1];
+                if (!target || target->type != AST_IDENTIFIER)
+                    syntaxError(p, p->current - 1, "Invalid assignment target");
+                pushExprFrame(p, EXPR_ASSIGN);
+                break;
+            }
+            while (p->exprCount > bottom && p->exprFrames[p->exprCount - 1].kind == EXPR_ASSIGN) {
+                ASTNode *right = popOperand(p);
+                ASTNode *left = popOperand(p);
+                p->exprCount--;
+                pushChild(p, binaryNode(p, left, OP_ASSIGN, right));
+            }
 
-        left = binaryNode(left, op, right);
+            // the innermost open '(', call or array literal gets its operand
+            if (p->exprCount == bottom)
+                return popOperand(p);
+            ExprFrame *f = &p->exprFrames[p->exprCount - 1];
+            if (f->kind == EXPR_PAREN) {
+                consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')'");
+                p->exprCount--;
+                continue;
+            }
+            if (match(p, TOKEN_DELIM_COMMA))
+                break;
+            if (f->kind == EXPR_CALL)
+                consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')' after function call arguments");
+            else
+                consume(p, TOKEN_DELIM_CLOSE_SQUARE, "Expected ']' after array literal");
+            closeList(p, &p->exprFrames[--p->exprCount]);
+        }
     }
-
-    return left;
 }
 
 // varDecl ::= 'var' IDENT [ '=' expression ] ';'
 static ASTNode *parseVarDecl(Parser *p)
 {
     advance(p); // consume 'var'
-    Token *id = peek(p);
+    int id = peek(p);
     consume(p, TOKEN_IDENTIFIER, "Expected variable name");
 
-    ASTNode *varDecl = makeNode(AST_VAR_DECL);
-    varDecl->data.varDecl.varName = strdup(id->lexeme);
+    ASTNode *varDecl = makeNode(p, AST_VAR_DECL);
+    varDecl->data.varDecl.varName = p->stream->values[slot(p, id)].atom;
 
     // Parse optional ': Type'
     if (match(p, TOKEN_DELIM_COLON)) {
@@ -293,40 +662,122 @@ static ASTNode *parseVarDecl(Parser *p)
     return varDecl;
 }
 
+// --- Statements ---
+// An if, loop or for statement is parsed without recursion too: its header
+// opens a BlockFrame on p->blocks and its block's statements are parsed in
+// the same loop, so only the nesting of for initialisers (themselves
+// statements) recurses. Each block frame remembers where its statement
+// started, and where the child statement in progress started, so a syntax
+// error is recovered from just as if each statement were parsed under its
+// own parseRecovering().
+typedef enum {
+    BLOCK_THEN,
+    BLOCK_ELSE,
+    BLOCK_LOOP, // while or for body
+} BlockKind;
+
+typedef struct BlockFrame {
+    BlockKind kind;
+    ASTNode *node;            // the if, while or for statement
+    const char *closeMessage; // for a missing '}'
+    int base;                 // its block's statements collect on the scratch stack from here
+    int start;                // first token and scratch depth of the statement
+    int scratchMark;
+    bool inChild;             // a statement of the block is being parsed
+    int childStart;
+    int childMark;
+} BlockFrame;
+
+static void openBlock(Parser *p, BlockKind kind, ASTNode *node, int start, int scratchMark, const char *closeMessage)
+{
+    if (p->blockCount == p->blockCapacity) {
+        int capacity = p->blockCapacity ? p->blockCapacity * 2 : 16;
+        BlockFrame *blocks = realloc(p->blocks, capacity * sizeof(BlockFrame));
+        if (!blocks)
+            parserAbort(p, peek(p), "Out of memory");
+        p->blocks = blocks;
+        p->blockCapacity = capacity;
+    }
+    BlockFrame *b = &p->blocks[p->blockCount++];
+    b->kind = kind;
+    b->node = node;
+    b->closeMessage = closeMessage;
+    b->base = p->scratchCount;
+    b->start = start;
+    b->scratchMark = scratchMark;
+    b->inChild = false;
+}
+
+// A simple statement, whole; or the header of a compound one up to its '{',
+// which opens a block frame and returns NULL.
+//
 // statement ::= 'return' expression ';'
 //             | varDecl
+//             | 'if' '(' expression ')' '{' statement* '}' ( 'else' '{' statement* '}' )?
+//             | 'loop' '(' expression ')' '{' statement* '}'
+//             | 'forloop' '(' statement expression ';' expression ')' '{' statement* '}'
+//             | print
 //             | expression ';'
-static ASTNode *parseStatement(Parser *p)
+static ASTNode *beginStatement(Parser *p)
 {
-    Token *t = peek(p);
-    if (!t)
+    int t = peek(p);
+    if (t < 0)
         return NULL;
+    TokenType type = (TokenType)p->types[slot(p, t)];
+    int scratchMark = p->scratchCount;
 
-    if (t->type == TOKEN_KEYWORD_RETURN) {
+    if (type == TOKEN_KEYWORD_IMPORT)
+        syntaxError(p, t, "'import' is only allowed at top level");
+
+    if (type == TOKEN_KEYWORD_RETURN) {
         advance(p);
-        ASTNode *n = makeNode(AST_RETURN);
+        ASTNode *n = makeNode(p, AST_RETURN);
         n->data.returnStmt.expr = parseExpression(p);
         consume(p, TOKEN_DELIM_SEMICOLON, "Expected ';' after return");
         return n;
     }
 
-    if (t->type == TOKEN_KEYWORD_VAR) {
+    if (type == TOKEN_KEYWORD_VAR) {
         return parseVarDecl(p);
     }
 
-    if (t->type == TOKEN_KEYWORD_IF) {
-        return parseIfStatement(p);
+    if (type == TOKEN_KEYWORD_IF) {
+        advance(p); // consume 'if'
+        consume(p, TOKEN_DELIM_OPEN_PAREN, "Expected '(' after 'if'");
+        ASTNode *node = makeNode(p, AST_IF);
+        node->data.ifStmt.condition = parseExpression(p);
+        consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')' after condition");
+        consume(p, TOKEN_DELIM_OPEN_BRACE, "Expected '{' for 'if' body");
+        openBlock(p, BLOCK_THEN, node, t, scratchMark, "Expected '}' to end 'if' body");
+        return NULL;
     }
 
-    if (t->type == TOKEN_KEYWORD_LOOP) {
-        return parseWhileStatement(p);
+    if (type == TOKEN_KEYWORD_LOOP) {
+        advance(p); // consume 'while'
+        consume(p, TOKEN_DELIM_OPEN_PAREN, "Expected '(' after 'while'");
+        ASTNode *node = makeNode(p, AST_WHILE);
+        node->data.whileStmt.condition = parseExpression(p);
+        consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')' after condition");
+        consume(p, TOKEN_DELIM_OPEN_BRACE, "Expected '{' to start block");
+        openBlock(p, BLOCK_LOOP, node, t, scratchMark, "Expected '}' to end block");
+        return NULL;
     }
 
-    if (t->type == TOKEN_KEYWORD_FORLOOP) {
-        return parseForStatement(p);
+    if (type == TOKEN_KEYWORD_FORLOOP) {
+        advance(p); // consume 'for'
+        consume(p, TOKEN_DELIM_OPEN_PAREN, "Expected '(' after 'for'");
+        ASTNode *node = makeNode(p, AST_FOR);
+        node->data.forStmt.init = parseStatement(p);
+        node->data.forStmt.condition = parseExpression(p);
+        consume(p, TOKEN_DELIM_SEMICOLON, "Expected ';' after loop condition");
+        node->data.forStmt.increment = parseExpression(p);
+        consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')' after increment");
+        consume(p, TOKEN_DELIM_OPEN_BRACE, "Expected '{' to start block");
+        openBlock(p, BLOCK_LOOP, node, t, scratchMark, "Expected '}' to end block");
+        return NULL;
     }
 
-    if (t->type == TOKEN_IDENTIFIER && strcmp(t->lexeme, "print") == 0) {
+    if (type == TOKEN_IDENTIFIER && p->stream->values[slot(p, t)].atom == p->printAtom) {
         return parsePrintStatement(p);
     }
 
@@ -335,52 +786,130 @@ static ASTNode *parseStatement(Parser *p)
     consume(p, TOKEN_DELIM_SEMICOLON, "Expected ';' after expression");
 
     // Wrap the expression in an expression statement node
-    ASTNode *stmt = makeNode(AST_EXPR_STMT);
+    ASTNode *stmt = makeNode(p, AST_EXPR_STMT);
     stmt->data.ExprStmt.expr = expr;
     return stmt;
 }
 
+// One statement with everything nested in it. A syntax error in the
+// statement itself unwinds to the caller's recovery point, as from any
+// other parse function; one in a nested statement is recovered from here.
+static ASTNode *parseStatement(Parser *p)
+{
+    int root = p->blockCount;
+    ASTNode *stmt = beginStatement(p);
+    if (p->blockCount == root)
+        return stmt;
+
+    jmp_buf here;
+    jmp_buf *outer = p->recover;
+    p->recover = &here;
+    if (setjmp(here)) {
+        BlockFrame *b = &p->blocks[p->blockCount - 1];
+        int start, mark;
+        if (b->inChild) {
+            // a statement of the innermost block failed
+            start = b->childStart;
+            mark = b->childMark;
+            b->inChild = false;
+        } else if (p->blockCount - 1 > root) {
+            // an inner if or loop failed at its '}' or 'else'
+            start = b->start;
+            mark = b->scratchMark;
+            p->blockCount--;
+        } else {
+            p->blockCount = root;
+            p->recover = outer;
+            longjmp(outer ? *outer : *p->abort, 1);
+        }
+        p->scratchCount = mark;
+        p->exprCount = 0;
+        synchronize(p);
+        if (p->current == start && peekType(p) != TOKEN_EOF)
+            advance(p); // e.g. a stray '}' at top level
+    }
+
+    for (;;) {
+        int depth = p->blockCount;
+        BlockFrame *b = &p->blocks[depth - 1];
+        if (!check(p, TOKEN_DELIM_CLOSE_BRACE) && peekType(p) != TOKEN_EOF) {
+            b->inChild = true;
+            b->childStart = p->current;
+            b->childMark = p->scratchCount;
+            ASTNode *child = beginStatement(p);
+            p->blocks[depth - 1].inChild = false;
+            if (child)
+                pushChild(p, child);
+            continue;
+        }
+
+        // the block is complete; errors from here on are its statement's
+        consume(p, TOKEN_DELIM_CLOSE_BRACE, b->closeMessage);
+        ASTNode *block = makeNode(p, AST_PROGRAM);
+        block->data.program.statements = popChildren(p, b->base, &block->data.program.count);
+        ASTNode *node = b->node;
+        if (b->kind == BLOCK_THEN) {
+            node->data.ifStmt.thenBranch = block;
+            if (match(p, TOKEN_KEYWORD_ELSE)) {
+                consume(p, TOKEN_DELIM_OPEN_BRACE, "Expected '{' for 'else' body");
+                b->kind = BLOCK_ELSE;
+                b->closeMessage = "Expected '}' to end 'else' body";
+                b->base = p->scratchCount;
+                continue;
+            }
+        } else if (b->kind == BLOCK_ELSE) {
+            node->data.ifStmt.elseBranch = block;
+        } else if (node->type == AST_WHILE) {
+            node->data.whileStmt.body = block;
+        } else {
+            node->data.forStmt.body = block;
+        }
+
+        p->blockCount--;
+        if (p->blockCount == root) {
+            p->recover = outer;
+            return node;
+        }
+        pushChild(p, node);
+    }
+}
+
 // function ::= 'fn' IDENT '(' ( param (',' param)* )? ')' ( '->' Type )? Block
 // param ::= IDENT ':' Type
 static ASTNode *parseFunction(Parser *p)
 {
     advance(p); // consume 'fn'
-    Token *name = peek(p);
+    int name = peek(p);
     consume(p, TOKEN_IDENTIFIER, "Expected function name");
-    ASTNode *fn = makeNode(AST_FUNCTION);
-    fn->data.function.name = strdup(name->lexeme);
+    ASTNode *fn = makeNode(p, AST_FUNCTION);
+    fn->data.function.name = p->stream->values[slot(p, name)].atom;
 
     consume(p, TOKEN_DELIM_OPEN_PAREN, "Expected '(' after function name");
 
-    // parse parameters
-    fn->data.function.params = NULL; // new field: array of AST_VAR_DECL or similar
-    fn->data.function.paramCount = 0;
-
+    // parse parameters into an array of AST_VAR_DECL
+    int base = p->scratchCount;
     if (!match(p, TOKEN_DELIM_CLOSE_PAREN))
     {
         do {
             // parse param
-            Token* paramName = peek(p);
+            int paramName = peek(p);
             consume(p, TOKEN_IDENTIFIER, "Expected parameter name");
+            Atom name = p->stream->values[slot(p, paramName)].atom;
 
             consume(p, TOKEN_DELIM_COLON, "Expected ':' after parameter name");
 
             ASTNode* paramType = parseType(p);
 
-            ASTNode* paramNode = makeNode(AST_VAR_DECL);
-            paramNode->data.varDecl.varName = strdup(paramName->lexeme);
+            ASTNode* paramNode = makeNode(p, AST_VAR_DECL);
+            paramNode->data.varDecl.varName = name;
             paramNode->data.varDecl.varType = paramType;
             paramNode->data.varDecl.initializer = NULL;
-
-            fn->data.function.paramCount++;
-            fn->data.function.params = realloc(
-                fn->data.function.params,
-                sizeof(ASTNode*) * fn->data.function.paramCount);
-            fn->data.function.params[fn->data.function.paramCount - 1] = paramNode;
+            pushChild(p, paramNode);
         } while (match(p, TOKEN_DELIM_COMMA));
 
         consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')' after parameters");
     }
+    fn->data.function.params = popChildren(p, base, &fn->data.function.paramCount);
 
     // parse optional return type
     if (match(p, TOKEN_ARROW)) // '->'
@@ -394,63 +923,59 @@ static ASTNode *parseFunction(Parser *p)
 
     // parse function body block
     consume(p, TOKEN_DELIM_OPEN_BRACE, "Expected '{' to begin function body");
-    fn->data.function.body = makeNode(AST_PROGRAM);
-    fn->data.function.body->data.program.statements = NULL;
-    fn->data.function.body->data.program.count = 0;
-
-    while (!match(p, TOKEN_DELIM_CLOSE_BRACE))
+    if (p->lazyBodies && !p->pipe)
     {
-        ASTNode *stmt = parseStatement(p);
-        int c = fn->data.function.body->data.program.count++;
-        fn->data.function.body->data.program.statements = realloc(
-            fn->data.function.body->data.program.statements,
-            fn->data.function.body->data.program.count * sizeof(ASTNode *));
-        fn->data.function.body->data.program.statements[c] = stmt;
+        LazyBody *lazy = parserAlloc(p, sizeof(LazyBody));
+        lazy->build = parseLazyBody;
+        lazy->context = p;
+        lazy->start = p->current;
+        skipBlock(p, "Expected '}' to end function body");
+        fn->data.function.lazyBody = lazy;
+        return fn;
     }
+    fn->data.function.body = parseBlockBody(p, "Expected '}' to end function body");
     return fn;
 }
 
 static ASTNode* parseType(Parser* p) {
-    Token* t = peek(p);
-    if (!t) {
-        fprintf(stderr, "Unexpected EOF while parsing type\n");
-        exit(1);
-    }
+    int t = peek(p);
+    if (t < 0)
+        syntaxError(p, t, "Unexpected EOF while parsing type");
 
     // Base types (keywords)
-    switch (t->type) {
+    switch (p->types[slot(p, t)]) {
         case TOKEN_KEYWORD_INT:
             advance(p);
             {
-                ASTNode* node = makeNode(AST_TYPE);
+                ASTNode* node = makeNode(p, AST_TYPE);
                 node->data.type.typeKind = AST_TYPE_INT;
                 return node;
             }
         case TOKEN_KEYWORD_FLOAT:
             advance(p);
             {
-                ASTNode* node = makeNode(AST_TYPE);
+                ASTNode* node = makeNode(p, AST_TYPE);
                 node->data.type.typeKind = AST_TYPE_FLOAT;
                 return node;
             }
         case TOKEN_KEYWORD_BOOL:
             advance(p);
             {
-                ASTNode* node = makeNode(AST_TYPE);
+                ASTNode* node = makeNode(p, AST_TYPE);
                 node->data.type.typeKind = AST_TYPE_BOOL;
                 return node;
             }
         case TOKEN_KEYWORD_STRING:
             advance(p);
             {
-                ASTNode* node = makeNode(AST_TYPE);
+                ASTNode* node = makeNode(p, AST_TYPE);
                 node->data.type.typeKind = AST_TYPE_STRING;
                 return node;
             }
         case TOKEN_KEYWORD_VOID:
             advance(p);
             {
-                ASTNode* node = makeNode(AST_TYPE);
+                ASTNode* node = makeNode(p, AST_TYPE);
                 node->data.type.typeKind = AST_TYPE_VOID;
                 return node;
             }
@@ -463,7 +988,7 @@ static ASTNode* parseType(Parser* p) {
         ASTNode* elemType = parseType(p);
         consume(p, TOKEN_DELIM_CLOSE_SQUARE, "Expected ']' after array element type");
 
-        ASTNode* arrayNode = makeNode(AST_TYPE);
+        ASTNode* arrayNode = makeNode(p, AST_TYPE);
         arrayNode->data.type.typeKind = AST_TYPE_ARRAY;
         arrayNode->data.type.elementType = elemType;
         return arrayNode;
@@ -471,369 +996,565 @@ static ASTNode* parseType(Parser* p) {
 
     // Tuple: (Type, Type, ...)
     if (match(p, TOKEN_DELIM_OPEN_PAREN)) {
-        ASTNode** elems = NULL;
-        int count = 0;
-
+        int base = p->scratchCount;
         do {
-            ASTNode* elemType = parseType(p);
-            elems = realloc(elems, sizeof(ASTNode*) * (count + 1));
-            elems[count++] = elemType;
+            pushChild(p, parseType(p));
         } while (match(p, TOKEN_DELIM_COMMA));
 
         consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')' after tuple types");
 
-        ASTNode* tupleNode = makeNode(AST_TYPE);
+        ASTNode* tupleNode = makeNode(p, AST_TYPE);
         tupleNode->data.type.typeKind = AST_TYPE_TUPLE;
-        tupleNode->data.type.tuple.elementTypes = elems;
-        tupleNode->data.type.tuple.elementCount = count;
+        tupleNode->data.type.tuple.elementTypes =
+            popChildren(p, base, &tupleNode->data.type.tuple.elementCount);
         return tupleNode;
     }
 
     // Struct type usage: "struct IDENT"
     if (match(p, TOKEN_KEYWORD_STRUCT)) {
-        Token* name = peek(p);
+        int name = peek(p);
         consume(p, TOKEN_IDENTIFIER, "Expected struct name");
 
-        ASTNode* structTypeNode = makeNode(AST_TYPE);
+        ASTNode* structTypeNode = makeNode(p, AST_TYPE);
         structTypeNode->data.type.typeKind = AST_TYPE_STRUCT;
-        structTypeNode->data.type.structType.name = strdup(name->lexeme);
+        structTypeNode->data.type.structType.name = p->stream->values[slot(p, name)].atom;
         structTypeNode->data.type.structType.fields = NULL;
         structTypeNode->data.type.structType.fieldCount = 0;
         // Note: parsing of the struct body happens separately in parseStruct()
         return structTypeNode;
     }
 
-    fprintf(stderr, "Unknown type: %s\n", t->lexeme);
-    exit(1);
+    int len;
+    const char *lexeme = lexemeOf(p, t, &len);
+    syntaxError(p, t, "Unknown type: %.*s", len, lexeme);
 }
 
 
-void initParser(Parser *p, Token **tokens, int tokenCount)
+void initParser(Parser *p, TokenStream *stream)
+{
+    arena_init(&p->arena);
+    p->scratch = NULL;
+    p->scratchCapacity = 0;
+    p->exprFrames = NULL;
+    p->exprCapacity = 0;
+    p->blocks = NULL;
+    p->blockCapacity = 0;
+    p->shared = NULL;
+    p->sharedCount = 0;
+    p->sharedCapacity = 0;
+    p->diagnostics = NULL;
+    p->diagnosticCapacity = 0;
+    p->lazyBodies = false;
+    p->shareExpressions = false;
+    resetParser(p, stream);
+}
+
+void resetParser(Parser *p, TokenStream *stream)
 {
-    p->tokens = tokens;
-    p->tokenCount = tokenCount;
+    arena_reset(&p->arena);
+    p->scratchCount = 0;
+    p->exprCount = 0;
+    p->blockCount = 0;
+    if (p->sharedCount > 0)
+        memset(p->shared, 0, p->sharedCapacity * sizeof(*p->shared));
+    p->sharedCount = 0;
+    p->diagnosticCount = 0;
+    p->recover = NULL;
+    p->abort = NULL;
+    p->stream = stream;
+    p->source = stream->source;
+    p->types = stream->types;
+    p->printAtom = intern_cstr("print");
+    p->tokenCount = stream->count;
     p->current = 0;
+    p->pipe = NULL;
+    p->tokenMask = -1;
+}
+
+void initPipelinedParser(Parser *p, TokenPipe *pipe)
+{
+    initParser(p, &pipe->ring);
+    p->tokenCount = 0;
+    p->pipe = pipe;
+    p->tokenMask = pipe->mask;
+}
+
+void freeParser(Parser *p)
+{
+    arena_free(&p->arena);
+    free(p->scratch);
+    p->scratch = NULL;
+    p->scratchCount = 0;
+    p->scratchCapacity = 0;
+    free(p->exprFrames);
+    p->exprFrames = NULL;
+    p->exprCount = 0;
+    p->exprCapacity = 0;
+    free(p->blocks);
+    p->blocks = NULL;
+    p->blockCount = 0;
+    p->blockCapacity = 0;
+    free(p->shared);
+    p->shared = NULL;
+    p->sharedCount = 0;
+    p->sharedCapacity = 0;
+    free(p->diagnostics);
+    p->diagnostics = NULL;
+    p->diagnosticCount = 0;
+    p->diagnosticCapacity = 0;
+}
+
+// import ::= 'import' STRING ';'
+static ASTNode *parseImport(Parser *p)
+{
+    advance(p);
+    int t = peek(p);
+    if (t < 0 || p->types[slot(p, t)] != TOKEN_STRING)
+        consume(p, TOKEN_STRING, "Expected a module path after 'import'");
+    ASTNode *node = makeNode(p, AST_IMPORT);
+    node->data.string = parserAlloc(p, p->stream->lengths[slot(p, t)] + 1);
+    token_string_decode_at(p->stream, slot(p, t), node->data.string);
+    advance(p);
+    consume(p, TOKEN_DELIM_SEMICOLON, "Expected ';' after import");
+    return node;
+}
+
+static ASTNode *parseTopLevel(Parser *p)
+{
+    TokenType type = peekType(p);
+    if (type == TOKEN_KEYWORD_FN)
+        return parseFunction(p);
+    if (type == TOKEN_KEYWORD_IMPORT)
+        return parseImport(p);
+    return parseStatement(p);
 }
 
 ASTNode *parseProgram(Parser *p)
 {
-    ASTNode *prog = makeNode(AST_PROGRAM);
-    prog->data.program.statements = NULL;
-    prog->data.program.count = 0;
+    jmp_buf abort;
+    p->abort = &abort;
+    p->recover = NULL;
+    if (setjmp(abort)) {
+        p->abort = NULL;
+        p->recover = NULL;
+        p->scratchCount = 0;
+        p->exprCount = 0;
+        p->blockCount = 0;
+        return NULL;
+    }
 
-    while (peek(p) && peek(p)->type != TOKEN_EOF)
+    ASTNode *prog = makeNode(p, AST_PROGRAM);
+    int base = p->scratchCount;
+    while (peekType(p) != TOKEN_EOF)
     {
-        ASTNode *node;
-        if (peek(p)->type == TOKEN_KEYWORD_FN)
-        {
-            node = parseFunction(p);
-        }
-        else
-        {
-            node = parseStatement(p);
-        }
-        int c = prog->data.program.count++;
-        prog->data.program.statements = realloc(
-            prog->data.program.statements,
-            prog->data.program.count * sizeof(ASTNode *));
-        prog->data.program.statements[c] = node;
+        ASTNode *node = parseRecovering(p, parseTopLevel);
+        if (node)
+            pushChild(p, node);
     }
+    prog->data.program.statements = popChildren(p, base, &prog->data.program.count);
+    p->abort = NULL;
     return prog;
 }
 
-static ASTNode *parseIfStatement(Parser *p)
+int parseItemAt(Parser *p, int start, bool topLevel, ASTNode **node)
 {
-    advance(p); // consume 'if'
-    consume(p, TOKEN_DELIM_OPEN_PAREN, "Expected '(' after 'if'");
+    jmp_buf abort;
+    *node = NULL;
+    p->current = start;
+    p->abort = &abort;
+    p->recover = NULL;
+    if (setjmp(abort)) {
+        p->abort = NULL;
+        p->recover = NULL;
+        p->scratchCount = 0;
+        p->exprCount = 0;
+        p->blockCount = 0;
+        return -1;
+    }
+    *node = parseRecovering(p, topLevel ? parseTopLevel : parseStatement);
+    p->abort = NULL;
+    return 0;
+}
 
-    ASTNode *condition = parseExpression(p);
+void updateParserStream(Parser *p)
+{
+    p->source = p->stream->source;
+    p->types = p->stream->types;
+    p->tokenCount = p->stream->count;
+}
 
-    consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')' after condition");
-    consume(p, TOKEN_DELIM_OPEN_BRACE, "Expected '{' for 'if' body");
+ParseResult parseScript(Parser *p)
+{
+    ParseResult result;
+    result.ast = parseProgram(p);
+    result.diagnostics = p->diagnostics;
+    result.diagnosticCount = p->diagnosticCount;
+    return result;
+}
 
-    ASTNode *thenBranch = makeNode(AST_PROGRAM);
-    thenBranch->data.program.statements = NULL;
-    thenBranch->data.program.count = 0;
+void printParseDiagnostics(const ParseResult *result)
+{
+    for (int i = 0; i < result->diagnosticCount; i++) {
+        const ParseDiagnostic *d = &result->diagnostics[i];
+        fprintf(stderr, "Parse error at line %d col %d: %s\n", d->line, d->col, d->message);
+    }
+}
 
-    while (!match(p, TOKEN_DELIM_CLOSE_BRACE))
-    {
-        ASTNode *stmt = parseStatement(p);
-        int c = thenBranch->data.program.count++;
-        thenBranch->data.program.statements = realloc(
-            thenBranch->data.program.statements,
-            thenBranch->data.program.count * sizeof(ASTNode *));
-        thenBranch->data.program.statements[c] = stmt;
+// statements up to and including the '}' of a block whose '{' is consumed
+static ASTNode *parseBlockBody(Parser *p, const char *closeMessage) {
+    int base = p->scratchCount;
+    while (!check(p, TOKEN_DELIM_CLOSE_BRACE) && peekType(p) != TOKEN_EOF) {
+        ASTNode *stmt = parseRecovering(p, parseStatement);
+        if (stmt)
+            pushChild(p, stmt);
     }
 
-    ASTNode *elseBranch = NULL;
-    if (match(p, TOKEN_KEYWORD_ELSE))
-    {
-        consume(p, TOKEN_DELIM_OPEN_BRACE, "Expected '{' for 'else' body");
+    consume(p, TOKEN_DELIM_CLOSE_BRACE, closeMessage);
 
-        elseBranch = makeNode(AST_PROGRAM);
-        elseBranch->data.program.statements = NULL;
-        elseBranch->data.program.count = 0;
+    ASTNode *block = makeNode(p, AST_PROGRAM);
+    block->data.program.statements = popChildren(p, base, &block->data.program.count);
+    return block;
+}
 
-        while (!match(p, TOKEN_DELIM_CLOSE_BRACE))
-        {
-            ASTNode *stmt = parseStatement(p);
-            int c = elseBranch->data.program.count++;
-            elseBranch->data.program.statements = realloc(
-                elseBranch->data.program.statements,
-                elseBranch->data.program.count * sizeof(ASTNode *));
-            elseBranch->data.program.statements[c] = stmt;
+// Pre-scan for lazy bodies: step past the '}' matching a consumed '{',
+// looking at nothing but the token types
+static void skipBlock(Parser *p, const char *closeMessage) {
+    const unsigned char *types = p->types;
+    int depth = 1;
+    for (int i = p->current; i < p->tokenCount; i++) {
+        if (types[i] == TOKEN_DELIM_OPEN_BRACE) {
+            depth++;
+        } else if (types[i] == TOKEN_DELIM_CLOSE_BRACE && --depth == 0) {
+            p->current = i + 1;
+            return;
         }
     }
-
-    ASTNode *node = makeNode(AST_IF);
-    node->data.ifStmt.condition = condition;
-    node->data.ifStmt.thenBranch = thenBranch;
-    node->data.ifStmt.elseBranch = elseBranch;
-
-    return node;
+    p->current = p->tokenCount - 1; // the EOF token
+    consume(p, TOKEN_DELIM_CLOSE_BRACE, closeMessage);
 }
 
+// a function body the pre-scan skipped, from just past its '{'; NULL when
+// out of memory or after too many errors
+static ASTNode *parseBodyAt(Parser *p, int start) {
+    jmp_buf abort;
+    p->current = start;
+    p->abort = &abort;
+    p->recover = NULL;
+    if (setjmp(abort)) {
+        p->abort = NULL;
+        p->recover = NULL;
+        p->scratchCount = 0;
+        p->exprCount = 0;
+        p->blockCount = 0;
+        return NULL;
+    }
 
-static bool isAtEnd(Parser *p) {
-    return peek(p) == NULL;
+    ASTNode *body = parseBlockBody(p, "Expected '}' to end function body");
+    p->abort = NULL;
+    return body;
 }
 
-static ASTNode *parseBlock(Parser *p) {
-    consume(p, TOKEN_DELIM_OPEN_BRACE, "Expected '{' to start block");
-
-    ASTNode **statements = NULL;
-    int count = 0;
+// LazyBody builder for a body the pre-scan skipped. Syntax errors in it are
+// kept with the others and printed; the body is then NULL.
+static ASTNode *parseLazyBody(LazyBody *lazy) {
+    Parser *p = lazy->context;
+    int resume = p->current;
+    int firstDiagnostic = p->diagnosticCount;
+    ASTNode *body = parseBodyAt(p, lazy->start);
+    p->current = resume;
+
+    if (p->diagnosticCount > firstDiagnostic) {
+        ParseResult result;
+        result.ast = NULL;
+        result.diagnostics = p->diagnostics + firstDiagnostic;
+        result.diagnosticCount = p->diagnosticCount - firstDiagnostic;
+        printParseDiagnostics(&result);
+        return NULL;
+    }
+    return body;
+}
 
-    while (!check(p, TOKEN_DELIM_CLOSE_BRACE) && !isAtEnd(p)) {
-        ASTNode *stmt = parseStatement(p);
-        statements = realloc(statements, sizeof(ASTNode *) * (count + 1));
-        statements[count++] = stmt;
+// --- Parallel function bodies ---
+// After a lazy parse every top-level body is a token range known to be
+// balanced, and parsing one touches nothing shared but the token stream and
+// the thread-safe intern table. Each worker is a Parser of its own, with its
+// own arena and diagnostics, taking the next function from a shared counter;
+// its arena and diagnostics are merged into the main parser when it is done.
+typedef struct {
+    ASTNode **functions;
+    int count;
+    int next;
+} BodyQueue;
+
+typedef struct {
+    Parser parser;
+    BodyQueue *queue;
+    int failed; // a body could not be parsed at all
+    pthread_t thread;
+} BodyWorker;
+
+static void *parseBodies(void *arg)
+{
+    BodyWorker *w = arg;
+    while (1) {
+        int i = __atomic_fetch_add(&w->queue->next, 1, __ATOMIC_RELAXED);
+        if (i >= w->queue->count)
+            return NULL;
+        ASTNode *fn = w->queue->functions[i];
+        int firstDiagnostic = w->parser.diagnosticCount;
+        ASTNode *body = parseBodyAt(&w->parser, fn->data.function.lazyBody->start);
+        if (!body)
+            w->failed = 1;
+        else if (w->parser.diagnosticCount == firstDiagnostic) {
+            fn->data.function.body = body;
+            fn->data.function.lazyBody = NULL;
+        }
     }
+}
 
-    consume(p, TOKEN_DELIM_CLOSE_BRACE, "Expected '}' to end block");
+typedef struct {
+    ParseDiagnostic diagnostic;
+    int order;
+} OrderedDiagnostic;
 
-    ASTNode *block = makeNode(AST_PROGRAM);
-    block->data.program.statements = statements;
-    block->data.program.count = count;
-    return block;
+static int compareDiagnostics(const void *a, const void *b)
+{
+    const OrderedDiagnostic *x = a, *y = b;
+    if (x->diagnostic.token != y->diagnostic.token)
+        return x->diagnostic.token < y->diagnostic.token ? -1 : 1;
+    return x->order - y->order;
 }
 
-static ASTNode *parseWhileStatement(Parser *p) {
-    consume(p, TOKEN_KEYWORD_LOOP, "Expected 'while'");
-    consume(p, TOKEN_DELIM_OPEN_PAREN, "Expected '(' after 'while'");
-    ASTNode *condition = parseExpression(p);
-    consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')' after condition");
-
-    ASTNode *body = parseBlock(p); // or parseStatement(p) if you allow single-line bodies
+// append the workers' diagnostics to p's and put all of them in source order
+static int mergeDiagnostics(Parser *p, BodyWorker *workers, int count)
+{
+    int total = p->diagnosticCount;
+    for (int k = 0; k < count; k++)
+        total += workers[k].parser.diagnosticCount;
+    if (total == p->diagnosticCount)
+        return 0;
+
+    OrderedDiagnostic *all = malloc(total * sizeof *all);
+    ParseDiagnostic *merged = malloc(total * sizeof *merged);
+    if (!all || !merged) {
+        free(all);
+        free(merged);
+        return -1;
+    }
+    int n = 0;
+    for (int i = 0; i < p->diagnosticCount; i++, n++)
+        all[n] = (OrderedDiagnostic){p->diagnostics[i], n};
+    for (int k = 0; k < count; k++)
+        for (int i = 0; i < workers[k].parser.diagnosticCount; i++, n++)
+            all[n] = (OrderedDiagnostic){workers[k].parser.diagnostics[i], n};
+    qsort(all, total, sizeof *all, compareDiagnostics);
+    for (int i = 0; i < total; i++)
+        merged[i] = all[i].diagnostic;
+    free(all);
+    free(p->diagnostics);
+    p->diagnostics = merged;
+    p->diagnosticCount = total;
+    p->diagnosticCapacity = total;
+    return 0;
+}
 
-    ASTNode *node = makeNode(AST_WHILE);
-    node->data.whileStmt.condition = condition;
-    node->data.whileStmt.body = body;
-    return node;
+// threads as asked for, <= 0 meaning every online CPU, within the cap
+static int bodyThreads(int threads)
+{
+    if (threads <= 0) {
+#if defined(__unix__) || defined(__APPLE__)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+        threads = 1;
+#endif
+    }
+    return threads < 1 ? 1 : threads > PARSER_MAX_THREADS ? PARSER_MAX_THREADS : threads;
 }
 
-static ASTNode *parseForStatement(Parser *p) {
-    consume(p, TOKEN_KEYWORD_FORLOOP, "Expected 'for'");
-    consume(p, TOKEN_DELIM_OPEN_PAREN, "Expected '(' after 'for'");
+int buildFunctionBodies(Parser *p, ASTNode *program, int threads)
+{
+    BodyQueue queue = {NULL, 0, 0};
+    queue.functions = malloc((program->data.program.count + 1) * sizeof(ASTNode *));
+    if (!queue.functions)
+        return -1;
+    for (int i = 0; i < program->data.program.count; i++) {
+        ASTNode *node = program->data.program.statements[i];
+        if (node->type == AST_FUNCTION && node->data.function.lazyBody &&
+            node->data.function.lazyBody->build == parseLazyBody && node->data.function.lazyBody->context == p)
+            queue.functions[queue.count++] = node;
+    }
 
-    ASTNode *init = parseStatement(p); 
-    ASTNode *condition = parseExpression(p);
-    consume(p, TOKEN_DELIM_SEMICOLON, "Expected ';' after loop condition");
-    ASTNode *increment = parseExpression(p);
-    consume(p, TOKEN_DELIM_CLOSE_PAREN, "Expected ')' after increment");
+    threads = bodyThreads(threads);
+    if (threads > queue.count / PARSER_BODIES_PER_THREAD)
+        threads = queue.count / PARSER_BODIES_PER_THREAD;
+    if (threads < 1)
+        threads = 1;
+    if (threads > 1) {
+        // token_position() builds its line table on first use; build it
+        // now, before workers reporting errors could race to
+        int line, col;
+        token_position(p->stream, 0, &line, &col);
+    }
 
-    ASTNode *body = parseBlock(p); 
+    BodyWorker workers[PARSER_MAX_THREADS];
+    for (int k = 0; k < threads; k++) {
+        initParser(&workers[k].parser, p->stream);
+        workers[k].parser.shareExpressions = p->shareExpressions;
+        workers[k].queue = &queue;
+        workers[k].failed = 0;
+    }
+    // worker 0 runs on the calling thread
+    int started = 1;
+    for (; started < threads; started++)
+        if (pthread_create(&workers[started].thread, NULL, parseBodies, &workers[started]) != 0)
+            break;
+    parseBodies(&workers[0]);
+    for (int k = 1; k < started; k++)
+        pthread_join(workers[k].thread, NULL);
+
+    int status = mergeDiagnostics(p, workers, threads);
+    for (int k = 0; k < threads; k++) {
+        if (workers[k].failed)
+            status = -1;
+        arena_adopt(&p->arena, &workers[k].parser.arena);
+        freeParser(&workers[k].parser);
+    }
+    free(queue.functions);
+    return status;
+}
 
-    ASTNode *node = makeNode(AST_FOR);
-    node->data.forStmt.init = init;
-    node->data.forStmt.condition = condition;
-    node->data.forStmt.increment = increment;
-    node->data.forStmt.body = body;
-    return node;
+ParseResult parseScriptParallel(Parser *p, int threads)
+{
+    // on one thread the pre-scan would only add a second pass
+    if (bodyThreads(threads) == 1)
+        return parseScript(p);
+    bool lazy = p->lazyBodies;
+    p->lazyBodies = true;
+    ASTNode *ast = parseProgram(p);
+    p->lazyBodies = lazy;
+    if (ast && buildFunctionBodies(p, ast, threads) != 0)
+        ast = NULL;
+
+    ParseResult result;
+    result.ast = ast;
+    result.diagnostics = p->diagnostics;
+    result.diagnosticCount = p->diagnosticCount;
+    return result;
 }
 
 ASTNode *parsePrintStatement(Parser *p) {
     // Consume 'print' identifier
-    Token *printToken = p->tokens[p->current];
-    if (strcmp(printToken->lexeme, "print") != 0) {
-        printf("Expected 'print' statement at line %d, col %d\n", printToken->line, printToken->col);
-        exit(1);
-    }
+    if (!check(p, TOKEN_IDENTIFIER) || p->stream->values[slot(p, p->current)].atom != p->printAtom)
+        syntaxError(p, p->current, "Expected 'print' statement");
     p->current++;
 
     // Consume '('
-    if (p->tokens[p->current]->type != TOKEN_DELIM_OPEN_PAREN) {
-        printf("Expected '(' after 'print' at line %d, col %d\n", p->tokens[p->current]->line, p->tokens[p->current]->col);
-        exit(1);
-    }
+    if (!check(p, TOKEN_DELIM_OPEN_PAREN))
+        syntaxError(p, p->current, "Expected '(' after 'print'");
     p->current++;
 
     // Parse expression to print
     ASTNode *expr = parseExpression(p);
 
     // Consume ')'
-    if (p->tokens[p->current]->type != TOKEN_DELIM_CLOSE_PAREN) {
-        printf("Expected ')' after expression in 'print' at line %d, col %d\n", p->tokens[p->current]->line, p->tokens[p->current]->col);
-        exit(1);
-    }
+    if (!check(p, TOKEN_DELIM_CLOSE_PAREN))
+        syntaxError(p, p->current, "Expected ')' after expression in 'print'");
     p->current++;
 
     // Consume ';'
-    if (p->tokens[p->current]->type != TOKEN_DELIM_SEMICOLON) {
-        printf("Expected ';' after 'print' statement at line %d, col %d\n", p->tokens[p->current]->line, p->tokens[p->current]->col);
-        exit(1);
-    }
+    if (!check(p, TOKEN_DELIM_SEMICOLON))
+        syntaxError(p, p->current, "Expected ';' after 'print' statement");
     p->current++;
 
     // Create AST node
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = AST_PRINT_STATEMENT;
+    ASTNode *node = makeNode(p, AST_PRINT_STATEMENT);
     node->data.printStmt.expr = expr;
     return node;
 }
 
-void freeAST(ASTNode *node)
+ASTNode *functionBody(ASTNode *fn)
 {
-    if (!node)
-        return;
-
-    switch (node->type)
-    {
-    case AST_PRINT_STATEMENT:
-        freeAST(node->data.printStmt.expr);
-        break;
-
-    case AST_NUMBER:
-        // Nothing to free
-        break;
-
-    case AST_STRING:
-        free(node->data.string);
-        break;
-
-    case AST_IDENTIFIER:
-        free(node->data.identifier);
-        break;
-
-    case AST_BINARY_EXPR:
-        freeAST(node->data.binary.left);
-        freeAST(node->data.binary.right);
-        break;
-
-    case AST_VAR_DECL:
-        free(node->data.varDecl.varName);
-        if (node->data.varDecl.varType)
-            freeAST(node->data.varDecl.varType);
-        if (node->data.varDecl.initializer)
-            freeAST(node->data.varDecl.initializer);
-        break;
-
-    case AST_RETURN:
-        freeAST(node->data.returnStmt.expr);
-        break;
-
-    case AST_FUNCTION:
-        free(node->data.function.name);
-        for (int i = 0; i < node->data.function.paramCount; i++)
-            freeAST(node->data.function.params[i]);
-        free(node->data.function.params);
-        if (node->data.function.returnType)
-            freeAST(node->data.function.returnType);
-        freeAST(node->data.function.body);
-        break;
-
-    case AST_IF:
-        freeAST(node->data.ifStmt.condition);
-        freeAST(node->data.ifStmt.thenBranch);
-        if (node->data.ifStmt.elseBranch)
-            freeAST(node->data.ifStmt.elseBranch);
-        break;
-
-    case AST_PROGRAM:
-        for (int i = 0; i < node->data.program.count; i++)
-            freeAST(node->data.program.statements[i]);
-        free(node->data.program.statements);
-        break;
+    LazyBody *lazy = fn->data.function.lazyBody;
+    if (lazy && (fn->data.function.body = lazy->build(lazy)))
+        fn->data.function.lazyBody = NULL;
+    return fn->data.function.body;
+}
 
-    case AST_TYPE:
-        switch (node->data.type.typeKind)
-        {
-        case AST_TYPE_ARRAY:
-            freeAST(node->data.type.elementType);
-            break;
-        case AST_TYPE_TUPLE:
-            for (int i = 0; i < node->data.type.tuple.elementCount; i++)
-                freeAST(node->data.type.tuple.elementTypes[i]);
-            free(node->data.type.tuple.elementTypes);
-            break;
-        case AST_TYPE_STRUCT:
-            free(node->data.type.structType.name);
-            for (int i = 0; i < node->data.type.structType.fieldCount; i++)
-                freeAST(node->data.type.structType.fields[i]);
-            free(node->data.type.structType.fields);
-            break;
-        default:
-            // Nothing additional to free
-            break;
+// printAST() keeps the lines still to print on a stack of its own instead of
+// recursing, so it can print trees of any depth. Each node pushes its child
+// lines in order and the run is then reversed, so they pop in order.
+typedef enum {
+    PRINT_NODE,
+    PRINT_BODY, // the body of function node, built on demand
+    PRINT_LABEL,
+} PrintStepKind;
+
+typedef struct {
+    PrintStepKind kind;
+    ASTNode *node;
+    const char *label; // a format taking number
+    int number;
+    int indent;
+} PrintStep;
+
+typedef struct {
+    PrintStep *steps;
+    int count;
+    int capacity;
+    bool failed;
+} PrintStack;
+
+static void pushPrint(PrintStack *s, PrintStepKind kind, ASTNode *node, const char *label, int number, int indent)
+{
+    if (s->count == s->capacity) {
+        int capacity = s->capacity ? s->capacity * 2 : 64;
+        PrintStep *steps = realloc(s->steps, capacity * sizeof(PrintStep));
+        if (!steps) {
+            s->failed = true;
+            return;
         }
-        break;
-
-    case AST_ARRAY_LITERAL:
-        for (int i = 0; i < node->data.arrayLiteral.elementCount; i++)
-            freeAST(node->data.arrayLiteral.elements[i]);
-        free(node->data.arrayLiteral.elements);
-        break;
-
-    case AST_WHILE:
-        freeAST(node->data.whileStmt.condition);
-        freeAST(node->data.whileStmt.body);
-        break;
-
-    case AST_FOR:
-        freeAST(node->data.forStmt.init);
-        freeAST(node->data.forStmt.condition);
-        freeAST(node->data.forStmt.increment);
-        freeAST(node->data.forStmt.body);
-        break;
-
-    case AST_FUNCTION_CALL:
-        freeAST(node->data.call.callee);
-        for (int i = 0; i < node->data.call.argCount; i++)
-            freeAST(node->data.call.arguments[i]);
-        free(node->data.call.arguments);
-        break;
-
-    default:
-        // Unknown node type — optionally handle/log here
-        break;
+        s->steps = steps;
+        s->capacity = capacity;
     }
+    s->steps[s->count++] = (PrintStep){kind, node, label, number, indent};
+}
 
-    free(node);
+static void pushChildNode(PrintStack *s, ASTNode *node, int indent)
+{
+    pushPrint(s, PRINT_NODE, node, NULL, 0, indent);
 }
 
-void printAST(ASTNode *node, int indent)
+static void pushLabel(PrintStack *s, const char *label, int number, int indent)
 {
-    if (!node)
-        return;
+    pushPrint(s, PRINT_LABEL, NULL, label, number, indent);
+}
 
+static void printIndent(int indent)
+{
     for (int i = 0; i < indent; i++)
         printf("  ");
+}
+
+// print node's own line and push the lines below it
+static void printNode(PrintStack *s, ASTNode *node, int indent)
+{
+    printIndent(indent);
 
     switch (node->type)
     {
     case AST_PRINT_STATEMENT:
         printf("PrintStmt:\n");
-        if (node->data.printStmt.expr == NULL) {
-            for (int i = 0; i < indent + 1; i++)
-                printf("  ");
-            printf("<empty expr>\n");
-        } else {
-            printAST(node->data.printStmt.expr, indent + 1);
-        }
+        if (node->data.printStmt.expr == NULL)
+            pushLabel(s, "<empty expr>", 0, indent + 1);
+        else
+            pushChildNode(s, node->data.printStmt.expr, indent + 1);
         break;
 
     case AST_NUMBER:
-        printf("Number: %d\n", node->data.number);
+        if (node->data.number.kind == TOKEN_FLOAT)
+            printf("Number: %g\n", node->data.number.floatValue);
+        else
+            printf("Number: %d\n", node->data.number.intValue);
         break;
 
     case AST_STRING:
@@ -845,133 +1566,114 @@ void printAST(ASTNode *node, int indent)
         break;
 
     case AST_BINARY_EXPR:
-        printf("BinaryOp: %s\n", node->data.binary.op->lexeme);
-        printAST(node->data.binary.left, indent + 1);
-        printAST(node->data.binary.right, indent + 1);
+        printf("BinaryOp: %s\n", opSpelling(node->data.binary.op));
+        pushChildNode(s, node->data.binary.left, indent + 1);
+        pushChildNode(s, node->data.binary.right, indent + 1);
         break;
 
     case AST_VAR_DECL:
         printf("VarDecl: %s\n", node->data.varDecl.varName);
         if (node->data.varDecl.varType)
         {
-            for (int i = 0; i < indent + 1; i++)
-                printf("  ");
-            printf("TypeAnnotation:\n");
-            printAST(node->data.varDecl.varType, indent + 2);
+            pushLabel(s, "TypeAnnotation:", 0, indent + 1);
+            pushChildNode(s, node->data.varDecl.varType, indent + 2);
         }
         if (node->data.varDecl.initializer)
         {
-            for (int i = 0; i < indent + 1; i++)
-                printf("  ");
-            printf("Initializer:\n");
-            printAST(node->data.varDecl.initializer, indent + 2);
+            pushLabel(s, "Initializer:", 0, indent + 1);
+            pushChildNode(s, node->data.varDecl.initializer, indent + 2);
         }
         break;
 
     case AST_RETURN:
         printf("Return:\n");
-        printAST(node->data.returnStmt.expr, indent + 1);
+        pushChildNode(s, node->data.returnStmt.expr, indent + 1);
         break;
 
     case AST_FUNCTION:
         printf("Function: %s\n", node->data.function.name);
         for (int i = 0; i < node->data.function.paramCount; i++)
         {
-            for (int j = 0; j < indent + 1; j++)
-                printf("  ");
-            printf("Param %d:\n", i);
-            printAST(node->data.function.params[i], indent + 2);
+            pushLabel(s, "Param %d:", i, indent + 1);
+            pushChildNode(s, node->data.function.params[i], indent + 2);
         }
         if (node->data.function.returnType)
         {
-            for (int j = 0; j < indent + 1; j++)
-                printf("  ");
-            printf("ReturnType:\n");
-            printAST(node->data.function.returnType, indent + 2);
+            pushLabel(s, "ReturnType:", 0, indent + 1);
+            pushChildNode(s, node->data.function.returnType, indent + 2);
         }
-        printAST(node->data.function.body, indent + 1);
+        pushPrint(s, PRINT_BODY, node, NULL, 0, indent + 1);
         break;
 
     case AST_FUNCTION_CALL:
         printf("FunctionCall:\n");
-        for (int j = 0; j < indent + 1; j++)
-            printf("  ");
-        printf("Callee:\n");
-        printAST(node->data.call.callee, indent + 2);
+        pushLabel(s, "Callee:", 0, indent + 1);
+        pushChildNode(s, node->data.call.callee, indent + 2);
         for (int i = 0; i < node->data.call.argCount; i++)
         {
-            for (int j = 0; j < indent + 1; j++)
-                printf("  ");
-            printf("Arg %d:\n", i);
-            printAST(node->data.call.arguments[i], indent + 2);
+            pushLabel(s, "Arg %d:", i, indent + 1);
+            pushChildNode(s, node->data.call.arguments[i], indent + 2);
         }
         break;
 
     case AST_PROGRAM:
         printf("Program (%d stmts):\n", node->data.program.count);
         for (int i = 0; i < node->data.program.count; i++)
-            printAST(node->data.program.statements[i], indent + 1);
+            pushChildNode(s, node->data.program.statements[i], indent + 1);
         break;
 
+    case AST_IMPORT:
+        printf("Import: \"%s\"\n", node->data.string);
+        break;
     case AST_EXPR_STMT:
             printf("ExprStmt:\n");
-            printAST(node->data.ExprStmt.expr, indent + 2);
+            pushChildNode(s, node->data.ExprStmt.expr, indent + 2);
             break;
     case AST_IF:
         printf("IfStmt:\n");
-        for (int i = 0; i < indent + 1; i++) printf("  ");
-        printf("Condition:\n");
-        printAST(node->data.ifStmt.condition, indent + 2);
-        for (int i = 0; i < indent + 1; i++) printf("  ");
-        printf("Then:\n");
-        printAST(node->data.ifStmt.thenBranch, indent + 2);
+        pushLabel(s, "Condition:", 0, indent + 1);
+        pushChildNode(s, node->data.ifStmt.condition, indent + 2);
+        pushLabel(s, "Then:", 0, indent + 1);
+        pushChildNode(s, node->data.ifStmt.thenBranch, indent + 2);
         if (node->data.ifStmt.elseBranch)
         {
-            for (int i = 0; i < indent + 1; i++) printf("  ");
-            printf("Else:\n");
-            printAST(node->data.ifStmt.elseBranch, indent + 2);
+            pushLabel(s, "Else:", 0, indent + 1);
+            pushChildNode(s, node->data.ifStmt.elseBranch, indent + 2);
         }
         break;
 
     case AST_WHILE:
         printf("WhileStmt:\n");
-        for (int i = 0; i < indent + 1; i++) printf("  ");
-        printf("Condition:\n");
-        printAST(node->data.whileStmt.condition, indent + 2);
-        for (int i = 0; i < indent + 1; i++) printf("  ");
-        printf("Body:\n");
-        printAST(node->data.whileStmt.body, indent + 2);
+        pushLabel(s, "Condition:", 0, indent + 1);
+        pushChildNode(s, node->data.whileStmt.condition, indent + 2);
+        pushLabel(s, "Body:", 0, indent + 1);
+        pushChildNode(s, node->data.whileStmt.body, indent + 2);
         break;
 
     case AST_FOR:
         printf("ForStmt:\n");
-        for (int i = 0; i < indent + 1; i++) printf("  ");
-        printf("Init:\n");
-        printAST(node->data.forStmt.init, indent + 2);
-        for (int i = 0; i < indent + 1; i++) printf("  ");
-        printf("Condition:\n");
-        printAST(node->data.forStmt.condition, indent + 2);
-        for (int i = 0; i < indent + 1; i++) printf("  ");
-        printf("Increment:\n");
-        printAST(node->data.forStmt.increment, indent + 2);
-        for (int i = 0; i < indent + 1; i++) printf("  ");
-        printf("Body:\n");
-        printAST(node->data.forStmt.body, indent + 2);
+        pushLabel(s, "Init:", 0, indent + 1);
+        pushChildNode(s, node->data.forStmt.init, indent + 2);
+        pushLabel(s, "Condition:", 0, indent + 1);
+        pushChildNode(s, node->data.forStmt.condition, indent + 2);
+        pushLabel(s, "Increment:", 0, indent + 1);
+        pushChildNode(s, node->data.forStmt.increment, indent + 2);
+        pushLabel(s, "Body:", 0, indent + 1);
+        pushChildNode(s, node->data.forStmt.body, indent + 2);
         break;
 
     case AST_ARRAY_LITERAL:
         printf("ArrayLiteral (%d elements):\n", node->data.arrayLiteral.elementCount);
         for (int i = 0; i < node->data.arrayLiteral.elementCount; i++) {
-            for (int j = 0; j < indent + 1; j++) printf("  ");
-            printf("Element %d:\n", i);
-            printAST(node->data.arrayLiteral.elements[i], indent + 2);
+            pushLabel(s, "Element %d:", i, indent + 1);
+            pushChildNode(s, node->data.arrayLiteral.elements[i], indent + 2);
         }
         break;
 
     case AST_TYPE_TUPLE:
         printf("Tuple (%d elements):\n", node->data.type.tuple.elementCount);
         for (int i = 0; i < node->data.type.tuple.elementCount; i++)
-            printAST(node->data.type.tuple.elementTypes[i], indent + 1);
+            pushChildNode(s, node->data.type.tuple.elementTypes[i], indent + 1);
         break;
 
     case AST_TYPE:
@@ -995,12 +1697,12 @@ void printAST(ASTNode *node, int indent)
             break;
         case AST_TYPE_ARRAY:
             printf("array of:\n");
-            printAST(node->data.type.elementType, indent + 1);
+            pushChildNode(s, node->data.type.elementType, indent + 1);
             break;
         case AST_TYPE_STRUCT:
             printf("struct %s\n", node->data.type.structType.name);
             for (int i = 0; i < node->data.type.structType.fieldCount; i++)
-                printAST(node->data.type.structType.fields[i], indent + 1);
+                pushChildNode(s, node->data.type.structType.fields[i], indent + 1);
             break;
         default:
             printf("Unknown typeKind: %d\n", node->data.type.typeKind);
@@ -1013,3 +1715,34 @@ void printAST(ASTNode *node, int indent)
         break;
     }
 }
+
+void printAST(ASTNode *node, int indent)
+{
+    PrintStack s = {NULL, 0, 0, false};
+    pushChildNode(&s, node, indent);
+    while (s.count > 0 && !s.failed)
+    {
+        PrintStep step = s.steps[--s.count];
+        if (step.kind == PRINT_LABEL)
+        {
+            printIndent(step.indent);
+            printf(step.label, step.number);
+            printf("\n");
+            continue;
+        }
+        ASTNode *n = step.kind == PRINT_BODY ? functionBody(step.node) : step.node;
+        if (!n)
+            continue;
+        int mark = s.count;
+        printNode(&s, n, step.indent);
+        for (int i = mark, j = s.count - 1; i < j; i++, j--)
+        {
+            PrintStep swap = s.steps[i];
+            s.steps[i] = s.steps[j];
+            s.steps[j] = swap;
+        }
+    }
+    if (s.failed)
+        fprintf(stderr, "printAST: out of memory\n");
+    free(s.steps);
+}
@@ -1,7 +1,10 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "arena.h"
 #include "lexer.h"
+#include <setjmp.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 typedef enum
@@ -23,6 +26,7 @@ typedef enum
     AST_WHILE,
     AST_FOR,
     AST_EXPR_STMT,
+    AST_IMPORT,
     // Type categories:
     AST_TYPE_INT,
     AST_TYPE_FLOAT,
@@ -33,32 +37,73 @@ typedef enum
     AST_TYPE_TUPLE,
     AST_TYPE_STRUCT
 } ASTNodeType;
+
+// Operators are resolved once by the parser, so the evaluator can switch on
+// them instead of comparing spellings
+typedef enum
+{
+    OP_ASSIGN,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_LT,
+    OP_LTE,
+    OP_GT,
+    OP_GTE,
+    OP_EQ,
+    OP_NEQ,
+    OP_AND,
+    OP_OR,
+    OP_NEG, // unary '-'
+    OP_NOT, // unary '!'
+    OP_COUNT
+} OpCode;
+
 typedef struct ASTNode ASTNode;
+
+// A function body that is built on first use instead of up front; see
+// functionBody(). context and start say where build() finds it.
+typedef struct LazyBody
+{
+    ASTNode *(*build)(struct LazyBody *lazy); // NULL when out of memory
+    void *context;
+    int start;
+} LazyBody;
 typedef struct ASTNode
 {
     ASTNodeType type;
     union
     {
-        int number;       // AST_NUMBER
-        char *string;     // AST_STRING
-        char *identifier; // AST_IDENTIFIER
+        struct
+        { // AST_NUMBER: typed constant decoded by the lexer
+            TokenType kind; // TOKEN_INT or TOKEN_FLOAT
+            union
+            {
+                int intValue;
+                float floatValue;
+            };
+        } number;
+        char *string;     // AST_STRING; AST_IMPORT: the imported path
+        Atom identifier;  // AST_IDENTIFIER
 
         struct
         { // AST_BINARY_EXPR
             struct ASTNode *left;
-            Token *op;
+            OpCode op;
             struct ASTNode *right;
         } binary;
 
         struct
         { // AST_UNARY_EXPR
-            Token *op;
+            OpCode op;
             struct ASTNode *operand;
         } unary;
 
         struct
         { // AST_VAR_DECL
-            char *varName;
+            Atom varName;
             struct ASTNode *varType;     // optional type annotation
             struct ASTNode *initializer; // optional initializer
         } varDecl;
@@ -70,11 +115,12 @@ typedef struct ASTNode
 
         struct
         { // AST_FUNCTION
-            char *name;
+            Atom name;
             struct ASTNode **params;
             int paramCount;
             struct ASTNode *returnType;
             struct ASTNode *body;
+            LazyBody *lazyBody; // set while the body is still to be built
         } function;
 
         struct
@@ -117,7 +163,7 @@ typedef struct ASTNode
 
                 struct
                 { // for structs
-                    char *name;
+                    Atom name;
                     struct ASTNode **fields; // array of AST_VAR_DECL
                     int fieldCount;
                 } structType;
@@ -149,17 +195,106 @@ typedef struct ASTNode
     } data;
 } ASTNode;
 
+// A syntax error: parsing records it and carries on after the next ';' or '}'
+typedef struct
+{
+    int token;           // index of the offending token in the stream
+    int line;            // 1-based position of that token, -1 past the end
+    int col;
+    const char *message; // owned by the parser
+} ParseDiagnostic;
+
 typedef struct
 {
-    Token **tokens;
+    TokenStream *stream;        // positions are looked up only for diagnostics
+    const char *source;         // buffer the tokens slice into
+    const unsigned char *types; // dense lookahead arrays of the stream
+    Atom printAtom; // 'print' is an identifier, recognised by its atom
     int current;
-    int tokenCount;
+    int tokenCount; // tokens that may be read without asking the pipe
+    // Pipelined mode: the tokens come from a lexer thread through pipe, and
+    // token i is in slot i & tokenMask of the stream, which is its ring.
+    // With a whole stream, pipe is NULL and tokenMask has every bit set.
+    TokenPipe *pipe;
+    int tokenMask;
+    Arena arena;       // owns every node, child list and string of the parse
+    ASTNode **scratch; // child lists under construction, copied to the arena when complete
+    int scratchCount;
+    int scratchCapacity;
+    // what is still open in the expression and the nested statements being
+    // parsed, kept here instead of on the C stack
+    struct ExprFrame *exprFrames;
+    int exprCount;
+    int exprCapacity;
+    struct BlockFrame *blocks;
+    int blockCount;
+    int blockCapacity;
+    // the expression nodes shareExpressions shares, by structure; open
+    // addressing on their hash
+    struct SharedNode *shared;
+    int sharedCount;
+    int sharedCapacity;
+    jmp_buf *recover; // innermost statement a syntax error unwinds to
+    jmp_buf *abort;   // parseProgram(), for errors parsing cannot go on after
+    ParseDiagnostic *diagnostics;
+    int diagnosticCount;
+    int diagnosticCapacity;
+    // Lazy mode: a pre-scan only matches the braces of each function body and
+    // functionBody() parses it on first use, so the stream and its source
+    // must outlive the tree. Off after initParser(); kept by resetParser().
+    bool lazyBodies;
+    // Hash-consing: structurally identical expressions without side effects
+    // (numbers, identifiers and the operators but '=' over them) are built
+    // once and shared, so the tree is a DAG and node identity means the same
+    // expression. Off after initParser(); kept by resetParser().
+    bool shareExpressions;
 } Parser;
 
-void initParser(Parser *p, Token **tokens, int tokenCount);
+typedef struct
+{
+    ASTNode *ast; // every statement that parsed; NULL when parsing had to stop
+    const ParseDiagnostic *diagnostics;
+    int diagnosticCount;
+} ParseResult;
+
+void initParser(Parser *p, TokenStream *stream);
+// release the previous AST in one step and parse a new stream, reusing the memory
+void resetParser(Parser *p, TokenStream *stream);
+// a parser reading from a started pipe as its lexer thread produces tokens;
+// never in lazy mode, since the ring does not keep the tokens
+void initPipelinedParser(Parser *p, TokenPipe *pipe);
+// release the AST and all parser memory
+void freeParser(Parser *p);
+// Neither ever exits the process. parseProgram() returns NULL only when out of
+// memory or after too many errors; check diagnosticCount for syntax errors.
 ASTNode *parseProgram(Parser *p);
+ParseResult parseScript(Parser *p);
+// parseScript() with the bodies of top-level functions parsed on up to
+// threads threads (<= 0: every online CPU) after a brace-matching pre-scan.
+// Without syntax errors the tree is the one parseScript() builds; diagnostics
+// come in source order.
+ParseResult parseScriptParallel(Parser *p, int threads);
+// build the bodies of program's top-level functions that p left lazy, on up
+// to threads threads; their syntax errors are added to p's diagnostics, not
+// printed, and leave those bodies lazy. -1 when out of memory or a body had
+// too many errors to parse.
+int buildFunctionBodies(Parser *p, ASTNode *program, int threads);
+// For incremental parsing: parse the one top-level item (function, import
+// or statement), or the one statement of a block, starting at token start;
+// p->current is left just past it. *node is NULL after a syntax error, which
+// is recorded as usual. -1 when parsing had to stop (out of memory or too
+// many errors).
+int parseItemAt(Parser *p, int start, bool topLevel, ASTNode **node);
+// pick up the arrays of a stream edited in place, keeping tree and diagnostics
+void updateParserStream(Parser *p);
+// one "Parse error at line L col C: message" line per diagnostic, to stderr
+void printParseDiagnostics(const ParseResult *result);
 void printAST(ASTNode *node, int indent);
-void freeAST(ASTNode *node);
+// the body of an AST_FUNCTION, built first if it was left lazy; NULL when
+// building it failed: out of memory, a damaged image, or syntax errors,
+// which are reported
+ASTNode *functionBody(ASTNode *fn);
+const char *opSpelling(OpCode op);
 
 #endif // PARSER_H
  
\ No newline at end of file
@@ -0,0 +1,380 @@
+#include "reparse.h"
+#include <string.h>
+
+// Both a top-level item and a body statement parse the same whatever comes
+// before them, since neither the grammar nor the parser carries state across
+// statements. So a parse of the new tokens that started where an old item
+// started, and that reaches the start of an old item after the edit, has
+// rebuilt exactly the items in between, and everything past that point is
+// still what a fresh parse would build.
+
+static int grow(void **array, int *capacity, int need, size_t size)
+{
+    if (need <= *capacity)
+        return 0;
+    int next = *capacity ? *capacity * 2 : 64;
+    while (next < need)
+        next *= 2;
+    void *grown = realloc(*array, (size_t)next * size);
+    if (!grown)
+        return -1;
+    *array = grown;
+    *capacity = next;
+    return 0;
+}
+
+static int noteChanged(Reparser *r, ASTNode *node, ASTNode *function)
+{
+    if (!node)
+        return 0;
+    if (grow((void **)&r->changed, &r->changedCapacity, r->changedCount + 1, sizeof(ReparsedNode)) < 0)
+        return -1;
+    r->changed[r->changedCount].node = node;
+    r->changed[r->changedCount].function = function;
+    r->changedCount++;
+    return 0;
+}
+
+static ASTNode *makeBlock(Parser *p, ASTNode **statements, int count)
+{
+    ASTNode *block = arena_alloc(&p->arena, sizeof(ASTNode));
+    ASTNode **list = arena_alloc(&p->arena, (count ? count : 1) * sizeof(ASTNode *));
+    if (!block || !list)
+        return NULL;
+    memset(block, 0, sizeof *block);
+    block->type = AST_PROGRAM;
+    for (int i = 0; i < count; i++)
+        if (statements[i])
+            list[block->data.program.count++] = statements[i];
+    block->data.program.statements = list;
+    return block;
+}
+
+// first of the count spans (relative to base) that ends past token at
+static int spanAfter(const TokenSpan *spans, int count, int base, int at)
+{
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (base + spans[mid].first + spans[mid].count > at)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+static int itemAfter(const Reparser *r, int at)
+{
+    int lo = 0, hi = r->itemCount;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (r->items[mid].span.first + r->items[mid].span.count > at)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+// the statements of the function item's body, which the pre-scan skipped
+static int buildBody(Reparser *r, ReparseItem *item)
+{
+    Parser *p = &r->parser;
+    ASTNode *fn = item->node;
+    ASTNode **nodes = NULL;
+    int capacity = 0, spanCapacity = 0, count = 0;
+    int at = item->span.first + item->bodyStart;
+    while (r->tokens.types[at] != TOKEN_DELIM_CLOSE_BRACE && r->tokens.types[at] != TOKEN_EOF) {
+        ASTNode *stmt;
+        if (parseItemAt(p, at, false, &stmt) < 0
+            || grow((void **)&nodes, &capacity, count + 1, sizeof(ASTNode *)) < 0
+            || grow((void **)&item->body, &spanCapacity, count + 1, sizeof(TokenSpan)) < 0) {
+            free(nodes);
+            return -1;
+        }
+        nodes[count] = stmt;
+        item->body[count].first = at - item->span.first;
+        item->body[count].count = p->current - at;
+        count++;
+        at = p->current;
+    }
+    fn->data.function.body = makeBlock(p, nodes, count);
+    fn->data.function.lazyBody = NULL;
+    free(nodes);
+    item->bodyCount = count;
+    return fn->data.function.body ? 0 : -1;
+}
+
+// parse the top-level item at token at, and its body if it is a function
+static int parseItem(Reparser *r, int at, ReparseItem *item)
+{
+    Parser *p = &r->parser;
+    memset(item, 0, sizeof *item);
+    item->span.first = at;
+    if (parseItemAt(p, at, true, &item->node) < 0)
+        return -1;
+    item->span.count = p->current - at;
+    ASTNode *fn = item->node;
+    if (fn && fn->type == AST_FUNCTION && fn->data.function.lazyBody) {
+        item->bodyStart = fn->data.function.lazyBody->start - at;
+        if (buildBody(r, item) < 0) {
+            free(item->body);
+            item->body = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void freeItems(ReparseItem *items, int count)
+{
+    for (int i = 0; i < count; i++)
+        free(items[i].body);
+}
+
+// point the program node at the items that parsed
+static int linkProgram(Reparser *r)
+{
+    ASTNode **statements = realloc(r->statements, (r->itemCount ? r->itemCount : 1) * sizeof(ASTNode *));
+    if (!statements)
+        return -1;
+    r->statements = statements;
+    int count = 0;
+    for (int i = 0; i < r->itemCount; i++)
+        if (r->items[i].node)
+            statements[count++] = r->items[i].node;
+    r->program->data.program.statements = statements;
+    r->program->data.program.count = count;
+    return 0;
+}
+
+static int parseAll(Reparser *r)
+{
+    Parser *p = &r->parser;
+    freeItems(r->items, r->itemCount);
+    r->itemCount = 0;
+    r->changedCount = 0;
+    r->full = true;
+    r->edits = 0;
+    r->program = NULL;
+    resetParser(p, &r->tokens);
+
+    int at = 0;
+    while (r->tokens.types[at] != TOKEN_EOF) {
+        ReparseItem item;
+        if (parseItem(r, at, &item) < 0)
+            return 0; // program stays NULL; the last diagnostic says why
+        if (grow((void **)&r->items, &r->itemCapacity, r->itemCount + 1, sizeof(ReparseItem)) < 0
+            || noteChanged(r, item.node, NULL) < 0) {
+            free(item.body);
+            return -1;
+        }
+        r->items[r->itemCount++] = item;
+        at = item.span.first + item.span.count;
+    }
+
+    r->program = arena_alloc(&p->arena, sizeof(ASTNode));
+    if (!r->program)
+        return -1;
+    memset(r->program, 0, sizeof *r->program);
+    r->program->type = AST_PROGRAM;
+    return linkProgram(r);
+}
+
+// Reparse inside the body of the one function the edit fell in, from the
+// statement before the changed tokens up to the first old statement the
+// new parse lines up with. 0 when the edit is not inside one body, or the
+// new statements do not line up with the old ones.
+static int reparseBody(Reparser *r, const TokenEdit *e)
+{
+    Parser *p = &r->parser;
+    int oldEnd = e->first + e->removed;
+    int delta = e->inserted - e->removed;
+    int a = itemAfter(r, e->first);
+    if (a == r->itemCount)
+        return 0;
+    ReparseItem *item = &r->items[a];
+    ASTNode *fn = item->node;
+    int base = item->span.first;
+    int close = base + item->span.count - 1; // the old '}'
+    if (!fn || fn->type != AST_FUNCTION || !fn->data.function.body || e->first < base + item->bodyStart || oldEnd > close)
+        return 0;
+
+    int k = spanAfter(item->body, item->bodyCount, base, e->first);
+    int pos = k > 0 ? base + item->body[k - 1].first + item->body[k - 1].count : base + item->bodyStart;
+    int m = k;
+    int firstChanged = r->changedCount;
+    ASTNode **nodes = NULL;
+    TokenSpan *spans = NULL;
+    int count = 0, nodeCapacity = 0, spanCapacity = 0;
+    for (;;) {
+        while (m < item->bodyCount
+               && (base + item->body[m].first < oldEnd || base + item->body[m].first + delta < pos))
+            m++;
+        if (m < item->bodyCount && base + item->body[m].first + delta == pos)
+            break;
+        TokenType t = r->tokens.types[pos];
+        if (t == TOKEN_DELIM_CLOSE_BRACE && pos == close + delta) {
+            m = item->bodyCount;
+            break;
+        }
+        if (t == TOKEN_DELIM_CLOSE_BRACE || t == TOKEN_EOF)
+            goto mismatch;
+        ASTNode *stmt;
+        if (parseItemAt(p, pos, false, &stmt) < 0)
+            goto failed;
+        if (p->current > close + delta)
+            goto mismatch;
+        if (grow((void **)&nodes, &nodeCapacity, count + 1, sizeof(ASTNode *)) < 0
+            || grow((void **)&spans, &spanCapacity, count + 1, sizeof(TokenSpan)) < 0
+            || noteChanged(r, stmt, fn) < 0)
+            goto failed;
+        nodes[count] = stmt;
+        spans[count].first = pos - base;
+        spans[count].count = p->current - pos;
+        count++;
+        pos = p->current;
+    }
+
+    // body statements [k, m) become the count new ones
+    int kept = item->bodyCount - m;
+    int total = k + count + kept;
+    ASTNode **statements = malloc((total ? total : 1) * sizeof(ASTNode *));
+    if (!statements)
+        goto failed;
+    // without syntax errors the body's statements are its spans, one to one
+    ASTNode **old = fn->data.function.body->data.program.statements;
+    memcpy(statements, old, k * sizeof(ASTNode *));
+    if (count)
+        memcpy(statements + k, nodes, count * sizeof(ASTNode *));
+    memcpy(statements + k + count, old + m, kept * sizeof(ASTNode *));
+    ASTNode *body = makeBlock(p, statements, total);
+    free(statements);
+    // sized for the spans both before and after the splice
+    int room = total > item->bodyCount ? total : item->bodyCount;
+    TokenSpan *bodySpans = realloc(item->body, (room ? room : 1) * sizeof(TokenSpan));
+    if (!body || !bodySpans)
+        goto failed;
+    item->body = bodySpans;
+    memmove(item->body + k + count, item->body + m, kept * sizeof(TokenSpan));
+    if (count)
+        memcpy(item->body + k, spans, count * sizeof(TokenSpan));
+    for (int i = k + count; i < total; i++)
+        item->body[i].first += delta;
+    item->bodyCount = total;
+    item->span.count += delta;
+    fn->data.function.body = body;
+    for (int i = a + 1; i < r->itemCount; i++)
+        r->items[i].span.first += delta;
+    free(nodes);
+    free(spans);
+    return 1;
+
+mismatch:
+    r->changedCount = firstChanged;
+    free(nodes);
+    free(spans);
+    return 0;
+failed:
+    free(nodes);
+    free(spans);
+    return -1;
+}
+
+// Reparse top-level items from the one before the changed tokens up to the
+// first old item the new parse lines up with, or the end of the script
+static int reparseItems(Reparser *r, const TokenEdit *e)
+{
+    int oldEnd = e->first + e->removed;
+    int delta = e->inserted - e->removed;
+    int a = itemAfter(r, e->first);
+    int pos = a > 0 ? r->items[a - 1].span.first + r->items[a - 1].span.count : 0;
+    int m = a;
+    ReparseItem *fresh = NULL;
+    int count = 0, capacity = 0;
+    for (;;) {
+        while (m < r->itemCount
+               && (r->items[m].span.first < oldEnd || r->items[m].span.first + delta < pos))
+            m++;
+        if (m < r->itemCount && r->items[m].span.first + delta == pos)
+            break;
+        if (r->tokens.types[pos] == TOKEN_EOF) {
+            m = r->itemCount;
+            break;
+        }
+        ReparseItem item;
+        if (parseItem(r, pos, &item) < 0)
+            goto failed;
+        if (grow((void **)&fresh, &capacity, count + 1, sizeof(ReparseItem)) < 0
+            || noteChanged(r, item.node, NULL) < 0) {
+            free(item.body);
+            goto failed;
+        }
+        fresh[count++] = item;
+        pos = item.span.first + item.span.count;
+    }
+
+    // items [a, m) become the count fresh ones
+    int kept = r->itemCount - m;
+    int total = a + count + kept;
+    if (grow((void **)&r->items, &r->itemCapacity, total, sizeof(ReparseItem)) < 0)
+        goto failed;
+    freeItems(r->items + a, m - a);
+    memmove(r->items + a + count, r->items + m, kept * sizeof(ReparseItem));
+    if (count)
+        memcpy(r->items + a, fresh, count * sizeof(ReparseItem));
+    for (int i = a + count; i < total; i++)
+        r->items[i].span.first += delta;
+    r->itemCount = total;
+    free(fresh);
+    return linkProgram(r) < 0 ? -1 : 1;
+
+failed:
+    freeItems(fresh, count);
+    free(fresh);
+    return -1;
+}
+
+int reparse_init(Reparser *r, const char *source, size_t length)
+{
+    memset(r, 0, sizeof *r);
+    if (tokenize_n(source, length, &r->tokens) < 0)
+        return -1;
+    initParser(&r->parser, &r->tokens);
+    r->parser.lazyBodies = true;
+    return parseAll(r);
+}
+
+int reparse_edit(Reparser *r, const char *source, size_t length, int start, int removed, int inserted)
+{
+    Parser *p = &r->parser;
+    TokenEdit e;
+    if (retokenize_edit_tokens(&r->tokens, source, length, start, removed, inserted, &e) < 0)
+        return -1;
+    updateParserStream(p);
+    if (!r->program || p->diagnosticCount > 0 || r->edits >= REPARSE_MAX_EDITS)
+        return parseAll(r);
+
+    r->changedCount = 0;
+    r->full = false;
+    int status = reparseBody(r, &e);
+    if (status == 0)
+        status = reparseItems(r, &e);
+    // a new syntax error: parse it all, for diagnostics in source order
+    if (status < 0 || p->diagnosticCount > 0)
+        return parseAll(r);
+    r->edits++;
+    return 0;
+}
+
+void reparse_free(Reparser *r)
+{
+    freeItems(r->items, r->itemCount);
+    free(r->items);
+    free(r->changed);
+    free(r->statements);
+    freeParser(&r->parser);
+    free_token_stream(&r->tokens);
+    memset(r, 0, sizeof *r);
+}
@@ -0,0 +1,81 @@
+#ifndef REPARSE_H
+#define REPARSE_H
+
+#include "lexer.h"
+#include "parser.h"
+#include <stdbool.h>
+
+/*
+ * Incremental parsing of a script under edit.
+ * Every top-level item and every statement of a function body remembers the
+ * token range it was parsed from. After an edit only the tokens around it
+ * are relexed, and only the innermost of those ranges the changed tokens
+ * fall in is parsed again, along with any neighbour the new parse runs
+ * into. The rest of the tree is kept as it is, by reference. A statement
+ * nested deeper, in an if or a loop, is parsed again with the body statement
+ * holding it.
+ *
+ * The whole script is parsed again instead while it has syntax errors (so
+ * that the diagnostics stay complete), after an edit the new parse cannot be
+ * lined up with the old tree around, and every REPARSE_MAX_EDITS edits, to
+ * free the subtrees replaced since.
+ */
+
+#define REPARSE_MAX_EDITS 1024
+
+typedef struct {
+    int first; // first token
+    int count; // tokens it covers
+} TokenSpan;
+
+typedef struct {
+    ASTNode *node;  // NULL when it had a syntax error
+    TokenSpan span;
+    // a function: its body statements start bodyStart tokens into span,
+    // just past the '{', and body holds their spans relative to span.first
+    int bodyStart;
+    TokenSpan *body;
+    int bodyCount;
+} ReparseItem;
+
+typedef struct {
+    ASTNode *node;     // a subtree built by the last parse
+    ASTNode *function; // the function whose body holds it; NULL at top level
+} ReparsedNode;
+
+typedef struct {
+    Parser parser; // owns the tree and the diagnostics
+    TokenStream tokens;
+    ASTNode *program; // NULL when parsing had to stop
+    ASTNode **statements; // program's statement list
+    ReparseItem *items;
+    int itemCount;
+    int itemCapacity;
+    // what the last parse built: every top-level item after a full parse
+    ReparsedNode *changed;
+    int changedCount;
+    int changedCapacity;
+    bool full;  // the last parse was of the whole script
+    int edits;  // incremental parses since the last full one
+} Reparser;
+
+// C++ linkage-aware section
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// lex and parse source, which must stay valid and NUL-padded like a
+// SourceBuffer; 0 on success (syntax errors are in parser), -1 when out of memory
+int reparse_init(Reparser *r, const char *source, size_t length);
+// after an edit replaced bytes [start, start + removed) of the old text by
+// the inserted bytes now at source[start, start + inserted), source being
+// the whole new text: bring tokens and tree up to date. 0 on success, -1
+// when out of memory, after which only reparse_free() may be called.
+int reparse_edit(Reparser *r, const char *source, size_t length, int start, int removed, int inserted);
+void reparse_free(Reparser *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REPARSE_H
@@ -11,14 +11,14 @@ SymbolTableEntry *currentScope = NULL;
 /**
  * @brief Adds a symbol (variable or function) to the symbol table.
  *
- * @param name The name of the symbol.
+ * @param name The interned name of the symbol; stored as is, not copied.
  * @param type The type of the symbol (e.g., int, float, function return type).
  * @param argCount The number of arguments (used for functions).
  */
-void addSymbol(char *name, Type *type)
+void addSymbol(Atom name, Type *type)
 {
     SymbolTableEntry *entry = malloc(sizeof(SymbolTableEntry));
-    entry->name = strdup(name);
+    entry->name = name;
     entry->type = type;
     entry->next = currentScope;
     entry->prevScope = NULL; // For nested scopes, see enterScope
@@ -107,7 +107,6 @@ void exitScope()
     while (entry)
     {
         SymbolTableEntry *next = entry->next;
-        free(entry->name);
         // Ideally also free type recursively here
         free(entry);
         entry = next;
@@ -119,15 +118,15 @@ void exitScope()
 /**
  * @brief Looks up a symbol by name in the current scope.
  *
- * @param name The symbol name to look for.
+ * @param name The interned symbol name to look for; compared by pointer.
  * @return Pointer to the SymbolTableEntry if found, or NULL if not found.
  */
-SymbolTableEntry *lookupSymbol(const char *name)
+SymbolTableEntry *lookupSymbol(Atom name)
 {
     SymbolTableEntry *entry = currentScope;
     while (entry)
     {
-        if (strcmp(entry->name, name) == 0)
+        if (entry->name == name)
         {
             return entry;
         }
@@ -142,7 +141,7 @@ SymbolTableEntry *lookupSymbol(const char *name)
  * @param name The symbol name to check.
  * @return Non-zero if declared, zero otherwise.
  */
-int isDeclared(char *name)
+int isDeclared(Atom name)
 {
     return lookupSymbol(name) != NULL;
 }
@@ -161,7 +160,8 @@ Type *getType(ASTNode *node) {
     switch (node->type) {
         case AST_NUMBER: {
             static Type intType = {.kind = TYPE_INT};
-            return &intType;
+            static Type floatType = {.kind = TYPE_FLOAT};
+            return node->data.number.kind == TOKEN_FLOAT ? &floatType : &intType;
         }
 
         case AST_STRING: {
@@ -229,7 +229,7 @@ Type *getType(ASTNode *node) {
                 }
                 case AST_TYPE_STRUCT: {
                     int count = node->data.type.structType.fieldCount;
-                    char **fieldNames = malloc(sizeof(char *) * count);
+                    Atom *fieldNames = malloc(sizeof(Atom) * count);
                     Type **fieldTypes = malloc(sizeof(Type *) * count);
                     for (int i = 0; i < count; i++) {
                         ASTNode *field = node->data.type.structType.fields[i];
@@ -314,7 +314,7 @@ void checkBinaryExpression(ASTNode *node)
  */
 void checkVariableDeclaration(ASTNode *node)
 {
-    char *varName = node->data.varDecl.varName;
+    Atom varName = node->data.varDecl.varName;
     if (isDeclared(varName))
     {
         printf("Semantic Error: Variable '%s' already declared.\n", varName);
@@ -334,7 +334,7 @@ void checkVariableDeclaration(ASTNode *node)
  */
 void checkVariableUsage(ASTNode *node)
 {
-    char *varName = node->data.identifier;
+    Atom varName = node->data.identifier;
     if (!isDeclared(varName))
     {
         printf("Semantic Error: Variable '%s' used before declaration.\n", varName);
@@ -405,7 +405,7 @@ void checkFunctionCall(ASTNode *node)
         return;
     }
 
-    const char *funcName = callee->data.identifier;
+    Atom funcName = callee->data.identifier;
     SymbolTableEntry *entry = lookupSymbol(funcName);
 
     if (!entry) {
@@ -544,105 +544,135 @@ void checkArrayInitializer(ASTNode *node, Type *expectedType) {
 
 
 /**
- * @brief Recursively traverses the AST and performs semantic analysis checks on each node.
+ * @brief Pushes a child onto the traversal stack, growing it as needed.
  *
- * @param node The current AST node being visited.
+ * @param stack The stack, reallocated when full.
+ * @param count Number of nodes on it.
+ * @param capacity Its allocated size in nodes.
+ * @param node The child; NULL children are skipped.
+ */
+static void pushTraversal(ASTNode ***stack, int *count, int *capacity, ASTNode *node)
+{
+    if (!node)
+        return;
+    if (*count == *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *stack = realloc(*stack, sizeof(ASTNode *) * *capacity);
+        if (!*stack)
+        {
+            fprintf(stderr, "Memory allocation failed in traverse\n");
+            exit(1);
+        }
+    }
+    (*stack)[(*count)++] = node;
+}
+
+/**
+ * @brief Traverses the AST and performs semantic analysis checks on each node.
+ *
+ * Nodes still to visit are kept on an explicit stack rather than the C stack,
+ * so trees of any depth can be walked. Children are pushed last first, so
+ * they are visited in source order.
+ *
+ * @param node The root of the subtree to visit.
  *             Assumes the node and its children are properly initialized.
  */
 void traverse(ASTNode *node)
 {
-    if (!node) return;
+    ASTNode **stack = NULL;
+    int count = 0, capacity = 0;
+    pushTraversal(&stack, &count, &capacity, node);
 
-    switch (node->type)
+    while (count > 0)
     {
-    case AST_PROGRAM:
-        for (int i = 0; i < node->data.program.count; i++)
-            traverse(node->data.program.statements[i]);
-        break;
-
-    case AST_VAR_DECL:
-        if (node->data.varDecl.varType)
-            traverse(node->data.varDecl.varType);
-        if (node->data.varDecl.initializer)
-            traverse(node->data.varDecl.initializer);
-        break;
-
-    case AST_TYPE:
-        // No traversal needed for type leaf
-        break;
-
-    case AST_NUMBER:
-    case AST_STRING:
-    case AST_IDENTIFIER:
-        // Leaf nodes — no traversal needed
-        break;
-
-    case AST_BINARY_EXPR:
-        traverse(node->data.binary.left);
-        traverse(node->data.binary.right);
-        break;
-
-    case AST_UNARY_EXPR:
-        traverse(node->data.unary.operand);
-        break;
-
-    case AST_FUNCTION:
-        if (node->data.function.returnType)
-            traverse(node->data.function.returnType);
-        traverse(node->data.function.body);
-        break;
-
-    case AST_FUNCTION_CALL:
-        traverse(node->data.call.callee);
-        for (int i = 0; i < node->data.call.argCount; i++)
-            traverse(node->data.call.arguments[i]);
-        break;
-
-    case AST_RETURN:
-        if (node->data.returnStmt.expr)
-            traverse(node->data.returnStmt.expr);
-        break;
-
-    case AST_IF:
-        traverse(node->data.ifStmt.condition);
-        traverse(node->data.ifStmt.thenBranch);
-        if (node->data.ifStmt.elseBranch)
-            traverse(node->data.ifStmt.elseBranch);
-        break;
-
-    case AST_PRINT_STATEMENT:
-        traverse(node->data.printStmt.expr);
-        break;
-
-    case AST_WHILE:
-        traverse(node->data.whileStmt.condition);
-        traverse(node->data.whileStmt.body);
-        break;
-
-    case AST_FOR:
-        if (node->data.forStmt.init)
-            traverse(node->data.forStmt.init);
-        if (node->data.forStmt.condition)
-            traverse(node->data.forStmt.condition);
-        if (node->data.forStmt.increment)
-            traverse(node->data.forStmt.increment);
-        traverse(node->data.forStmt.body);
-        break;
-
-    case AST_EXPR_STMT:
-        if (node->data.ExprStmt.expr)
-            traverse(node->data.ExprStmt.expr);
-        break;
-
-    case AST_ARRAY_LITERAL:
-        for (int i = 0; i < node->data.arrayLiteral.elementCount; i++)
-            traverse(node->data.arrayLiteral.elements[i]);
-        break;
+        node = stack[--count];
+        switch (node->type)
+        {
+        case AST_PROGRAM:
+            for (int i = node->data.program.count - 1; i >= 0; i--)
+                pushTraversal(&stack, &count, &capacity, node->data.program.statements[i]);
+            break;
+
+        case AST_VAR_DECL:
+            pushTraversal(&stack, &count, &capacity, node->data.varDecl.initializer);
+            pushTraversal(&stack, &count, &capacity, node->data.varDecl.varType);
+            break;
+
+        case AST_TYPE:
+            // No traversal needed for type leaf
+            break;
+
+        case AST_NUMBER:
+        case AST_STRING:
+        case AST_IDENTIFIER:
+        case AST_IMPORT:
+            // Leaf nodes — no traversal needed
+            break;
+
+        case AST_BINARY_EXPR:
+            pushTraversal(&stack, &count, &capacity, node->data.binary.right);
+            pushTraversal(&stack, &count, &capacity, node->data.binary.left);
+            break;
+
+        case AST_UNARY_EXPR:
+            pushTraversal(&stack, &count, &capacity, node->data.unary.operand);
+            break;
+
+        case AST_FUNCTION:
+            // a body still left lazy is checked when the function is first called
+            if (!node->data.function.lazyBody)
+                pushTraversal(&stack, &count, &capacity, node->data.function.body);
+            pushTraversal(&stack, &count, &capacity, node->data.function.returnType);
+            break;
+
+        case AST_FUNCTION_CALL:
+            for (int i = node->data.call.argCount - 1; i >= 0; i--)
+                pushTraversal(&stack, &count, &capacity, node->data.call.arguments[i]);
+            pushTraversal(&stack, &count, &capacity, node->data.call.callee);
+            break;
+
+        case AST_RETURN:
+            pushTraversal(&stack, &count, &capacity, node->data.returnStmt.expr);
+            break;
+
+        case AST_IF:
+            pushTraversal(&stack, &count, &capacity, node->data.ifStmt.elseBranch);
+            pushTraversal(&stack, &count, &capacity, node->data.ifStmt.thenBranch);
+            pushTraversal(&stack, &count, &capacity, node->data.ifStmt.condition);
+            break;
+
+        case AST_PRINT_STATEMENT:
+            pushTraversal(&stack, &count, &capacity, node->data.printStmt.expr);
+            break;
+
+        case AST_WHILE:
+            pushTraversal(&stack, &count, &capacity, node->data.whileStmt.body);
+            pushTraversal(&stack, &count, &capacity, node->data.whileStmt.condition);
+            break;
+
+        case AST_FOR:
+            pushTraversal(&stack, &count, &capacity, node->data.forStmt.body);
+            pushTraversal(&stack, &count, &capacity, node->data.forStmt.increment);
+            pushTraversal(&stack, &count, &capacity, node->data.forStmt.condition);
+            pushTraversal(&stack, &count, &capacity, node->data.forStmt.init);
+            break;
+
+        case AST_EXPR_STMT:
+            pushTraversal(&stack, &count, &capacity, node->data.ExprStmt.expr);
+            break;
+
+        case AST_ARRAY_LITERAL:
+            for (int i = node->data.arrayLiteral.elementCount - 1; i >= 0; i--)
+                pushTraversal(&stack, &count, &capacity, node->data.arrayLiteral.elements[i]);
+            break;
 
-    default:
-        // Unknown or unsupported node — no action
-        break;
+        default:
+            // Unknown or unsupported node — no action
+            break;
+        }
     }
+    free(stack);
 }
 
 /**
@@ -677,6 +707,7 @@ const char *ASTNodeTypeNames[] = {
     "AST_WHILE",
     "AST_FOR",
     "AST_EXPR_STMT",
+    "AST_IMPORT",
     "AST_TYPE_INT",
     "AST_TYPE_FLOAT",
     "AST_TYPE_BOOL",
@@ -730,7 +761,7 @@ void debugTraverse(ASTNode *node)
         {
             int kindIndex = node->data.type.typeKind - AST_TYPE_INT;
             // Defensive: check bounds
-            if (kindIndex >= 0 && kindIndex < (sizeof(TypeKindNames)/sizeof(TypeKindNames[0])))
+            if (kindIndex >= 0 && kindIndex < (int)(sizeof(TypeKindNames)/sizeof(TypeKindNames[0])))
                 printf("Node: TYPE - Kind: %s\n", TypeKindNames[kindIndex]);
             else
                 printf("Node: TYPE - Kind: Unknown (%d)\n", node->data.type.typeKind);
@@ -738,25 +769,32 @@ void debugTraverse(ASTNode *node)
         break;
 
     case AST_NUMBER:
-        printf("Node: NUMBER - Value: %d\n", node->data.number);
+        if (node->data.number.kind == TOKEN_FLOAT)
+            printf("Node: NUMBER - Value: %g\n", node->data.number.floatValue);
+        else
+            printf("Node: NUMBER - Value: %d\n", node->data.number.intValue);
         break;
 
     case AST_STRING:
         printf("Node: STRING - Value: %s\n", node->data.string);
         break;
 
+    case AST_IMPORT:
+        printf("Node: IMPORT - Path: %s\n", node->data.string);
+        break;
+
     case AST_IDENTIFIER:
         printf("Node: IDENTIFIER - Name: %s\n", node->data.identifier);
         break;
 
     case AST_BINARY_EXPR:
-        printf("Node: BINARY_EXPR - Operator: %s\n", node->data.binary.op->lexeme);
+        printf("Node: BINARY_EXPR - Operator: %s\n", opSpelling(node->data.binary.op));
         debugTraverse(node->data.binary.left);
         debugTraverse(node->data.binary.right);
         break;
 
     case AST_UNARY_EXPR:
-        printf("Node: UNARY_EXPR - Operator: %s\n", node->data.unary.op->lexeme);
+        printf("Node: UNARY_EXPR - Operator: %s\n", opSpelling(node->data.unary.op));
         debugTraverse(node->data.unary.operand);
         break;
 
@@ -766,7 +804,7 @@ void debugTraverse(ASTNode *node)
         if (node->data.function.returnType)
             debugTraverse(node->data.function.returnType);
         printf("Body:\n");
-        debugTraverse(node->data.function.body);
+        debugTraverse(functionBody(node));
         break;
 
     case AST_FUNCTION_CALL:
@@ -845,7 +883,7 @@ void debugTraverse(ASTNode *node)
         // Unknown or unsupported node
         if (node->type >= AST_TYPE_INT && node->type <= AST_TYPE_STRUCT) {
             int kindIndex = node->type - AST_TYPE_INT;
-            if (kindIndex >= 0 && kindIndex < (sizeof(TypeKindNames)/sizeof(TypeKindNames[0])))
+            if (kindIndex >= 0 && kindIndex < (int)(sizeof(TypeKindNames)/sizeof(TypeKindNames[0])))
                 printf("Node: TYPE (Leaf) - Kind: %s\n", TypeKindNames[kindIndex]);
             else
                 printf("Node: Unknown AST_TYPE Leaf (%d)\n", node->type);
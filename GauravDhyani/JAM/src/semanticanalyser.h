@@ -14,13 +14,13 @@ typedef struct Type {
     union {
         struct { struct Type *elementType; } array;
         struct { struct Type **elements; int count; } tuple;
-        struct { char **fieldNames; struct Type **fieldTypes; int count; } structType;
+        struct { Atom *fieldNames; struct Type **fieldTypes; int count; } structType;
         struct { struct Type **paramTypes; int paramCount; struct Type *returnType; } function;
     };
 } Type;
 
 typedef struct SymbolTableEntry {
-    char *name;
+    Atom name;                        // interned, compared by pointer
     Type *type;                       // pointer to Type struct now
     struct SymbolTableEntry *next;   // next symbol in current scope
 
@@ -33,14 +33,14 @@ extern SymbolTableEntry *symbolTable;
 extern SymbolTableEntry *currentScope;
 
 // Function declarations
-void addSymbol(char *name, Type *type);
+void addSymbol(Atom name, Type *type);
 Type* createFunctionType(Type **paramTypes, int paramCount, Type *returnType);
 int typeEquals(Type *a, Type *b);
 void enterScope();
 TypeKind getNodeType(ASTNode *node);
 void exitScope();
-SymbolTableEntry *lookupSymbol(const char *name);
-int isDeclared(char *name);
+SymbolTableEntry *lookupSymbol(Atom name);
+int isDeclared(Atom name);
 Type* getType(ASTNode *node);
 int getFunctionArgCount(SymbolTableEntry *entry);
 int getASTArgCount(ASTNode *node);
@@ -0,0 +1,177 @@
+#include "sourceloader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SOURCE_LOADER_MMAP 1
+#include <unistd.h>
+#include <sys/mman.h>
+#else
+#include <io.h>
+#define read _read
+#define close _close
+#endif
+
+// -------------------------
+// read() fallback
+// -------------------------
+
+/**
+ * @brief Reads everything from a descriptor into a padded heap buffer.
+ *
+ * Used for pipes, stdin and anything else that cannot be mapped. Short reads
+ * and EINTR are retried until end of input.
+ *
+ * @return 0 on success, -1 on a read or allocation error.
+ */
+static int read_all(int fd, SourceBuffer *out)
+{
+    size_t cap = 64 * 1024;
+    size_t len = 0;
+    char *buf = malloc(cap + SOURCE_PADDING);
+    if (!buf)
+        return -1;
+
+    while (1)
+    {
+        if (len == cap)
+        {
+            char *grown = realloc(buf, cap * 2 + SOURCE_PADDING);
+            if (!grown)
+            {
+                free(buf);
+                return -1;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            free(buf);
+            return -1;
+        }
+        if (n == 0)
+            break;
+        len += (size_t)n;
+    }
+
+    memset(buf + len, 0, SOURCE_PADDING);
+    out->data = buf;
+    out->length = len;
+    out->mappedSize = 0;
+    return 0;
+}
+
+// -------------------------
+// mmap loader
+// -------------------------
+
+#ifdef SOURCE_LOADER_MMAP
+/**
+ * @brief Maps a regular file read-only with zero padding behind it.
+ *
+ * An anonymous zero-filled region large enough for the file plus padding is
+ * reserved first, and the file is mapped over its start with MAP_FIXED. The
+ * bytes past EOF in the last file page read as zero, and the pages after it
+ * stay anonymous zero pages, so the padding exists even when the file size is
+ * an exact multiple of the page size.
+ *
+ * @return 0 on success, -1 if the file could not be mapped.
+ */
+static int map_file(int fd, size_t size, SourceBuffer *out)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t total = (size + SOURCE_PADDING + page - 1) / page * page;
+
+    char *base = mmap(NULL, total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return -1;
+
+    int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    if (mmap(base, size, PROT_READ, flags, fd, 0) == MAP_FAILED)
+    {
+        munmap(base, total);
+        return -1;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(base, size, MADV_SEQUENTIAL);
+#endif
+
+    out->data = base;
+    out->length = size;
+    out->mappedSize = total;
+    return 0;
+}
+#endif
+
+/**
+ * @brief Loads a script from an open descriptor, mapping it when possible.
+ *
+ * Regular non-empty files are memory-mapped; everything else is read.
+ * The descriptor is not closed.
+ *
+ * @return 0 on success, -1 on failure (errno describes the error).
+ */
+int load_source_fd(int fd, SourceBuffer *out)
+{
+#ifdef SOURCE_LOADER_MMAP
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        if (map_file(fd, (size_t)st.st_size, out) == 0)
+            return 0;
+        // fall through to read() if the mapping was refused
+    }
+#endif
+    return read_all(fd, out);
+}
+
+/**
+ * @brief Loads a script file; "-" loads standard input.
+ *
+ * @param filename Path to the script file, or "-".
+ * @param out Receives the padded source buffer.
+ * @return 0 on success, -1 on failure (errno describes the error).
+ */
+int load_source(const char *filename, SourceBuffer *out)
+{
+    if (strcmp(filename, "-") == 0)
+        return load_source_fd(0, out);
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    int result = load_source_fd(fd, out);
+    int saved = errno;
+    close(fd); // the mapping stays valid after close
+    errno = saved;
+    return result;
+}
+
+/**
+ * @brief Unmaps or frees a buffer returned by load_source().
+ */
+void release_source(SourceBuffer *source)
+{
+    if (!source->data)
+        return;
+#ifdef SOURCE_LOADER_MMAP
+    if (source->mappedSize)
+        munmap(source->data, source->mappedSize);
+    else
+#endif
+        free(source->data);
+    source->data = NULL;
+    source->length = 0;
+    source->mappedSize = 0;
+}
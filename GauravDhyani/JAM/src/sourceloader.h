@@ -0,0 +1,30 @@
+#ifndef SOURCE_LOADER_H
+#define SOURCE_LOADER_H
+
+#include <stddef.h>
+
+// Zero bytes guaranteed after the last source byte. The first one is the
+// NUL terminator; the rest let the lexer (and its scan kernels) read ahead
+// at EOF without bounds checks.
+#define SOURCE_PADDING 64
+
+typedef struct {
+    char *data;        // source text followed by SOURCE_PADDING zero bytes
+    size_t length;     // source length in bytes, padding excluded
+    size_t mappedSize; // size of the mapping, 0 when data came from malloc
+} SourceBuffer;
+
+// C++ linkage-aware section
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int load_source(const char *filename, SourceBuffer *out);
+int load_source_fd(int fd, SourceBuffer *out);
+void release_source(SourceBuffer *source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SOURCE_LOADER_H